@@ -1,58 +1,198 @@
 #include "lib/simple_dataframe.h"
+#include "sdk/parallel_parser.h"
 #include "sdk/parser.h"
+#include "utils/cli_flags.h"
+#include "utils/mapped_file.h"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <new>
 
 using namespace std;
 
+/* every heap allocation in the process, so a stage can report allocations per
+ * row. operator new[] and delete[] forward to these by default. Not inlined,
+ * so the compiler doesn't see delete of a new'd pointer become free. */
+static atomic<long> n_allocs(0);
+
+__attribute__((noinline)) void *operator new(size_t size) {
+  n_allocs++;
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void *p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+/**
+ * timings of one stage of the benchmark over every trial
+ */
+class StageResult {
+public:
+  string name;
+  int rows = 0;
+  vector<double> trial_ms;
+  long allocs = 0; // per trial
+
+  double min_ms() const {
+    return *min_element(trial_ms.begin(), trial_ms.end());
+  }
+
+  double median_ms() const {
+    vector<double> sorted(trial_ms);
+    sort(sorted.begin(), sorted.end());
+    return sorted[sorted.size() / 2];
+  }
+
+  double mb_per_s(long length) const { return (length / 1e3) / median_ms(); }
+
+  double rows_per_s() const { return rows / (median_ms() / 1e3); }
+
+  double allocs_per_row() const { return rows ? (double)allocs / rows : 0; }
+};
+
+/**
+ * run fn warmup times untimed and then trials times, fn returns the number of
+ * rows it produced
+ */
+StageResult run_stage(const string &name, int warmup, int trials,
+                      const function<int()> &fn) {
+  StageResult res;
+  res.name = name;
+  for (int i = 0; i < warmup; i++)
+    fn();
+  for (int i = 0; i < trials; i++) {
+    long allocs_before = n_allocs;
+    auto t1 = chrono::high_resolution_clock::now();
+    res.rows = fn();
+    auto t2 = chrono::high_resolution_clock::now();
+    res.allocs = n_allocs - allocs_before;
+    res.trial_ms.push_back(chrono::duration<double, milli>(t2 - t1).count());
+  }
+  return res;
+}
+
 /**
- * Example benchmarking the parser against a file. Prints the length of the
- * file in bytes, the schema for the file, whether the parse was successful,
- * and the time it took to parse the file into a DataFrame in milliseconds.
+ * Benchmarks the parser against a memory-mapped SOR file, e.g. one of the
+ * corpora generated by df_builder for `make bench`. Each stage is run warmup
+ * times and then timed over a number of trials:
+ *   infer_schema    - sampling the schema from across the file
+ *   parse_byte_wise - parsing into a SimpleDataFrame a byte at a time
+ *   parse_scanner   - parsing into a SimpleDataFrame with the SIMD scanner
+ *   build_chunks    - parsing into DataFrameChunks on one thread
+ *   parallel_chunks - parsing into DataFrameChunks with the ParallelParser
+ * For each stage the median and minimum time, MB/s and rows/s (from the
+ * median) and heap allocations per row are printed. With --json the results
+ * are also appended to the given file as one JSON object per stage per line,
+ * to compare across runs.
  *
- * Benchmark uses a SimpleDataFrame which is a fully in-memory representation
- * of a DataFrame.
+ * e.g.
+ * $ bench.exe --file data.sor --trials 5 --warmup 1 --json bench.jsonl
  * authors: @grahamwren, @jagen31
  */
 int main(int argc, char **argv) {
-  const char *filename = argc > 1 ? argv[1] : "datafile.sor";
-  FILE *fd = fopen(filename, "r");
-  cout << "opened file " << fd << " name: " << filename << endl;
-  if (fd != 0) {
-    fseek(fd, 0, SEEK_END);
-    long length = ftell(fd);
-    fseek(fd, 0, SEEK_SET);
-
-    char *buf = new char[length];
-    fread(buf, length, 1, fd);
-
-    cout << "starting parsing len " << length << " file " << filename << endl;
-    auto t1 = chrono::high_resolution_clock::now();
+  CliFlags cli;
+  cli.add_flag("--file")
+      .add_flag("--trials")
+      .add_flag("--warmup")
+      .add_flag("--json")
+      .parse(argc, argv);
+  string filename = cli.get_flag("--file").value_or("datafile.sor");
+  int trials = max(1, stoi(cli.get_flag("--trials").value_or("5")));
+  int warmup = stoi(cli.get_flag("--warmup").value_or("1"));
+  auto json_file = cli.get_flag("--json");
 
-    Parser parser(length, buf);
-    Schema scm;
-    parser.infer_schema(scm);
-    SimpleDataFrame df(scm);
+  MappedFile file(filename.c_str());
+  if (!file.ok()) {
+    cout << "Unknown file: " << filename << endl;
+    return 1;
+  }
+  long length = file.length();
+  char *buf = file.data();
 
-    bool success = parser.parse_file(df);
-    auto t2 = chrono::high_resolution_clock::now();
+  /* fault in the whole mapping first so no stage pays for it */
+  volatile char sink = 0;
+  for (long i = 0; i < length; i += 4096)
+    sink = sink + buf[i];
+
+  Schema scm;
+  Parser(length, buf).infer_schema_sampled(scm);
+  char scm_buf[scm.width() + 1];
+  scm.c_str(scm_buf);
+  cout << "file " << filename << " len " << length << " schema " << scm_buf
+       << endl;
 
-    char scm_buf[scm.width() + 1];
-    scm.c_str(scm_buf);
-    cout << "schema " << scm_buf << endl;
-    if (success) {
-      cout << "parse success for " << df.nrows() << " rows" << endl;
-    } else {
-      cout << "parse fail" << endl;
+  vector<StageResult> results;
+  results.push_back(run_stage("infer_schema", warmup, trials, [&]() {
+    Schema inferred;
+    Parser(length, buf).infer_schema_sampled(inferred);
+    return 0;
+  }));
+  for (bool use_scanner : {false, true}) {
+    const char *name = use_scanner ? "parse_scanner" : "parse_byte_wise";
+    results.push_back(run_stage(name, warmup, trials, [&]() {
+      Parser parser(length, buf);
+      parser.use_scanner = use_scanner;
+      SimpleDataFrame df(scm);
+      bool success = parser.parse_file(df);
+      assert(success);
+      return df.nrows();
+    }));
+  }
+  results.push_back(run_stage("build_chunks", warmup, trials, [&]() {
+    Parser parser(length, buf);
+    int n_rows = 0;
+    while (true) {
+      DataFrameChunk dfc(scm);
+      if (!parser.parse_n_lines(DF_CHUNK_SIZE, dfc))
+        break;
+      dfc.finalize();
+      n_rows += dfc.nrows();
+      if (!dfc.is_full())
+        break;
     }
-    if (length < 2048) {
-      df.print();
+    return n_rows;
+  }));
+  results.push_back(run_stage("parallel_chunks", warmup, trials, [&]() {
+    Parser parser(length, buf);
+    ParallelParser pparser(scm, parser);
+    vector<DataFrameChunk> dfcs;
+    int n_rows = 0;
+    while (pparser.parse_chunks(ThreadPool::shared().slots(), dfcs) > 0) {
+      for (DataFrameChunk &dfc : dfcs)
+        n_rows += dfc.nrows();
+    }
+    return n_rows;
+  }));
+
+  /* schema inference produces no rows, report the rows in the file */
+  results[0].rows = results[1].rows;
+
+  for (StageResult &res : results) {
+    cout << res.name << ": median " << res.median_ms() << " ms, min "
+         << res.min_ms() << " ms, " << res.mb_per_s(length) << " MB/s, "
+         << res.rows_per_s() << " rows/s, " << res.allocs_per_row()
+         << " allocs/row" << endl;
+  }
+
+  if (json_file) {
+    ofstream out(*json_file, ios::app);
+    for (StageResult &res : results) {
+      out << "{\"file\":\"" << filename << "\",\"bytes\":" << length
+          << ",\"schema\":\"" << scm_buf << "\",\"rows\":" << res.rows
+          << ",\"stage\":\"" << res.name << "\",\"threads\":"
+          << (res.name == "parallel_chunks" ? ThreadPool::shared().slots() : 1)
+          << ",\"trials\":" << trials << ",\"median_ms\":" << res.median_ms()
+          << ",\"min_ms\":" << res.min_ms()
+          << ",\"mb_per_s\":" << res.mb_per_s(length)
+          << ",\"rows_per_s\":" << res.rows_per_s()
+          << ",\"allocs_per_row\":" << res.allocs_per_row() << "}" << endl;
     }
-    chrono::duration<double, milli> diff = t2 - t1;
-    cout << diff.count() << " ms" << endl;
-    fclose(fd);
-  } else {
-    cout << "Unknown file: " << filename << endl;
   }
   return 0;
 }
@@ -0,0 +1,99 @@
+#include "kv/kv.h"
+#include "sdk/cluster.h"
+#include "utils/cli_flags.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * median ms of running fn trials times, after running it once untimed
+ */
+double median_ms(int trials, const function<void()> &fn) {
+  fn();
+  vector<double> ms;
+  for (int i = 0; i < trials; i++) {
+    auto t1 = chrono::high_resolution_clock::now();
+    fn();
+    auto t2 = chrono::high_resolution_clock::now();
+    ms.push_back(chrono::duration<double, milli>(t2 - t1).count());
+  }
+  sort(ms.begin(), ms.end());
+  return ms[ms.size() / 2];
+}
+
+void report(const string &name, long bytes, double ms) {
+  cout << name << ": median " << ms << " ms, " << (bytes / 1e6) / ms
+       << " GB/s" << endl;
+}
+
+/**
+ * Microbenchmark of PUTting one DataFrameChunk of --cols float columns (16 by
+ * default) to a KV node on loopback, in this process. Reports GB/s of
+ * serialized chunk PUT, compared to serializing the chunk and to memcpy-ing
+ * the serialized bytes, the most the transport could hope for.
+ *
+ * e.g.
+ * $ bench_put.exe --cols 16 --trials 10
+ * authors: @grahamwren, @jagen31
+ */
+int main(int argc, char **argv) {
+  CliFlags cli;
+  cli.add_flag("--cols").add_flag("--trials").parse(argc, argv);
+  int cols = max(1, stoi(cli.get_flag("--cols").value_or("16")));
+  int trials = max(1, stoi(cli.get_flag("--trials").value_or("10")));
+
+  IpV4Addr ip("127.0.0.1");
+  thread node([&]() { KV kv(ip); });
+  /* give the node a moment to start listening */
+  this_thread::sleep_for(chrono::milliseconds(100));
+  Cluster cluster(ip);
+
+  Key key("bench_put");
+  Schema scm(string(cols, 'F').c_str());
+  bool created = cluster.create(key, scm);
+  assert(created);
+
+  mt19937 gen(4500);
+  uniform_real_distribution<float> dist(-1e6, 1e6);
+  DataFrameChunk chunk(scm);
+  Row row(scm);
+  for (int y = 0; y < DF_CHUNK_SIZE; y++) {
+    for (int x = 0; x < cols; x++)
+      row.set(x, dist(gen));
+    chunk.add_row(row);
+  }
+
+  WriteCursor wc;
+  chunk.serialize(wc);
+  long bytes = wc.length();
+  cout << "chunk: " << DF_CHUNK_SIZE << " rows, " << bytes << " bytes" << endl;
+
+  unique_ptr<uint8_t[]> dst(new uint8_t[bytes]);
+  double ms =
+      median_ms(trials, [&]() { memcpy(dst.get(), wc.begin(), bytes); });
+  report("memcpy", bytes, ms);
+
+  ms = median_ms(trials, [&]() {
+    WriteCursor out;
+    chunk.serialize(out);
+  });
+  report("serialize", bytes, ms);
+
+  ms = median_ms(trials, [&]() {
+    bool put = cluster.put(key, 0, chunk);
+    assert(put);
+  });
+  report("put", bytes, ms);
+
+  cluster.shutdown();
+  node.join();
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include "lib/reduce.h"
+#include "lib/rowers.h"
+#include "utils/cli_flags.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+/**
+ * median ms of running fn trials times, after running it once untimed
+ */
+double median_ms(int trials, const function<void()> &fn) {
+  fn();
+  vector<double> ms;
+  for (int i = 0; i < trials; i++) {
+    auto t1 = chrono::high_resolution_clock::now();
+    fn();
+    auto t2 = chrono::high_resolution_clock::now();
+    ms.push_back(chrono::duration<double, milli>(t2 - t1).count());
+  }
+  sort(ms.begin(), ms.end());
+  return ms[ms.size() / 2];
+}
+
+void report(const string &name, long bytes, double ms) {
+  cout << name << ": median " << ms << " ms, " << (bytes / 1e6) / ms
+       << " GB/s" << endl;
+}
+
+/**
+ * Microbenchmark of the aggregation kernels in Reduce on one core, over
+ * random int and float columns of --values values (16M by default) with no
+ * missing values and with 10% missing. Reports GB/s of column values reduced
+ * by each kernel supported by this CPU, by the kernel Reduce picks, and by a
+ * SumRower mapped over the same ints as DataFrameChunks.
+ *
+ * e.g.
+ * $ bench_reduce.exe --values 16777216 --trials 5
+ * authors: @grahamwren, @jagen31
+ */
+int main(int argc, char **argv) {
+  CliFlags cli;
+  cli.add_flag("--values").add_flag("--trials").parse(argc, argv);
+  int n = stoi(cli.get_flag("--values").value_or("16777216"));
+  int trials = max(1, stoi(cli.get_flag("--trials").value_or("5")));
+
+  mt19937 gen(4500);
+  vector<int32_t> ints(n);
+  vector<float> floats(n);
+  vector<uint8_t> missing((n + 7) / 8, 0);
+  for (int i = 0; i < n; i++) {
+    ints[i] = gen() % 2000000 - 1000000;
+    floats[i] = ints[i] * 0.25f;
+    if (gen() % 10 == 0)
+      missing[i / 8] |= 1 << (i % 8);
+  }
+
+  vector<pair<string, Reduce::int_fn_t>> int_fns = {
+      {"scalar", Reduce::ints_scalar_fn}};
+  vector<pair<string, Reduce::float_fn_t>> float_fns = {
+      {"scalar", Reduce::floats_scalar_fn}};
+#ifdef REDUCE_X86
+  int_fns.emplace_back("sse2", Reduce::ints_sse2);
+  float_fns.emplace_back("sse2", Reduce::floats_sse2);
+  if (__builtin_cpu_supports("avx2")) {
+    int_fns.emplace_back("avx2", Reduce::ints_avx2);
+    float_fns.emplace_back("avx2", Reduce::floats_avx2);
+  }
+#endif
+  int_fns.emplace_back("dispatched", Reduce::int_kernel());
+  float_fns.emplace_back("dispatched", Reduce::float_kernel());
+
+  long bytes = (long)n * 4;
+  for (const uint8_t *m : {(const uint8_t *)nullptr,
+                           (const uint8_t *)missing.data()}) {
+    string suffix = m ? " (10% missing)" : "";
+    for (auto &[name, fn] : int_fns) {
+      IntReduction r;
+      double ms = median_ms(trials, [&]() {
+        r = IntReduction();
+        fn(ints.data(), m, n, r);
+      });
+      report("ints " + name + suffix, bytes, ms);
+    }
+    for (auto &[name, fn] : float_fns) {
+      FloatReduction r;
+      double ms = median_ms(trials, [&]() {
+        r = FloatReduction();
+        fn(floats.data(), m, n, r);
+      });
+      report("floats " + name + suffix, bytes, ms);
+    }
+  }
+
+  /* the same ints through DataFrameChunks, RowBatches and SumRower */
+  Schema scm("I");
+  vector<DataFrameChunk> chunks;
+  Row row(scm);
+  for (int i = 0; i < n; i++) {
+    if (i % DF_CHUNK_SIZE == 0)
+      chunks.emplace_back(scm);
+    row.set(0, ints[i]);
+    chunks.back().add_row(row);
+  }
+  double ms = median_ms(trials, [&]() {
+    SumRower rower(0);
+    for (int ci = 0; ci < chunks.size(); ci++)
+      chunks[ci].map(rower, ci * DF_CHUNK_SIZE);
+  });
+  report("SumRower over chunks", bytes, ms);
+  return 0;
+}
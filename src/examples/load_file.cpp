@@ -4,22 +4,31 @@
 
 /**
  * EAU2 cluster application for loading a SOR file into the Cluster. Takes
- * arguments for the Key to store the file under, the filename to load, and an
- * IP address in the cluster to register with.
+ * arguments for the Key to store the file under, the filename to load ("-" to
+ * stream from stdin, .gz and .zst files are decompressed as they are loaded),
+ * and an IP address in the cluster to register with.
+ * Optionally takes the Schema of the file, e.g. "--schema IIFSB", to skip
+ * inferring it, and a Bloom filter for each int column of each chunk, sized by
+ * false positive rate, e.g. "--bloom-fpr 0.01", or by bits per value, e.g.
+ * "--bloom-bits 10", see DFOptions.
  * authors: @grahamwren, @jagen31
  */
 class LoadFile : public Application {
 public:
   Key data_key;
   string filename;
+  optional<Schema> schema;
+  DFOptions opts;
 
-  LoadFile(const IpV4Addr &ip, const string &key, const string &filename)
-      : Application(ip), data_key(key), filename(filename) {}
+  LoadFile(const IpV4Addr &ip, const string &key, const string &filename,
+           const optional<Schema> &schema, const DFOptions &opts)
+      : Application(ip), data_key(key), filename(filename), schema(schema),
+        opts(opts) {}
 
   void ensure_key_removed() { cluster.remove(data_key); }
 
   void load_file() {
-    bool import_res = cluster.load_file(data_key, filename.c_str());
+    bool import_res = cluster.load_file(data_key, filename.c_str(), schema, opts);
     cout << "Loaded: " << data_key.name.c_str() << endl;
     assert(import_res);
   }
@@ -32,16 +41,32 @@ public:
 
 int main(int argc, char **argv) {
   CliFlags cli;
-  cli.add_flag("--ip").add_flag("--key").add_flag("--file").parse(argc, argv,
-                                                                  true);
+  cli.add_flag("--ip")
+      .add_flag("--key")
+      .add_flag("--file")
+      .add_flag("--schema")
+      .add_flag("--bloom-fpr")
+      .add_flag("--bloom-bits")
+      .parse(argc, argv, true);
   auto ip = cli.get_flag("--ip");
   auto key = cli.get_flag("--key");
   auto filename = cli.get_flag("--file");
+  auto schema_flag = cli.get_flag("--schema");
+  auto bloom_fpr = cli.get_flag("--bloom-fpr");
+  auto bloom_bits = cli.get_flag("--bloom-bits");
 
-  /* all flags are required */
+  /* all flags but --schema and --bloom-* are required */
   assert(ip);
   assert(key);
   assert(filename);
 
-  LoadFile(ip->c_str(), *key, *filename).run();
+  optional<Schema> schema;
+  if (schema_flag)
+    schema.emplace(schema_flag->c_str());
+  DFOptions opts;
+  if (bloom_fpr)
+    opts.bloom_fpr = stod(*bloom_fpr);
+  if (bloom_bits)
+    opts.bloom_bits_per_key = stod(*bloom_bits);
+  LoadFile(ip->c_str(), *key, *filename, schema, opts).run();
 }
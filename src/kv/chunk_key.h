@@ -39,7 +39,9 @@ inline void pack<const ChunkKey &>(WriteCursor &c, const ChunkKey &ckey) {
 }
 
 template <> inline ChunkKey yield(ReadCursor &c) {
-  return ChunkKey(yield<Key>(c), yield<int>(c));
+  /* yield in order, the order arguments are evaluated in isn't */
+  Key key = yield<Key>(c);
+  return ChunkKey(key, yield<int>(c));
 }
 
 ostream &operator<<(ostream &output, const ChunkKey &k) {
@@ -8,9 +8,15 @@
 #include "lib/sized_ptr.h"
 #include "network/node.h"
 #include "network/packet.h"
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string>
+#include <utility>
 
 using namespace std;
 
@@ -55,33 +61,48 @@ public:
 /**
  * Request a DataFrameChunk from a node in the cluster, responds with an OK and
  * the serialized DataFrameChunk in the body if is available in the node,
- * otherwise responds with an ERR and no data in the body
+ * otherwise responds with an ERR and no data in the body. If given columns,
+ * only those columns are sent and the others are missing in the chunk, see
+ * DataFrameChunk::serialize.
  *
  * authors: @grahamwren, @jagen31
  */
 class GetCommand : public Command {
 private:
   ChunkKey ckey;
+  vector<int> cols; // empty for every column
 
 protected:
   void serialize_args(WriteCursor &wc) const {
     pack<const ChunkKey &>(wc, ckey);
+    pack(wc, (int)cols.size());
+    for (int x : cols)
+      pack(wc, x);
   }
 
 public:
-  GetCommand(const ChunkKey &ckey) : ckey(ckey) {}
-  GetCommand(const Key &key, int i) : ckey(key, i) {}
-  GetCommand(ReadCursor &c) : ckey(yield<Key>(c), yield<int>(c)) {}
+  GetCommand(const ChunkKey &ckey, const vector<int> &cols = {})
+      : ckey(ckey), cols(cols) {}
+  GetCommand(const Key &key, int i, const vector<int> &cols = {})
+      : ckey(key, i), cols(cols) {}
+  GetCommand(ReadCursor &c) : ckey(yield<ChunkKey>(c)) {
+    int n_cols = yield<int>(c);
+    for (int i = 0; i < n_cols; i++)
+      cols.push_back(yield<int>(c));
+  }
   Type get_type() const { return Type::GET; }
 
   void run(KVStore &kv, const IpV4Addr &src,
            const Node::respond_fn_t &respond) const {
-    if (kv.has_pdf(ckey.key)) {
-      PartialDataFrame &pdf = kv.get_pdf(ckey.key);
-      if (pdf.has_chunk(ckey.chunk_idx)) {
-        const DataFrameChunk &dfc = pdf.get_chunk(ckey.chunk_idx);
+    if (shared_ptr<PartialDataFrame> pdf = kv.get_pdf(ckey.key)) {
+      shared_lock lock(pdf->get_lock());
+      if (pdf->has_chunk(ckey.chunk_idx)) {
+        const DataFrameChunk &dfc = pdf->get_chunk(ckey.chunk_idx);
         WriteCursor wc;
-        dfc.serialize(wc);
+        if (cols.empty())
+          dfc.serialize(wc);
+        else
+          dfc.serialize(wc, cols);
         return respond(true, move(wc));
       }
     }
@@ -90,13 +111,19 @@ public:
 
   ostream &out(ostream &output) const {
     output << ckey;
+    if (!cols.empty()) {
+      output << ", cols: [";
+      for (int i = 0; i < cols.size(); i++)
+        output << (i ? ", " : "") << cols[i];
+      output << "]";
+    }
     return output;
   }
 
   bool equals(const Command &o) const {
     if (get_type() == o.get_type()) {
       const GetCommand &other = dynamic_cast<const GetCommand &>(o);
-      return ckey == other.ckey;
+      return ckey == other.ckey && cols == other.cols;
     }
     return false;
   }
@@ -113,38 +140,87 @@ public:
 class PutCommand : public Command {
 private:
   ChunkKey chunk_key;
+  bool cut_short = false; // the packet ended before the chunk, see yield_data
   DataChunk data;
 
 protected:
+  /* the chunk is CHUNK_ALIGN aligned in the payload so the receiving Node
+   * can read it in place, see DataFrameChunk::fill */
   void serialize_args(WriteCursor &wc) const {
     pack<const ChunkKey &>(wc, chunk_key);
-    pack(wc, data.data());
+    pack(wc, data.len());
+    align(wc, CHUNK_ALIGN);
+    wc.ensure_space(data.len());
+    wc.write(data.len(), data.data().ptr);
+  }
+
+  /* the chunk, or an empty one with cut_short set if its length is negative
+   * or runs past the end of c */
+  static DataChunk yield_data(ReadCursor &c, bool &cut_short) {
+    if (!can_read(c, sizeof(int))) {
+      cut_short = true;
+      return DataChunk();
+    }
+    int len = yield<int>(c);
+    align(c, CHUNK_ALIGN);
+    if (len < 0 || !can_read(c, len)) {
+      cut_short = true;
+      return DataChunk();
+    }
+    uint8_t *start = c.cursor;
+    c.cursor += len;
+    /* share ownership of the packet if possible, otherwise borrow data from
+     * the ReadCursor 🤞 */
+    if (c.owner)
+      return DataChunk(len, shared_ptr<uint8_t>(c.owner, start));
+    return DataChunk(sized_ptr(len, start), true);
   }
 
 public:
   PutCommand(const ChunkKey &chunk_key, const DataChunk &dc)
       : chunk_key(chunk_key), data(dc) {}
   PutCommand(ReadCursor &c)
-      : chunk_key(yield<ChunkKey>(c)),
-        /* borrow data from ReadCursor 🤞 */
-        data(yield<sized_ptr<uint8_t>>(c), true) {}
+      : chunk_key(yield<ChunkKey>(c)), data(yield_data(c, cut_short)) {}
+
+  /**
+   * serialize a PutCommand of chunk_key into wc, with write_chunk serializing
+   * the chunk straight into wc, e.g. DataFrameChunk::serialize. The same bytes
+   * as serialize, without first serializing the chunk on its own and copying
+   * it in.
+   */
+  static void
+  serialize_chunk(WriteCursor &wc, const ChunkKey &chunk_key,
+                  const function<void(WriteCursor &)> &write_chunk) {
+    pack(wc, Type::PUT);
+    pack<const ChunkKey &>(wc, chunk_key);
+    int len_offset = wc.length();
+    pack(wc, 0); // the length of the chunk, once it's written
+    align(wc, CHUNK_ALIGN);
+    int start = wc.length();
+    write_chunk(wc);
+    int len = wc.length() - start;
+    memcpy(wc.begin() + len_offset, &len, sizeof(len));
+  }
 
   Type get_type() const { return Type::PUT; }
 
   void run(KVStore &kv, const IpV4Addr &src,
            const Node::respond_fn_t &respond) const {
-    if (!kv.has_pdf(chunk_key.key))
+    shared_ptr<PartialDataFrame> pdf = kv.get_pdf(chunk_key.key);
+    if (!pdf || cut_short)
       return respond(false); // returns and responds ERR
-    else
-      respond(true); // just respond OK
 
-    PartialDataFrame &pdf = kv.get_pdf(chunk_key.key);
-    ReadCursor rc(data.data());
-    if (pdf.has_chunk(chunk_key.chunk_idx)) {
-      pdf.replace_df_chunk(chunk_key.chunk_idx, rc);
+    /* waits for maps of this PDF running in the background */
+    unique_lock lock(pdf->get_lock());
+    ReadCursor rc = data.cursor();
+    bool stored;
+    if (pdf->has_chunk(chunk_key.chunk_idx)) {
+      stored = pdf->replace_df_chunk(chunk_key.chunk_idx, rc);
     } else {
-      pdf.add_df_chunk(chunk_key.chunk_idx, rc);
+      stored = pdf->add_df_chunk(chunk_key.chunk_idx, rc);
     }
+    /* ERR if the chunk is from another version or cut short */
+    respond(stored);
   }
 
   ostream &out(ostream &output) const {
@@ -224,11 +300,7 @@ public:
 
   void run(KVStore &kv, const IpV4Addr &src,
            const Node::respond_fn_t &respond) const {
-    if (kv.has_pdf(key))
-      return respond(false);
-
-    kv.add_pdf(key, scm);
-    return respond(true);
+    return respond(!!kv.add_pdf(key, scm));
   }
 
   Type get_type() const { return Type::NEW; }
@@ -280,28 +352,25 @@ public:
            const Node::respond_fn_t &respond) const {
     /* if command has query_key, just get info for this query_key */
     if (query_key) {
-      if (kv.has_pdf(*query_key)) {
-        const PartialDataFrame &pdf = kv.get_pdf(*query_key);
+      if (shared_ptr<PartialDataFrame> pdf = kv.get_pdf(*query_key)) {
+        shared_lock lock(pdf->get_lock());
         WriteCursor wc;
         pack<const Key &>(wc, *query_key);
-        if (pdf.has_chunk(0)) {
+        if (pdf->has_chunk(0)) {
           pack<bool>(wc, true); // pack true if this Node has chunk 0
-          pack<const Schema &>(wc, pdf.get_schema());
+          pack<const Schema &>(wc, pdf->get_schema());
         } else {
           /* pack false because not the owner of this DF */
           pack<bool>(wc, false);
         }
-        pack<int>(wc, pdf.largest_chunk_idx());
+        pack<int>(wc, pdf->largest_chunk_idx());
         return respond(true, move(wc));
       }
       return respond(false);
     } else {
       WriteCursor wc;
       /* traverse all keys checking for owned DF */
-      kv.for_each([&](const pair<const Key, PartialDataFrame> &e) {
-        const Key &key = e.first;
-        const PartialDataFrame &pdf = e.second;
-
+      kv.for_each([&](const Key &key, const PartialDataFrame &pdf) {
         pack<const Key &>(wc, key);
         if (pdf.has_chunk(0)) {
           pack<bool>(wc, true); // pack true if this Node has chunk 0
@@ -325,7 +394,9 @@ public:
     while (has_next(c)) {
       Key key = yield<Key>(c);
       if (yield<bool>(c)) {
-        results.emplace_back(make_tuple(key, yield<Schema>(c), yield<int>(c)));
+        /* yield in order, the order arguments are evaluated in isn't */
+        Schema scm = yield<Schema>(c);
+        results.emplace_back(make_tuple(key, scm, yield<int>(c)));
       } else {
         results.emplace_back(make_tuple(key, nullopt, yield<int>(c)));
       }
@@ -336,11 +407,12 @@ public:
 /**
  * Start the given Rower on the DataFrame associated with the given Key. Applies
  * the Rower to all chunks stored on the Node. Responds with OK and a result ID
- * in the body if the Rower is successfully started. To get the results of the
- * map, issue a FetchMapResult command with the provided result ID. After
- * responding, this Command blocks the main thread of the Node until it is
- * successful so the Node will NOT respond to packets or commands until it is
- * done mapping.
+ * in the body if the Rower is successfully started. The map runs in the
+ * background on the Node, so the Node keeps serving other commands meanwhile,
+ * except PUTs of this DataFrame which wait for it. A DELETE doesn't, the map
+ * keeps the chunks it started with. To get the
+ * results of the map, issue a FetchMapResult command with the provided result
+ * ID.
  *
  * authors: @grahamwren, @jagen31
  */
@@ -365,24 +437,12 @@ public:
 
   void run(KVStore &kv, const IpV4Addr &src,
            const Node::respond_fn_t &respond) const {
-    if (!kv.has_pdf(key)) {
+    optional<int> result_id = kv.start_map(key, rower);
+    if (!result_id)
       return respond(false); // return and respond ERR
-    }
-    int result_id = kv.get_result_id();
     WriteCursor wc;
-    pack(wc, result_id);
-    /* respond OK early with result_id */
+    pack(wc, *result_id);
     respond(true, move(wc));
-
-    WriteCursor wc2;
-
-    /* compute map result */
-    PartialDataFrame &pdf = kv.get_pdf(key);
-    pdf.map(*rower); // local map
-    rower->serialize_results(wc2);
-
-    /* store result under result_id */
-    kv.insert_map_result(result_id, move(wc2));
   }
 
   ostream &out(ostream &output) const {
@@ -401,35 +461,63 @@ public:
 
 /**
  * Command to send to fetch the result of a previous StartMapCommand, takes an
- * argument of a result_id and looks in the KVStore for data stored under that
- * id. Responds with OK and the serialized result of the Rower if successful.
+ * argument of a result_id and looks in the KVStore for the map job under that
+ * id. If wait is set, waits for the map to finish, blocking the Node
+ * meanwhile. Responds with ERR for an unknown id, otherwise OK and whether the
+ * map is done. If it is, that's followed by the serialized result of the Rower
+ * and the result is removed from the Node, otherwise by the chunks mapped so
+ * far and the chunks to map, see unpack_progress.
  *
  * authors: @grahamwren, @jagen31
  */
 class FetchMapResultCommand : public Command {
 private:
   int result_id;
+  bool wait;
 
 protected:
-  void serialize_args(WriteCursor &wc) const { pack<int>(wc, result_id); }
+  void serialize_args(WriteCursor &wc) const {
+    pack<int>(wc, result_id);
+    pack<bool>(wc, wait);
+  }
 
 public:
-  FetchMapResultCommand(int result_id) : result_id(result_id) {}
-  FetchMapResultCommand(ReadCursor &c) : result_id(yield<int>(c)) {}
+  FetchMapResultCommand(int result_id, bool wait = true)
+      : result_id(result_id), wait(wait) {}
+  FetchMapResultCommand(ReadCursor &c)
+      : result_id(yield<int>(c)), wait(yield<bool>(c)) {}
   Type get_type() const { return Type::FETCH_MAP_RESULT; }
 
   void run(KVStore &kv, const IpV4Addr &src,
            const Node::respond_fn_t &respond) const {
-    if (kv.has_map_result(result_id)) {
-      respond(true, kv.get_map_result(result_id));
+    /* look the job up once, it may be removed by another fetch meanwhile */
+    shared_ptr<MapJob> job = kv.find_map_job(result_id);
+    if (!job)
+      return respond(false);
+    if (wait)
+      job->wait();
+
+    WriteCursor wc;
+    if (job->is_done()) {
+      const DataChunk &result = job->result;
+      pack<bool>(wc, true);
+      align(wc, sizeof(uint64_t)); // keep the results aligned
+      wc.ensure_space(result.len());
+      wc.write(result.len(), result.data().ptr);
+      respond(true, move(wc));
       kv.remove_map_result(result_id);
     } else {
-      respond(false);
+      auto [chunks_done, n_chunks] = job->progress();
+      pack<bool>(wc, false);
+      align(wc, sizeof(uint64_t));
+      pack<int>(wc, chunks_done);
+      pack<int>(wc, n_chunks);
+      respond(true, move(wc));
     }
   }
 
   ostream &out(ostream &output) const {
-    output << "result_id: " << result_id;
+    output << "result_id: " << result_id << ", wait: " << wait;
     return output;
   }
 
@@ -437,10 +525,25 @@ public:
     if (get_type() == o.get_type()) {
       const FetchMapResultCommand &other =
           dynamic_cast<const FetchMapResultCommand &>(o);
-      return result_id == other.result_id;
+      return result_id == other.result_id && wait == other.wait;
     }
     return false;
   }
+
+  /**
+   * read whether the map is done from a response, if not then the chunks mapped
+   * so far and the chunks to map are in progress, otherwise the Rower's results
+   * follow in c
+   */
+  static bool unpack_progress(ReadCursor &c, pair<int, int> &progress) {
+    bool done = yield<bool>(c);
+    align(c, sizeof(uint64_t));
+    if (done)
+      return true;
+    progress.first = yield<int>(c);
+    progress.second = yield<int>(c);
+    return false;
+  }
 };
 
 ostream &operator<<(ostream &output, const Command::Type &t) {
@@ -11,17 +11,22 @@
 using namespace std;
 
 /**
- * an implementation of sized_ptr that owns it's data
+ * an implementation of sized_ptr that owns it's data, or optionally borrows it
+ * when the owner is known to outlive the DataChunk
  */
 class DataChunk {
 private:
   int _len;
   shared_ptr<uint8_t> bytes;
+  bool borrowed = false;
 
 public:
   DataChunk() : _len(0), bytes(nullptr) {}
   DataChunk(int n, const shared_ptr<uint8_t> &b) : _len(n), bytes(b) {}
-  DataChunk(WriteCursor &&wc) : _len(wc.length()), bytes(wc.data.release()) {
+  /* WriteCursor memory is malloc-ed, so free it the same way */
+  DataChunk(WriteCursor &&wc)
+      : _len(wc.length()),
+        bytes(wc.data.release(), [](uint8_t *ptr) { free(ptr); }) {
     wc.data.reset(nullptr);
     wc._length = 0;
     wc._capacity = 0;
@@ -33,7 +38,8 @@ public:
         bytes(borrow ? sp.ptr : new uint8_t[_len], [=](uint8_t *ptr) {
           if (!borrow) // only delete ptr if we are NOT borrowing
             delete[] ptr;
-        }) {
+        }),
+        borrowed(borrow) {
     /* don't copy if borrowing */
     if (!borrow && _len > 0) {
       /* warn for big copies, likely should be moves */
@@ -44,6 +50,13 @@ public:
   }
 
   sized_ptr<uint8_t> data() const { return sized_ptr(len(), bytes.get()); }
+
+  /**
+   * a cursor over this data which shares ownership of it, unless borrowed
+   */
+  ReadCursor cursor() const {
+    return ReadCursor(len(), bytes.get(), borrowed ? nullptr : bytes);
+  }
   int len() const { return _len; }
   const shared_ptr<uint8_t> &ptr() const { return bytes; }
 
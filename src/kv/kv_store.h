@@ -1,96 +1,277 @@
 #pragma once
 
+#include "data_chunk.h"
 #include "key.h"
+#include "lib/rower.h"
 #include "lib/schema.h"
 #include "partial_dataframe.h"
+#include <atomic>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 
 using namespace std;
 
+/**
+ * A map started by a StartMapCommand, run in the background by one of the
+ * KVStore's map runners so the Node keeps serving other commands meanwhile,
+ * see KVStore::start_map. The result is the Rower's serialized results once
+ * done, and doesn't change after.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+struct MapJob {
+  atomic<int> n_chunks{0};
+  atomic<int> chunks_done{0};
+  mutex mtx;
+  condition_variable cv;
+  bool started = false; // holds the lock on its PDF, guarded by mtx
+  bool done = false;    // result is set, guarded by mtx
+  DataChunk result;
+
+  bool is_done() {
+    lock_guard lock(mtx);
+    return done;
+  }
+
+  /* block until the job is done */
+  void wait() {
+    unique_lock lock(mtx);
+    cv.wait(lock, [&]() { return done; });
+  }
+
+  /* the chunks mapped so far and the chunks to map */
+  pair<int, int> progress() const {
+    return make_pair(chunks_done.load(), n_chunks.load());
+  }
+};
+
 /**
  * DataStore for a KV Node. Encapsulates the DataFrameChunks (DFCs) stored on
  * the Node in PartialDataFrames (PDFs) to track the index of each chunk and the
  * Schema of the parent DataFrame
  *
+ * Safe to use from the Node's handler threads at once. The set of PDFs is
+ * guarded by one lock, held only to look up, add or remove a PDF, and each PDF
+ * by its own (see PartialDataFrame::get_lock). PDFs are shared, so one removed
+ * while a command or map still uses it lives until they are done.
+ *
+ * Maps run on long-lived runner threads, each taking queued jobs in turn. A
+ * runner is only started when every runner is busy, so there are as many as
+ * the most maps run at once, and a map doesn't pay to start a thread.
+ *
  * authors: @grahamwren, @jagen31
  */
 class KVStore {
 public:
   /* return whether this Store knows about the given Key */
   bool has_pdf(const Key &key) const;
-  /* get the PDF for the given Key */
-  PartialDataFrame &get_pdf(const Key &key);
-  /* create a PDF in the clsuter for the given Key and Schema */
-  PartialDataFrame &add_pdf(const Key &key, const Schema &schema);
+  /* get the PDF for the given Key, nullptr if missing */
+  shared_ptr<PartialDataFrame> get_pdf(const Key &key) const;
+  /* create a PDF in the clsuter for the given Key and Schema, nullptr if the
+   * PDF exists */
+  shared_ptr<PartialDataFrame> add_pdf(const Key &key, const Schema &schema);
   /* remove the PDF for the given Key, and delete all associated DFCs */
   void remove_pdf(const Key &key);
-  /* apply the given function to every PDF in the Store */
-  void
-      for_each(function<void(const pair<const Key, PartialDataFrame> &)>) const;
+  /* apply the given function to every PDF in the Store, holding each PDF's
+   * lock shared */
+  void for_each(function<void(const Key &, const PartialDataFrame &)>) const;
 
-  /* storing Map results */
+  /* running maps and storing Map results, by result ID */
 
-  /* return whether we have a result for the given result ID */
+  /* start mapping the Rower over the PDF for the given Key in the background,
+   * return the result ID of the job, nullopt if missing PDF */
+  optional<int> start_map(const Key &, shared_ptr<Rower>);
+  /* get the job for the given result ID, nullptr if missing. Use the job it
+   * returns, it stays valid even if the result is removed meanwhile */
+  shared_ptr<MapJob> find_map_job(int) const;
+  /* return whether we have a job for the given result ID */
   bool has_map_result(int) const;
-  /* get the result for the given ID, undefined behavior if missing result for
-   * the given ID */
-  const DataChunk &get_map_result(int) const;
+  /* return whether the job for the given ID is done */
+  bool is_map_done(int) const;
+  /* the chunks mapped so far and the chunks to map by the job for the given ID
+   */
+  pair<int, int> map_progress(int) const;
+  /* block until the job for the given ID is done */
+  void wait_map(int) const;
   /* remove the result for the given ID, usually after responding with it */
   void remove_map_result(int);
   /* get a new result ID to respond to the client, gurantees that the returned
    * result ID will not conflict with another result ID requested later */
   int get_result_id();
-  /* insert a map result for a given ID, undefined behavior if ID not from
-   * get_result_id */
+  /* insert a map result for a given ID, marking its job done, undefined
+   * behavior if ID not from get_result_id */
   void insert_map_result(int, DataChunk &&);
 
+  KVStore() = default;
+  KVStore(const KVStore &) = delete;
+  /* waits for running and queued maps */
+  ~KVStore();
+
 protected:
-  unordered_map<const Key, PartialDataFrame> data;
-  unordered_map<int, DataChunk> map_results;
+  unordered_map<const Key, shared_ptr<PartialDataFrame>> data;
+  mutable shared_mutex data_mtx; // guards data, not the PDFs
+  unordered_map<int, shared_ptr<MapJob>> map_jobs;
+  mutable mutex jobs_mtx; // guards map_jobs, not the jobs
+
+  /* maps waiting for a runner */
+  vector<thread> runners;
+  deque<function<void()>> pending_maps;
+  int idle_runners = 0;  // guarded by runners_mtx
+  bool stopping = false; // guarded by runners_mtx
+  mutex runners_mtx;
+  condition_variable runners_cv;
+
+  shared_ptr<MapJob> get_map_job(int) const;
+  static void finish_map_job(MapJob &, DataChunk &&);
+  /* queue the map to run on an idle runner, starting one if none is idle */
+  void run_map(function<void()> &&);
+  void runner_loop();
 };
 
-bool KVStore::has_pdf(const Key &key) const {
-  return data.find(key) != data.end();
-}
+bool KVStore::has_pdf(const Key &key) const { return !!get_pdf(key); }
 
-PartialDataFrame &KVStore::get_pdf(const Key &key) {
-  assert(has_pdf(key));
-  return data.find(key)->second;
+shared_ptr<PartialDataFrame> KVStore::get_pdf(const Key &key) const {
+  shared_lock lock(data_mtx);
+  auto it = data.find(key);
+  return it == data.end() ? nullptr : it->second;
 }
 
-PartialDataFrame &KVStore::add_pdf(const Key &key, const Schema &schema) {
-  assert(!has_pdf(key));
-  data.emplace(key, schema);
-  return get_pdf(key);
+shared_ptr<PartialDataFrame> KVStore::add_pdf(const Key &key,
+                                              const Schema &schema) {
+  unique_lock lock(data_mtx);
+  auto e = data.try_emplace(key, nullptr);
+  if (!e.second)
+    return nullptr;
+  e.first->second = make_shared<PartialDataFrame>(schema);
+  return e.first->second;
 }
 
-void KVStore::remove_pdf(const Key &key) { data.erase(key); }
+void KVStore::remove_pdf(const Key &key) {
+  unique_lock lock(data_mtx);
+  data.erase(key);
+}
 
 void KVStore::for_each(
-    function<void(const pair<const Key, PartialDataFrame> &)> fn) const {
-  ::for_each(data.begin(), data.end(), fn);
+    function<void(const Key &, const PartialDataFrame &)> fn) const {
+  shared_lock lock(data_mtx);
+  for (auto &e : data) {
+    shared_lock pdf_lock(e.second->get_lock());
+    fn(e.first, *e.second);
+  }
+}
+
+optional<int> KVStore::start_map(const Key &key, shared_ptr<Rower> rower) {
+  shared_ptr<const PartialDataFrame> pdf = get_pdf(key);
+  if (!pdf)
+    return nullopt;
+  int result_id = get_result_id();
+  shared_ptr<MapJob> job = get_map_job(result_id);
+  run_map([pdf, rower, job]() {
+    WriteCursor wc;
+    {
+      shared_lock pdf_lock(pdf->get_lock());
+      {
+        lock_guard lock(job->mtx);
+        job->n_chunks = pdf->nchunks();
+        job->started = true;
+      }
+      job->cv.notify_all();
+      pdf->map(*rower, ThreadPool::shared(), &job->chunks_done);
+    }
+    rower->serialize_results(wc);
+    finish_map_job(*job, move(wc));
+  });
+  /* return once the job holds the PDF, so it sees the PDF as it is now */
+  unique_lock lock(job->mtx);
+  job->cv.wait(lock, [&]() { return job->started; });
+  return result_id;
+}
+
+void KVStore::run_map(function<void()> &&fn) {
+  {
+    lock_guard lock(runners_mtx);
+    pending_maps.push_back(move(fn));
+    if (idle_runners < (int)pending_maps.size()) {
+      runners.emplace_back([this]() { runner_loop(); });
+      return;
+    }
+  }
+  runners_cv.notify_one();
+}
+
+void KVStore::runner_loop() {
+  unique_lock lock(runners_mtx);
+  while (true) {
+    idle_runners++;
+    runners_cv.wait(lock, [&]() { return stopping || !pending_maps.empty(); });
+    idle_runners--;
+    /* finish queued maps before stopping */
+    if (pending_maps.empty())
+      return;
+    function<void()> fn = move(pending_maps.front());
+    pending_maps.pop_front();
+    lock.unlock();
+    fn();
+    lock.lock();
+  }
+}
+
+shared_ptr<MapJob> KVStore::find_map_job(int result_id) const {
+  lock_guard lock(jobs_mtx);
+  auto it = map_jobs.find(result_id);
+  return it == map_jobs.end() ? nullptr : it->second;
+}
+
+shared_ptr<MapJob> KVStore::get_map_job(int result_id) const {
+  shared_ptr<MapJob> job = find_map_job(result_id);
+  assert(job);
+  return job;
+}
+
+void KVStore::finish_map_job(MapJob &job, DataChunk &&result) {
+  {
+    lock_guard lock(job.mtx);
+    job.result = move(result);
+    job.done = true;
+  }
+  job.cv.notify_all();
 }
 
 bool KVStore::has_map_result(int result_id) const {
-  return map_results.find(result_id) != map_results.end();
+  return !!find_map_job(result_id);
+}
+
+bool KVStore::is_map_done(int result_id) const {
+  return get_map_job(result_id)->is_done();
 }
 
-const DataChunk &KVStore::get_map_result(int result_id) const {
-  assert(has_map_result(result_id));
-  const DataChunk &dc = map_results.at(result_id);
-  return dc;
+pair<int, int> KVStore::map_progress(int result_id) const {
+  return get_map_job(result_id)->progress();
 }
 
-void KVStore::remove_map_result(int result_id) { map_results.erase(result_id); }
+void KVStore::wait_map(int result_id) const { get_map_job(result_id)->wait(); }
+
+void KVStore::remove_map_result(int result_id) {
+  lock_guard lock(jobs_mtx);
+  map_jobs.erase(result_id);
+}
 
 int KVStore::get_result_id() {
+  lock_guard lock(jobs_mtx);
   int result_id;
   bool added = false;
   while (!added) {
-    /* insert nullptr to reserve result_id */
-    auto e = map_results.try_emplace(rand(), DataChunk(0, nullptr));
+    /* insert an empty job to reserve result_id */
+    auto e = map_jobs.try_emplace(rand(), make_shared<MapJob>());
     added = e.second;
     result_id = e.first->first;
   }
@@ -98,6 +279,15 @@ int KVStore::get_result_id() {
 }
 
 void KVStore::insert_map_result(int result_id, DataChunk &&data) {
-  assert(has_map_result(result_id));
-  map_results.insert_or_assign(result_id, move(data));
+  finish_map_job(*get_map_job(result_id), move(data));
+}
+
+KVStore::~KVStore() {
+  {
+    lock_guard lock(runners_mtx);
+    stopping = true;
+  }
+  runners_cv.notify_all();
+  for (thread &t : runners)
+    t.join();
 }
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "lib/dataframe_chunk.h"
+#include "lib/thread_pool.h"
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <set>
-#include <thread>
+#include <shared_mutex>
 #include <unordered_map>
 
 using namespace std;
@@ -18,22 +21,18 @@ class PartialDataFrame : public DataFrame {
 protected:
   const Schema schema;
   unordered_map<int, DataFrameChunk> chunks;
-
-  void pmap_helper(const vector<int> &c_idxs, Rower &rower) const {
-    Row row(get_schema());
-    for (int ci : c_idxs) {
-      auto &chunk = chunks.at(ci);
-      int start_i = ci * DF_CHUNK_SIZE;
-      for (int i = start_i; i < start_i + chunk.nrows(); i++) {
-        fill_row(i, row);
-        rower.accept(row);
-      }
-    }
-  }
+  mutable shared_mutex mtx;
 
 public:
   PartialDataFrame(const Schema &scm) : schema(scm) {}
 
+  /**
+   * guards the chunks of this PDF on a Node, held shared while reading them,
+   * e.g. by a map running in the background, and exclusively while adding or
+   * replacing them
+   */
+  shared_mutex &get_lock() const { return mtx; }
+
   const Schema &get_schema() const { return schema; }
 
   bool has_chunk_by_row(int y) const {
@@ -56,10 +55,10 @@ public:
     int chunk_offset = y % DF_CHUNK_SIZE;
     return get_chunk(chunk_idx).get_bool(chunk_offset, x);
   }
-  string *get_string(int y, int x) const {
+  string_view get_string_view(int y, int x) const {
     int chunk_idx = y / DF_CHUNK_SIZE;
     int chunk_offset = y % DF_CHUNK_SIZE;
-    return get_chunk(chunk_idx).get_string(chunk_offset, x);
+    return get_chunk(chunk_idx).get_string_view(chunk_offset, x);
   }
   bool is_missing(int y, int x) const {
     int chunk_idx = y / DF_CHUNK_SIZE;
@@ -68,60 +67,75 @@ public:
   }
 
   /**
-   * Runs the given rower over the Chunks available in this PartialDataFrame
+   * Runs the given rower over the Chunks available in this PartialDataFrame,
+   * one Chunk per task on the node's shared ThreadPool
+   */
+  void map(Rower &rower) const { map(rower, ThreadPool::shared()); }
+
+  /**
+   * Runs the given rower over the Chunks available in this PartialDataFrame,
+   * one Chunk per task on the given pool. Each slot of the pool maps its
+   * Chunks with its own clone of rower, cloned when it first gets a Chunk,
+   * the caller's slot uses rower itself. The clones are joined to rower at the
+   * end. If given, chunks_done is incremented as each Chunk is mapped.
    */
-  void map(Rower &rower) const {
+  void map(Rower &rower, ThreadPool &pool,
+           atomic<int> *chunks_done = nullptr) const {
     if (chunks.size() == 0)
       return;
 
-    int threads_to_use = min((int)THREAD_COUNT, (int)chunks.size());
-
-    /* distribute the chunks for the threads */
-    vector<int> splits[threads_to_use];
-    int i = 0;
-    for (auto &e : chunks) {
-      splits[i].push_back(e.first);
-      i = (i + 1) % threads_to_use;
-    }
-
-    unique_ptr<Rower> rowers[threads_to_use - 1];
-    vector<thread> threads;
-    /* start threads_to_use - 1 threads */
-    for (int i = 0; i < threads_to_use - 1; i++) {
-      rowers[i] = rower.clone();
-      Rower &rower = *rowers[i];
-      vector<int> &split = splits[i];
-      threads.emplace_back([&]() { pmap_helper(split, rower); });
-    }
-
-    /* run map on main thread with last split */
-    pmap_helper(splits[threads_to_use - 1], rower);
+    /* in order, so neighbouring tasks map neighbouring rows */
+    vector<int> c_idxs;
+    c_idxs.reserve(chunks.size());
+    for (auto &e : chunks)
+      c_idxs.push_back(e.first);
+    sort(c_idxs.begin(), c_idxs.end());
+
+    int callers_slot = pool.slots() - 1;
+    vector<unique_ptr<Rower>> rowers(pool.slots());
+    pool.run(c_idxs.size(), [&](int task, int slot) {
+      if (slot != callers_slot && !rowers[slot])
+        rowers[slot] = rower.clone();
+      Rower &r = slot == callers_slot ? rower : *rowers[slot];
+      int ci = c_idxs[task];
+      chunks.at(ci).map(r, ci * DF_CHUNK_SIZE);
+      if (chunks_done)
+        (*chunks_done)++;
+    });
 
     /* join all rowers to main */
-    for (int i = 0; i < threads_to_use - 1; i++) {
-      threads[i].join();
-      rower.join(*rowers[i]);
-    }
+    for (auto &r : rowers)
+      if (r)
+        rower.join(*r);
   }
 
   /**
    * add a DFC at the given chunk_idx, undefined behavior if the chunk_idx
-   * already exists in this PDF
+   * already exists in this PDF. Returns false, adding nothing, if the chunk
+   * can't be read (see DataFrameChunk::fill)
    */
-  void add_df_chunk(int chunk_idx, ReadCursor &c) {
+  bool add_df_chunk(int chunk_idx, ReadCursor &c) {
     assert(!has_chunk(chunk_idx));
-    auto &dfc = chunks.emplace(chunk_idx, schema).first->second;
-    dfc.fill(c);
+    DataFrameChunk dfc(schema);
+    if (!dfc.fill(c))
+      return false;
+    chunks.emplace(chunk_idx, move(dfc));
+    return true;
   }
 
   /**
    * replace a DFC at the given chunk_idx, undefined behavior if the chunk_idx
-   * does not exist in this PDF
+   * does not exist in this PDF. Returns false, keeping the old chunk, if the
+   * new chunk can't be read
    */
-  void replace_df_chunk(int chunk_idx, ReadCursor &c) {
+  bool replace_df_chunk(int chunk_idx, ReadCursor &c) {
     assert(has_chunk(chunk_idx));
+    DataFrameChunk dfc(schema);
+    if (!dfc.fill(c))
+      return false;
     chunks.erase(chunk_idx);
-    add_df_chunk(chunk_idx, c);
+    chunks.emplace(chunk_idx, move(dfc));
+    return true;
   }
 
   bool has_chunk(int chunk_idx) const {
@@ -1,4 +1,5 @@
 #include "kv/kv.h"
+#include "lib/thread_pool.h"
 #include "utils/cli_flags.h"
 
 /**
@@ -6,11 +7,17 @@
  */
 int main(int argc, char **argv) {
   CliFlags cli;
-  cli.add_flag("--ip").add_flag("--server-ip").parse(argc, argv, true);
+  cli.add_flag("--ip").add_flag("--server-ip").add_flag("--threads").parse(
+      argc, argv, true);
   auto ip = cli.get_flag("--ip");
   auto server_ip = cli.get_flag("--server-ip");
+  auto threads = cli.get_flag("--threads");
   assert(ip); // "--ip" flag required
 
+  /* threads mapping Rowers over this node's chunks, default one per core */
+  if (threads)
+    ThreadPool::set_shared_threads(stoi(*threads));
+
   if (server_ip) {
     KV kv(ip->c_str(), server_ip->c_str());
   } else {
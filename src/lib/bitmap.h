@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <inttypes.h>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A growable array of bits packed into 64 bit words, used where vector<bool>
+ * would be but with access to the packed words so a whole bitmap can be
+ * copied in or out with a single memcpy. Bit i is bit (i % 8) of byte (i / 8)
+ * of the words on little-endian machines, so the bytes are the same as any
+ * other packed bitmap. Bits past size() in the last word are always zero.
+ *
+ * A Bitmap can also borrow its bits from memory it doesn't own (see view), e.g.
+ * a received packet, in which case it is read-only.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class Bitmap {
+protected:
+  vector<uint64_t> words;
+  size_t n_bits = 0;
+  const uint64_t *borrowed = nullptr;
+
+  const uint64_t *bits() const { return borrowed ? borrowed : words.data(); }
+
+  static size_t words_for(size_t n) { return (n + 63) / 64; }
+
+public:
+  /**
+   * reference to a single bit, like vector<bool>::reference
+   */
+  class reference {
+  protected:
+    uint64_t &word;
+    const uint64_t mask;
+
+  public:
+    reference(uint64_t &word, int bit) : word(word), mask(1ULL << bit) {}
+    operator bool() const { return word & mask; }
+    reference &operator=(bool val) {
+      word = val ? word | mask : word & ~mask;
+      return *this;
+    }
+    reference &operator=(const reference &other) {
+      return *this = (bool)other;
+    }
+  };
+
+  bool operator[](size_t i) const { return bits()[i / 64] >> (i % 64) & 1; }
+  reference operator[](size_t i) {
+    assert(!borrowed);
+    return reference(words[i / 64], i % 64);
+  }
+
+  void push_back(bool val) {
+    assert(!borrowed);
+    if (n_bits % 64 == 0)
+      words.push_back(0);
+    words.back() |= (uint64_t)val << (n_bits % 64);
+    n_bits++;
+  }
+
+  void resize(size_t n) {
+    assert(!borrowed);
+    words.resize(words_for(n), 0);
+    n_bits = n;
+    /* clear bits dropped from the last word so they read as zero if regrown */
+    if (n % 64)
+      words.back() &= (1ULL << (n % 64)) - 1;
+  }
+
+  void reserve(size_t n) { words.reserve(words_for(n)); }
+  size_t size() const { return n_bits; }
+
+  /**
+   * number of bytes needed to hold size() bits
+   */
+  size_t byte_size() const { return (n_bits + 7) / 8; }
+
+  /**
+   * the packed bits, byte_size() bytes long
+   */
+  const uint8_t *bytes() const {
+    return reinterpret_cast<const uint8_t *>(bits());
+  }
+
+  /**
+   * replace the contents with n bits copied from packed bytes
+   */
+  void assign(size_t n, const uint8_t *src) {
+    borrowed = nullptr;
+    words.assign(words_for(n), 0);
+    n_bits = n;
+    memcpy(words.data(), src, (n + 7) / 8);
+    resize(n); // clear any bits past n in the last byte
+  }
+
+  /**
+   * replace the contents with n bits all set to val
+   */
+  void assign(size_t n, bool val) {
+    borrowed = nullptr;
+    words.assign(words_for(n), val ? ~0ULL : 0);
+    n_bits = n;
+    resize(n); // clear any bits past n in the last word
+  }
+
+  /**
+   * borrow n bits packed at src without copying them, src must be 8 byte
+   * aligned, have no bits set past n in its last byte, and outlive this
+   */
+  void view(size_t n, const uint8_t *src) {
+    assert(reinterpret_cast<uintptr_t>(src) % sizeof(uint64_t) == 0);
+    words.clear();
+    n_bits = n;
+    borrowed = reinterpret_cast<const uint64_t *>(src);
+  }
+
+  bool operator==(const Bitmap &other) const {
+    return n_bits == other.n_bits &&
+           memcmp(bytes(), other.bytes(), byte_size()) == 0;
+  }
+};
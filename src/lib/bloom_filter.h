@@ -0,0 +1,154 @@
+#pragma once
+
+#include "cursor.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <inttypes.h>
+#include <vector>
+
+#ifndef BLOOM_BLOCK_WORDS
+#define BLOOM_BLOCK_WORDS 8 // 512 bit blocks, one cache line
+#endif
+
+using namespace std;
+
+/**
+ * A blocked Bloom filter of ints. Each key sets k bits within a single block
+ * of one cache line picked by its hash, so a lookup touches one cache line.
+ * Answers whether a key may have been added, with false positives at a rate
+ * given by the bits per key but never false negatives.
+ *
+ * Like Bitmap, a BloomFilter can borrow its blocks from memory it doesn't own
+ * (see fill), e.g. a received packet, in which case it is read-only.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class BloomFilter {
+protected:
+  static constexpr int BLOCK_BITS = BLOOM_BLOCK_WORDS * 64;
+
+  vector<uint64_t> words;
+  const uint64_t *borrowed = nullptr;
+  uint32_t n_blocks = 0;
+  uint8_t k = 0;
+
+  const uint64_t *blocks() const { return borrowed ? borrowed : words.data(); }
+
+  /* splitmix64 finalizer, spreads every bit of the key over the hash */
+  static uint64_t hash(int32_t key) {
+    uint64_t h = (uint32_t)key + 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+  }
+
+  /* the first word of the block for hash h */
+  uint64_t block_of(uint64_t h) const {
+    return ((h >> 32) * n_blocks >> 32) * BLOOM_BLOCK_WORDS;
+  }
+
+  /* the i-th bit of hash h within its block, by double hashing */
+  static uint32_t bit_of(uint64_t h, int i) {
+    uint32_t h1 = h, h2 = (h >> 32) | 1;
+    return (h1 + i * h2) % BLOCK_BITS;
+  }
+
+public:
+  /**
+   * bits per key needed for a false positive rate of fpr, ignoring the small
+   * increase from blocking
+   */
+  static double bits_per_key_for(double fpr) {
+    return -log(fpr) / (log(2) * log(2));
+  }
+
+  /**
+   * an empty filter sized for n_keys keys at bits_per_key bits each
+   */
+  BloomFilter(int n_keys, double bits_per_key) {
+    uint64_t n_bits = ceil(max(n_keys, 1) * bits_per_key);
+    n_blocks = max((n_bits + BLOCK_BITS - 1) / BLOCK_BITS, (uint64_t)1);
+    k = min(max((int)round(bits_per_key * log(2)), 1), 16);
+    words.assign((size_t)n_blocks * BLOOM_BLOCK_WORDS, 0);
+  }
+  BloomFilter() {}
+
+  /**
+   * whether this filter has any blocks, a default BloomFilter has none
+   */
+  bool empty() const { return n_blocks == 0; }
+  size_t byte_size() const {
+    return (size_t)n_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+  }
+
+  void add(int32_t key) {
+    assert(!borrowed && !empty());
+    uint64_t h = hash(key);
+    uint64_t *block = words.data() + block_of(h);
+    for (int i = 0; i < k; i++) {
+      uint32_t bit = bit_of(h, i);
+      block[bit / 64] |= 1ULL << (bit % 64);
+    }
+  }
+
+  /**
+   * false only if key was never added, an empty filter may contain anything
+   */
+  bool may_contain(int32_t key) const {
+    if (empty())
+      return true;
+    uint64_t h = hash(key);
+    const uint64_t *block = blocks() + block_of(h);
+    for (int i = 0; i < k; i++) {
+      uint32_t bit = bit_of(h, i);
+      if (!(block[bit / 64] >> (bit % 64) & 1))
+        return false;
+    }
+    return true;
+  }
+
+  void clear() {
+    words.clear();
+    borrowed = nullptr;
+    n_blocks = 0;
+    k = 0;
+  }
+
+  /**
+   * write the number of blocks, k and then the blocks, 8 byte aligned
+   */
+  void serialize(WriteCursor &c) const {
+    pack(c, n_blocks);
+    pack(c, (uint32_t)k);
+    c.ensure_space(byte_size());
+    c.write(n_blocks * BLOOM_BLOCK_WORDS, blocks());
+  }
+
+  /**
+   * read what serialize wrote, borrowing the blocks from the cursor's bytes if
+   * borrow is set, they must then be 8 byte aligned and outlive this. Returns
+   * false, leaving this empty, if the cursor ends before the blocks do.
+   */
+  bool fill(ReadCursor &c, bool borrow = false) {
+    clear();
+    if (!can_read(c, 2 * sizeof(uint32_t)))
+      return false;
+    n_blocks = yield<uint32_t>(c);
+    k = yield<uint32_t>(c);
+    if (!can_read(c, byte_size()) || k > 16) {
+      clear();
+      return false;
+    }
+    if (borrow) {
+      assert(reinterpret_cast<uintptr_t>(c.cursor) % sizeof(uint64_t) == 0);
+      borrowed = reinterpret_cast<const uint64_t *>(c.cursor);
+    } else if (n_blocks) {
+      words.resize((size_t)n_blocks * BLOOM_BLOCK_WORDS);
+      memcpy(words.data(), c.cursor, byte_size());
+    }
+    c.cursor += byte_size();
+    return true;
+  }
+};
@@ -1,23 +1,199 @@
 #pragma once
 
+#include "bitmap.h"
+#include "bloom_filter.h"
 #include "cursor.h"
 #include "data.h"
+#include "packed_ints.h"
 #include <cassert>
+#include <cmath>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
+#ifndef STRING_DICT_MAX_RATIO
+#define STRING_DICT_MAX_RATIO 0.5 // most distinct/present strings to encode
+#endif
+
+#ifndef CHUNK_ALIGN
+#define CHUNK_ALIGN 8 // alignment of each buffer in a serialized column
+#endif
+
 using namespace std;
 
+/**
+ * Statistics of the values of a column, recorded per chunk so scans can skip
+ * chunks which can't hold a value they are looking for, see
+ * Rower::can_skip. min and max bound the present values of int, float and bool
+ * (as 0 and 1) columns, min > max if there are none or for strings. They may
+ * be looser than the actual min and max, never tighter.
+ */
+struct ZoneMap {
+  bool known = false;
+  int null_count = 0;
+  double min = INFINITY;
+  double max = -INFINITY;
+
+  /**
+   * whether any present value can be in [lo, hi]
+   */
+  bool may_contain(double lo, double hi) const {
+    return !known || (min <= hi && max >= lo);
+  }
+};
+
 /**
  * A abstract parent class for the TypedColumn template
  *
+ * Serialized columns are an encoding tag, the column's ZoneMap, its
+ * BloomFilter (no blocks if it has none), a packed bitmap with a bit set for
+ * each missing value, and then the values in a layout given by the encoding.
+ * Each buffer starts CHUNK_ALIGN aligned from the start of the cursor, so
+ * fixed-width values can be copied or read in place without unpacking.
+ *
  * authors: @grahamwren, @jagen31
  */
 class Column {
+public:
+  /**
+   * layout of the values of a serialized column, PLAIN values are a
+   * contiguous array (bit-packed for BOOL), strings are uint32 offsets
+   * followed by the bytes of every string. DICT strings are a dictionary of
+   * the distinct strings and a uint32 code per row, see TypedColumn<string *>.
+   * FOR, DELTA and RLE are compressed ints or bools, see PackedInts.
+   * OMITTED is a column left out of a projection, see serialize_omitted.
+   */
+  enum class Encoding : uint8_t {
+    PLAIN = 0,
+    DICT = 1,
+    FOR = 2,
+    DELTA = 3,
+    RLE = 4,
+    OMITTED = 5
+  };
+
 protected:
+  /* PackedInts tags its int layouts the same way, so they convert by value */
+  static_assert((int)PackedInts::Encoding::PLAIN == (int)Encoding::PLAIN &&
+                (int)PackedInts::Encoding::FOR == (int)Encoding::FOR &&
+                (int)PackedInts::Encoding::DELTA == (int)Encoding::DELTA &&
+                (int)PackedInts::Encoding::RLE == (int)Encoding::RLE);
+  static Encoding from_packed(PackedInts::Encoding e) { return (Encoding)e; }
+  static PackedInts::Encoding to_packed(Encoding e) {
+    assert(e != Encoding::DICT && e != Encoding::OMITTED);
+    return (PackedInts::Encoding)e;
+  }
+
   const Data::Type type;
-  vector<bool> missings;
+  Bitmap missings;
+  ZoneMap zone;
+  BloomFilter bloom;
+
+  /* every change to a value goes through one of these, which mark the zone map
+   * as out of date and drop the Bloom filter */
+  void push_missing(bool m) {
+    missings.push_back(m);
+    zone.known = false;
+    bloom.clear();
+  }
+  void set_missing(int y, bool m) {
+    missings[y] = m;
+    zone.known = false;
+    bloom.clear();
+  }
+  void resize_missings(int len) {
+    missings.resize(len);
+    zone.known = false;
+    bloom.clear();
+  }
+
+  /**
+   * write the encoding tag, the zone map, the Bloom filter and the missing
+   * bitmap, aligned for the values which follow
+   */
+  void serialize_header(WriteCursor &c, Encoding enc) {
+    if (!zone.known)
+      compute_zone_map();
+    pack(c, (uint8_t)enc);
+    align(c, CHUNK_ALIGN);
+    pack(c, (int64_t)zone.null_count);
+    pack(c, zone.min);
+    pack(c, zone.max);
+    bloom.serialize(c);
+    c.ensure_space(missings.byte_size());
+    c.write(missings.byte_size(), missings.bytes());
+    align(c, CHUNK_ALIGN);
+  }
+
+  /* the bytes of a serialized bitmap of len bits, padded to a whole word by
+   * the alignment after it, which a borrowed Bitmap reads */
+  static uint64_t bitmap_bytes(int len) {
+    return ((uint64_t)len + 63) / 64 * sizeof(uint64_t);
+  }
+
+  /* whether the n offsets never decrease, so the strings they delimit are
+   * within the bytes after them */
+  static bool ascending(const uint32_t *offsets, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+      if (offsets[i] < offsets[i - 1])
+        return false;
+    }
+    return true;
+  }
+
+  /* whether each of the len dictionary codes is below n_dict */
+  static bool codes_in(const uint32_t *codes, int len, uint32_t n_dict) {
+    for (int y = 0; y < len; y++) {
+      if (codes[y] >= n_dict)
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * read what serialize_header wrote for a column of len values, returns the
+   * encoding of the values which follow, nullopt if it is unknown or the
+   * cursor ends before the header does. Borrows the Bloom filter and missing
+   * bitmap from the cursor's bytes instead of copying them if borrow is set.
+   */
+  optional<Encoding> fill_header(int len, ReadCursor &c, bool borrow = false) {
+    assert(length() == 0); // only fill empty columns
+    if (!can_read(c, 1))
+      return nullopt;
+    Encoding enc = (Encoding)yield<uint8_t>(c);
+    if (enc > Encoding::OMITTED)
+      return nullopt;
+    align(c, CHUNK_ALIGN);
+    if (enc == Encoding::OMITTED) {
+      /* every value missing, the caller fills in empty values */
+      zone = ZoneMap();
+      zone.known = true;
+      zone.null_count = len;
+      bloom.clear();
+      missings.assign(len, true);
+      return enc;
+    }
+    if (!can_read(c, sizeof(int64_t) + 2 * sizeof(double)))
+      return nullopt;
+    zone.null_count = yield<int64_t>(c);
+    zone.min = yield<double>(c);
+    zone.max = yield<double>(c);
+    zone.known = true;
+    if (!bloom.fill(c, borrow) || !can_read(c, bitmap_bytes(len)))
+      return nullopt;
+    if (borrow)
+      missings.view(len, c.cursor);
+    else
+      missings.assign(len, c.cursor);
+    c.cursor += (len + 7) / 8;
+    align(c, CHUNK_ALIGN);
+    return enc;
+  }
 
 public:
   Column(const Data::Type t) : type(t) {}
@@ -26,11 +202,34 @@ public:
   Data::Type get_type() const { return type; }
 
   static Column *create(Data::Type);
+  /* create a read-only Column which reads a serialized column in place, see
+   * column_view.h */
+  static Column *create_view(Data::Type);
 
   /**
-   * fill this column from the given ReadCursor
+   * write a column left out of a projection, e.g. by GetCommand, as only its
+   * OMITTED encoding tag. It is filled as a column of only missing values.
    */
-  virtual void fill(int, ReadCursor &) = 0;
+  static void serialize_omitted(WriteCursor &c) {
+    pack(c, (uint8_t)Encoding::OMITTED);
+    align(c, CHUNK_ALIGN);
+  }
+
+  /**
+   * whether the serialized column at the cursor was omitted, without reading
+   * it, the cursor must have a byte to read
+   */
+  static bool is_omitted(const ReadCursor &c) {
+    return *c.cursor == (uint8_t)Encoding::OMITTED;
+  }
+
+  /**
+   * fill this column with len values from the given ReadCursor. Returns false
+   * if the encoding doesn't fit the column or the cursor ends before the
+   * values do, leaving the column unusable. Only the lengths are checked, not
+   * that every value (e.g. a string offset) is consistent.
+   */
+  virtual bool fill(int len, ReadCursor &) = 0;
   /**
    * serialize the contents of this column into the given cursor, should have
    * parity with fill
@@ -60,51 +259,275 @@ public:
   virtual int get_int(int y) const = 0;
   virtual float get_float(int y) const = 0;
   virtual bool get_bool(int y) const = 0;
-  virtual string *get_string(int y) const = 0;
+  /**
+   * read a string in place, valid as long as the column isn't modified, only
+   * string columns have strings
+   */
+  virtual string_view get_string_view(int y) const {
+    assert(false);
+    return {};
+  }
+  /* a copy of the string at y, to keep it past changes to the column */
+  string get_string(int y) const { return string(get_string_view(y)); }
+
+  /**
+   * read the n ints starting at y into out, decoding a compressed column a
+   * block at a time, which scans should prefer over get_int
+   */
+  virtual void get_ints(int y, int n, int *out) const {
+    for (int i = 0; i < n; i++)
+      out[i] = get_int(y + i);
+  }
+
+  /**
+   * the values of an uncompressed int or float column in place, one per row,
+   * nullptr for any other column, see RowBatch
+   */
+  virtual const int *int_values() const { return nullptr; }
+  virtual const float *float_values() const { return nullptr; }
+
+  /**
+   * the bitmap with a bit set for each missing value
+   */
+  const Bitmap &missing_bitmap() const { return missings; }
+
+  /**
+   * compress the column if worth it and release spare capacity, once it is
+   * done growing, e.g. when a Parser finishes a DataFrameChunk. Modifying a
+   * compacted column is allowed but decompresses it first.
+   */
+  virtual void compact() {}
+
+  /**
+   * the statistics of this column's values, only known once computed, e.g. by
+   * compact or serialize, or read with the rest of a serialized column
+   */
+  const ZoneMap &zone_map() const { return zone; }
+
+  /**
+   * scan the values to record their statistics in the zone map
+   */
+  void compute_zone_map() {
+    ZoneMap z;
+    int vals[256];
+    for (int y = 0; y < length(); y += 256) {
+      int n = min(256, length() - y);
+      if (type == Data::Type::INT)
+        get_ints(y, n, vals);
+      for (int i = 0; i < n; i++) {
+        if (is_missing(y + i)) {
+          z.null_count++;
+          continue;
+        }
+        double v;
+        switch (type) {
+        case Data::Type::INT:
+          v = vals[i];
+          break;
+        case Data::Type::FLOAT:
+          v = get_float(y + i);
+          break;
+        case Data::Type::STRING:
+          continue; // no bounds
+        default:
+          v = get_bool(y + i);
+        }
+        z.min = std::min(z.min, v);
+        z.max = std::max(z.max, v);
+      }
+    }
+    z.known = true;
+    zone = z;
+  }
+
+  /**
+   * the Bloom filter of this int column's present values, empty (which may
+   * contain anything) unless built by build_bloom_filter or read with the rest
+   * of a serialized column. Modifying the column drops it.
+   */
+  const BloomFilter &bloom_filter() const { return bloom; }
+
+  /**
+   * add every present value of this int column to a new Bloom filter of
+   * bits_per_key bits a value, once the column is done growing
+   */
+  void build_bloom_filter(double bits_per_key) {
+    assert(type == Data::Type::INT);
+    if (!zone.known)
+      compute_zone_map();
+    int n_present = length() - zone.null_count;
+    BloomFilter b(n_present, bits_per_key);
+    int vals[256];
+    for (int y = 0; y < length(); y += 256) {
+      int n = min(256, length() - y);
+      get_ints(y, n, vals);
+      for (int i = 0; i < n; i++) {
+        if (!is_missing(y + i))
+          b.add(vals[i]);
+      }
+    }
+    bloom = move(b);
+  }
+
+  /**
+   * the dictionary of a dictionary-encoded string column, so a Rower can
+   * aggregate on codes and resolve each distinct string once. dict_size is 0
+   * and dict_codes is nullptr for any other column. The code of a missing
+   * value is meaningless.
+   */
+  virtual int dict_size() const { return 0; }
+  virtual const uint32_t *dict_codes() const { return nullptr; }
+  virtual string_view dict_entry(uint32_t code) const {
+    assert(false);
+    return {};
+  }
 
   virtual bool equals(const Column &c) const {
     return type == c.type && length() == c.length();
   }
+
+  /**
+   * compare every value through the getters, for comparing Columns of the
+   * same type with different implementations
+   */
+  bool values_equal(const Column &c) const {
+    if (!Column::equals(c))
+      return false;
+    for (int i = 0; i < length(); i++) {
+      if (is_missing(i) || c.is_missing(i)) {
+        if (is_missing(i) != c.is_missing(i))
+          return false;
+        continue;
+      }
+      bool eq;
+      switch (type) {
+      case Data::Type::INT:
+        eq = get_int(i) == c.get_int(i);
+        break;
+      case Data::Type::FLOAT:
+        eq = get_float(i) == c.get_float(i);
+        break;
+      case Data::Type::STRING:
+        eq = get_string_view(i) == c.get_string_view(i);
+        break;
+      default:
+        eq = get_bool(i) == c.get_bool(i);
+      }
+      if (!eq)
+        return false;
+    }
+    return true;
+  }
   bool is_missing(int y) const { return missings[y]; }
   int length() const { return missings.size(); }
 };
 
 /**
- * A template which represents contiguous storage of it's templated type.
+ * A template which represents contiguous storage of it's templated type. bools
+ * are stored packed in a Bitmap.
+ *
+ * Once compacted int and bool columns are compressed with PackedInts if that
+ * is smaller, in which case data is empty and the values are read from the
+ * encoded bytes, which are also what is serialized.
  *
  * authors: @grahamwren, @jagen31
  */
 template <typename T> class TypedColumn : public Column {
 protected:
-  vector<T> data;
+  static constexpr bool packable = is_same_v<T, int> || is_same_v<T, bool>;
+
+  conditional_t<is_same_v<T, bool>, Bitmap, vector<T>> data;
+  /* the encoded values when compressed, see compact */
+  vector<uint64_t> packed_bytes;
+  PackedInts packed;
+  bool is_packed = false;
+
+  /* read the PackedInts at the start of the bytes of packed_bytes */
+  void open_packed(Encoding enc, size_t n_bytes) {
+    ReadCursor rc(n_bytes, reinterpret_cast<uint8_t *>(packed_bytes.data()));
+    packed.open(to_packed(enc), length(), rc);
+    is_packed = true;
+  }
+
+  /* store the values uncompressed again so they can be modified */
+  void unpack() {
+    if constexpr (packable) {
+      if (!is_packed)
+        return;
+      vector<int32_t> vals(length());
+      packed.decode(0, length(), vals.data());
+      if constexpr (is_same_v<T, bool>) {
+        data.reserve(length());
+        for (int32_t v : vals)
+          data.push_back(v);
+      } else {
+        data.assign(vals.begin(), vals.end());
+      }
+      packed_bytes.clear();
+      packed_bytes.shrink_to_fit();
+      is_packed = false;
+    }
+  }
 
 public:
   TypedColumn() : Column(Data::get_type<T>()) {}
 
-  void fill(int len, ReadCursor &c) {
-    data.reserve(len);
-    for (int i = 0; i < len; i++) {
-      bool missing = yield<uint8_t>(c) == 1;
-      if (missing) {
-        push();
-      } else {
-        push(yield<T>(c));
+  bool fill(int len, ReadCursor &c) {
+    optional<Encoding> enc = fill_header(len, c);
+    if (!enc)
+      return false;
+    if (*enc == Encoding::OMITTED) {
+      data.resize(len);
+      return true;
+    }
+    if constexpr (packable) {
+      if (*enc != Encoding::PLAIN && *enc != Encoding::DICT) {
+        /* copy the encoded bytes and read them in place */
+        const uint8_t *start = c.cursor;
+        PackedInts in_cursor;
+        if (!in_cursor.open(to_packed(*enc), len, c))
+          return false;
+        size_t n_bytes = c.cursor - start;
+        packed_bytes.resize((n_bytes + 7) / 8);
+        memcpy(packed_bytes.data(), start, n_bytes);
+        open_packed(*enc, n_bytes);
+        return true;
       }
     }
+    if (*enc != Encoding::PLAIN)
+      return false;
+    if constexpr (is_same_v<T, bool>) {
+      if (!can_read(c, (len + 7) / 8))
+        return false;
+      data.assign(len, c.cursor);
+      c.cursor += data.byte_size();
+    } else {
+      if (!can_read(c, (uint64_t)len * sizeof(T)))
+        return false;
+      data.resize(len);
+      memcpy(data.data(), c.cursor, len * sizeof(T));
+      c.cursor += len * sizeof(T);
+    }
+    align(c, CHUNK_ALIGN);
+    return true;
   }
 
   void serialize(WriteCursor &c) {
-    c.ensure_space(length() * (1 + sizeof(T)));
-    for (int i = 0; i < length(); i++) {
-      if (is_missing(i)) {
-        /* pack single byte for missing */
-        pack(c, (uint8_t)1);
-      } else {
-        /* pack single byte for missing */
-        pack(c, (uint8_t)0);
-        pack(c, (T)data[i]);
-      }
+    if (is_packed) {
+      serialize_header(c, from_packed(packed.encoding()));
+      c.ensure_space(packed.byte_size());
+      c.write(packed.byte_size(), packed.bytes());
+      return;
+    }
+    serialize_header(c, Encoding::PLAIN);
+    if constexpr (is_same_v<T, bool>) {
+      c.ensure_space(data.byte_size());
+      c.write(data.byte_size(), data.bytes());
+    } else {
+      c.ensure_space(length() * sizeof(T));
+      c.write(length(), data.data());
     }
+    align(c, CHUNK_ALIGN);
   }
 
   /* this is annoying, they should already be here from parent */
@@ -112,32 +535,97 @@ public:
   void push(float val) { assert(false); }
   void push(bool val) { assert(false); }
   void push(string *val) { assert(false); }
-  void push() {
-    data.push_back((T)NULL);
-    missings.push_back(true);
-  }
+  void push() { append_missing(); }
 
   void set(int y, int val) { assert(false); }
   void set(int y, float val) { assert(false); }
   void set(int y, bool val) { assert(false); }
   void set(int y, string *val) { assert(false); }
   void set(int y) {
+    unpack();
     data[y] = (T)NULL;
-    missings[y] = true;
+    set_missing(y, true);
+  }
+
+  /**
+   * non-virtual appends for callers which know the type of this column, e.g.
+   * the Parser filling a DataFrameChunk column by column
+   */
+  void append(T val) {
+    unpack();
+    push_missing(false);
+    data.push_back(val);
+  }
+  void append_missing() {
+    unpack();
+    push_missing(true);
+    data.push_back((T)NULL);
+  }
+
+  /* drop every value after the first len */
+  void truncate(int len) {
+    unpack();
+    resize_missings(len);
+    data.resize(len);
   }
 
+  /**
+   * record the zone map and compress an int or bool column with PackedInts if
+   * that is smaller than its plain values
+   */
+  void compact() {
+    if (!zone.known)
+      compute_zone_map();
+    if constexpr (packable) {
+      if (is_packed)
+        return;
+      int len = length();
+      /* missing values take the previous present value (or the first one) so
+       * they don't widen the range of values or break up runs */
+      int first = 0;
+      while (first < len && is_missing(first))
+        first++;
+      vector<int32_t> vals(len);
+      int32_t prev = first < len ? data[first] : 0;
+      for (int i = 0; i < len; i++)
+        vals[i] = prev = is_missing(i) ? prev : data[i];
+      size_t plain_size;
+      if constexpr (is_same_v<T, bool>)
+        plain_size = (data.byte_size() + 7) / 8 * 8;
+      else
+        plain_size = len * sizeof(T);
+
+      WriteCursor wc;
+      Encoding enc = from_packed(PackedInts::encode(vals.data(), len, wc));
+      if (enc != Encoding::PLAIN && wc.length() < plain_size) {
+        packed_bytes.resize((wc.length() + 7) / 8);
+        memcpy(packed_bytes.data(), wc.begin(), wc.length());
+        open_packed(enc, wc.length());
+        data = {};
+      }
+    }
+  }
+
+  bool is_compressed() const { return is_packed; }
+
   int get_int(int y) const { assert(false); }
   float get_float(int y) const { assert(false); }
   bool get_bool(int y) const { assert(false); }
-  string *get_string(int y) const { assert(false); }
+  void get_ints(int y, int n, int *out) const { Column::get_ints(y, n, out); }
+  const int *int_values() const { return nullptr; }
+  const float *float_values() const { return nullptr; }
 
   bool equals(const Column &c) const {
     if (!Column::equals(c)) {
       return false;
     }
 
-    /* Column::equals checks type and length fields so cast should be safe */
-    const TypedColumn<T> &other = dynamic_cast<const TypedColumn<T> &>(c);
+    /* Column::equals checks type and length fields so cast should be safe,
+     * unless c is another implementation, e.g. a view */
+    const TypedColumn<T> *other_ptr = dynamic_cast<const TypedColumn<T> *>(&c);
+    if (!other_ptr || is_packed || other_ptr->is_packed)
+      return values_equal(c);
+    const TypedColumn<T> &other = *other_ptr;
     for (int i = 0; i < length(); i++) {
       if ((is_missing(i) && other.is_missing(i)) ||
           (data[i] == other.data[i])) {
@@ -149,68 +637,419 @@ public:
   }
 };
 
-template <> void TypedColumn<int>::push(int val) {
-  missings.push_back(false);
-  data.push_back(val);
-}
-template <> void TypedColumn<float>::push(float val) {
-  missings.push_back(false);
-  data.push_back(val);
-}
-template <> void TypedColumn<bool>::push(bool val) {
-  missings.push_back(false);
-  data.push_back(val);
-}
-template <> void TypedColumn<string *>::push(string *val) {
-  assert(val);
-  missings.push_back(false);
-  data.push_back(val);
-}
+/**
+ * A column of strings stored as one contiguous arena holding the bytes of
+ * every string back to back, and len + 1 uint32 offsets into it, so cell i is
+ * bytes [offsets[i], offsets[i + 1]). Missing cells are empty. This is also
+ * the serialized layout, so serialize and fill are a memcpy of each buffer.
+ *
+ * A column with few distinct strings can be dictionary-encoded (see encode),
+ * then the arena and offsets hold each distinct string once and every row has
+ * a uint32 code, the index of its string in that dictionary.
+ *
+ * Appending a string copies its bytes to the end of the arena, the column
+ * never takes ownership of the strings it is given. The Parser instead appends
+ * views of its input with append_view, which stay borrowed after the arena's
+ * cells until compact() copies them in, so a chunk parsed from an mmap is
+ * serialized without ever copying its strings into the column.
+ * get_string_view reads a cell in place without allocating or locking.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+template <> class TypedColumn<string *> : public Column {
+protected:
+  /* every string, or only the distinct strings if dictionary-encoded */
+  vector<uint32_t> offsets{0};
+  vector<char> arena;
+  /* cells after the arena's which borrow the caller's memory, empty if missing
+   */
+  vector<string_view> borrowed;
+  size_t borrowed_bytes = 0;
+  /* the dictionary code of each row, empty unless dictionary-encoded */
+  vector<uint32_t> codes;
+  bool dict = false;
 
-template <> void TypedColumn<int>::set(int y, int val) {
-  data[y] = val;
-  missings[y] = false;
-}
-template <> void TypedColumn<float>::set(int y, float val) {
+  /* number of cells in the arena, every later cell is borrowed */
+  int n_arena() const { return offsets.size() - 1; }
+
+  string_view entry(uint32_t i) const {
+    return string_view(arena.data() + offsets[i], offsets[i + 1] - offsets[i]);
+  }
+
+  /* the string of row y of a column which isn't encoded */
+  string_view cell(int y) const {
+    return y < n_arena() ? entry(y) : borrowed[y - n_arena()];
+  }
+
+  /* fill n strings laid out as offsets and then bytes, false if the cursor
+   * ends before they do */
+  bool fill_strings(uint32_t n, ReadCursor &c) {
+    if (!can_read(c, ((uint64_t)n + 1) * sizeof(uint32_t)))
+      return false;
+    offsets.resize((uint64_t)n + 1);
+    memcpy(offsets.data(), c.cursor, offsets.size() * sizeof(uint32_t));
+    c.cursor += offsets.size() * sizeof(uint32_t);
+    align(c, CHUNK_ALIGN);
+    if (!ascending(offsets.data(), offsets.size()) ||
+        !can_read(c, offsets.back()))
+      return false;
+    arena.resize(offsets.back());
+    memcpy(arena.data(), c.cursor, arena.size());
+    c.cursor += arena.size();
+    align(c, CHUNK_ALIGN);
+    return true;
+  }
+
+  void serialize_strings(WriteCursor &c) const {
+    assert(byte_size() <= UINT32_MAX); // offsets are 32 bits
+    c.ensure_space((offsets.size() + borrowed.size()) * sizeof(uint32_t));
+    c.write(offsets.size(), offsets.data());
+    uint32_t end = arena.size();
+    for (const string_view &cell : borrowed)
+      c.write(end += cell.size());
+    align(c, CHUNK_ALIGN);
+    c.ensure_space(byte_size());
+    c.write(arena.size(), arena.data());
+    for (const string_view &cell : borrowed)
+      c.write(cell.size(), cell.data());
+    align(c, CHUNK_ALIGN);
+  }
+
+public:
+  TypedColumn() : Column(Data::Type::STRING) {}
+
+  bool fill(int len, ReadCursor &c) {
+    optional<Encoding> enc = fill_header(len, c);
+    if (!enc)
+      return false;
+    borrowed.clear();
+    borrowed_bytes = 0;
+    if (*enc == Encoding::OMITTED) {
+      offsets.assign(len + 1, 0);
+      return true;
+    }
+    if (*enc == Encoding::DICT) {
+      if (!can_read(c, sizeof(uint32_t)))
+        return false;
+      uint32_t n_dict = yield<uint32_t>(c);
+      if (n_dict > INT32_MAX - 1)
+        return false;
+      align(c, CHUNK_ALIGN);
+      if (!fill_strings(n_dict, c) ||
+          !can_read(c, (uint64_t)len * sizeof(uint32_t)))
+        return false;
+      codes.resize(len);
+      memcpy(codes.data(), c.cursor, len * sizeof(uint32_t));
+      c.cursor += len * sizeof(uint32_t);
+      align(c, CHUNK_ALIGN);
+      if (!codes_in(codes.data(), len, n_dict))
+        return false;
+      dict = true;
+      return true;
+    }
+    return *enc == Encoding::PLAIN && fill_strings(len, c);
+  }
+
+  /**
+   * serialize as PLAIN, or as DICT if encoded: the number of distinct strings,
+   * the dictionary laid out like a PLAIN column, and then the code of each row
+   */
+  void serialize(WriteCursor &c) {
+    if (dict) {
+      serialize_header(c, Encoding::DICT);
+      pack(c, (uint32_t)dict_size());
+      align(c, CHUNK_ALIGN);
+      serialize_strings(c);
+      c.ensure_space(codes.size() * sizeof(uint32_t));
+      c.write(codes.size(), codes.data());
+      align(c, CHUNK_ALIGN);
+    } else {
+      serialize_header(c, Encoding::PLAIN);
+      serialize_strings(c);
+    }
+  }
+
+  void push(int val) { assert(false); }
+  void push(float val) { assert(false); }
+  void push(bool val) { assert(false); }
+  void push(string *val) {
+    assert(val);
+    append(val->data(), val->size());
+  }
+  void push() { append_missing(); }
+
+  void set(int y, int val) { assert(false); }
+  void set(int y, float val) { assert(false); }
+  void set(int y, bool val) { assert(false); }
+  /**
+   * replace the bytes of cell y, moving every later cell, so O(bytes after y)
+   */
+  void set(int y, string *val) {
+    assert(val);
+    decode();
+    copy_borrowed();
+    replace(y, val->data(), val->size());
+    set_missing(y, false);
+  }
+  void set(int y) {
+    decode();
+    copy_borrowed();
+    replace(y, nullptr, 0);
+    set_missing(y, true);
+  }
+
+  int get_int(int y) const { assert(false); }
+  float get_float(int y) const { assert(false); }
+  bool get_bool(int y) const { assert(false); }
+  string_view get_string_view(int y) const {
+    assert(!is_missing(y));
+    return dict ? entry(codes[y]) : cell(y);
+  }
+
+  int dict_size() const { return dict ? offsets.size() - 1 : 0; }
+  const uint32_t *dict_codes() const { return dict ? codes.data() : nullptr; }
+  string_view dict_entry(uint32_t code) const {
+    assert(dict);
+    return entry(code);
+  }
+
+  /**
+   * non-virtual appends for callers which know the type of this column, e.g.
+   * the Parser filling a DataFrameChunk column by column. The len bytes at s
+   * are copied to the end of the arena.
+   */
+  void append(const char *s, size_t len) {
+    decode();
+    copy_borrowed(); // the borrowed cells come after the arena's
+    assert(arena.size() + len <= UINT32_MAX); // offsets are 32 bits
+    arena.insert(arena.end(), s, s + len);
+    offsets.push_back(arena.size());
+    push_missing(false);
+  }
+  void append(string_view s) { append(s.data(), s.size()); }
+  /**
+   * append the len bytes at s without copying them, they must outlive this
+   * column or its next compact() call
+   */
+  void append_view(const char *s, size_t len) {
+    decode();
+    borrowed.emplace_back(s, len);
+    borrowed_bytes += len;
+    push_missing(false);
+  }
+  void append_missing() {
+    decode();
+    if (borrowed.empty())
+      offsets.push_back(arena.size());
+    else
+      borrowed.emplace_back();
+    push_missing(true);
+  }
+
+  /**
+   * dictionary-encode the column if at most STRING_DICT_MAX_RATIO of its
+   * present values are distinct, returns whether the column is encoded. Only
+   * the distinct strings are copied, borrowed cells are read in place.
+   */
+  bool encode() {
+    if (dict)
+      return true;
+    int n_present = 0;
+    for (int y = 0; y < length(); y++)
+      n_present += !is_missing(y);
+    size_t max_distinct = n_present * STRING_DICT_MAX_RATIO;
+    if (n_present == 0 || max_distinct == 0)
+      return false;
+
+    unordered_map<string_view, uint32_t> index;
+    vector<uint32_t> dict_offsets{0};
+    vector<char> dict_arena;
+    vector<uint32_t> row_codes(length(), 0); // missing rows keep code 0
+    for (int y = 0; y < length(); y++) {
+      if (is_missing(y))
+        continue;
+      string_view s = cell(y);
+      auto it = index.find(s);
+      if (it == index.end()) {
+        if (index.size() == max_distinct)
+          return false; // too many distinct strings to be worth it
+        it = index.emplace(s, index.size()).first;
+        dict_arena.insert(dict_arena.end(), s.begin(), s.end());
+        dict_offsets.push_back(dict_arena.size());
+      }
+      row_codes[y] = it->second;
+    }
+    offsets = move(dict_offsets);
+    arena = move(dict_arena);
+    codes = move(row_codes);
+    borrowed.clear();
+    borrowed_bytes = 0;
+    dict = true;
+    return true;
+  }
+
+  /**
+   * undo encode, storing every row's string again so the column can be
+   * modified
+   */
+  void decode() {
+    if (!dict)
+      return;
+    vector<uint32_t> row_offsets{0};
+    vector<char> row_arena;
+    row_offsets.reserve(length() + 1);
+    for (int y = 0; y < length(); y++) {
+      if (!is_missing(y)) {
+        string_view s = entry(codes[y]);
+        row_arena.insert(row_arena.end(), s.begin(), s.end());
+      }
+      row_offsets.push_back(row_arena.size());
+    }
+    offsets = move(row_offsets);
+    arena = move(row_arena);
+    codes.clear();
+    dict = false;
+  }
+
+  bool is_encoded() const { return dict; }
+
+  /**
+   * copy the borrowed cells to the end of the arena, in one allocation, e.g.
+   * before the buffer they point into is reused
+   */
+  void copy_borrowed() {
+    if (borrowed.empty())
+      return;
+    assert(byte_size() <= UINT32_MAX); // offsets are 32 bits
+    arena.reserve(byte_size());
+    offsets.reserve(length() + 1);
+    for (const string_view &cell : borrowed) {
+      arena.insert(arena.end(), cell.begin(), cell.end());
+      offsets.push_back(arena.size());
+    }
+    borrowed.clear();
+    borrowed_bytes = 0;
+  }
+
+  /**
+   * record the zone map, dictionary-encode the column if worth it (see
+   * encode) or else copy the borrowed cells into the arena, and release the
+   * spare capacity of its buffers, once the column is done growing
+   */
+  void compact() {
+    if (!zone.known)
+      compute_zone_map();
+    if (!encode())
+      copy_borrowed();
+    arena.shrink_to_fit();
+    offsets.shrink_to_fit();
+    codes.shrink_to_fit();
+  }
+
+  /* drop every value after the first len */
+  void truncate(int len) {
+    decode();
+    if (len >= n_arena()) {
+      for (int i = len - n_arena(); i < borrowed.size(); i++)
+        borrowed_bytes -= borrowed[i].size();
+      borrowed.resize(len - n_arena());
+    } else {
+      borrowed.clear();
+      borrowed_bytes = 0;
+      offsets.resize(len + 1);
+      arena.resize(offsets.back());
+    }
+    resize_missings(len);
+  }
+
+  /**
+   * the sum of the lengths of every string, in the arena or borrowed, or of
+   * every distinct string if dictionary-encoded
+   */
+  size_t byte_size() const { return arena.size() + borrowed_bytes; }
+
+  bool equals(const Column &c) const {
+    if (!Column::equals(c)) {
+      return false;
+    }
+
+    /* Column::equals checks type and length fields so cast should be safe,
+     * unless c is another implementation, e.g. a view */
+    const TypedColumn<string *> *other_ptr =
+        dynamic_cast<const TypedColumn<string *> *>(&c);
+    if (!other_ptr)
+      return values_equal(c);
+    const TypedColumn<string *> &other = *other_ptr;
+    for (int i = 0; i < length(); i++) {
+      if ((is_missing(i) && other.is_missing(i)) ||
+          (!is_missing(i) && !other.is_missing(i) &&
+           get_string_view(i) == other.get_string_view(i))) {
+        continue;
+      }
+      return false;
+    }
+    return true;
+  }
+
+protected:
+  /* splice len bytes at s in place of the bytes of cell y, not encoded */
+  void replace(int y, const char *s, size_t len) {
+    assert(!dict);
+    uint32_t start = offsets[y], old_len = offsets[y + 1] - start;
+    assert(arena.size() - old_len + len <= UINT32_MAX);
+    arena.erase(arena.begin() + start, arena.begin() + start + old_len);
+    arena.insert(arena.begin() + start, s, s + len);
+    int64_t delta = (int64_t)len - old_len;
+    for (int i = y + 1; i < offsets.size(); i++)
+      offsets[i] += delta;
+  }
+};
+
+template <> inline void TypedColumn<int>::push(int val) { append(val); }
+template <> inline void TypedColumn<float>::push(float val) { append(val); }
+template <> inline void TypedColumn<bool>::push(bool val) { append(val); }
+
+template <> inline void TypedColumn<int>::set(int y, int val) {
+  unpack();
   data[y] = val;
-  missings[y] = false;
+  set_missing(y, false);
 }
-template <> void TypedColumn<bool>::set(int y, bool val) {
+template <> inline void TypedColumn<float>::set(int y, float val) {
   data[y] = val;
-  missings[y] = false;
+  set_missing(y, false);
 }
-template <> void TypedColumn<string *>::set(int y, string *val) {
-  assert(val);
+template <> inline void TypedColumn<bool>::set(int y, bool val) {
+  unpack();
   data[y] = val;
-  missings[y] = false;
+  set_missing(y, false);
 }
 
-template <> int TypedColumn<int>::get_int(int y) const { return data[y]; }
-template <> float TypedColumn<float>::get_float(int y) const { return data[y]; }
-template <> bool TypedColumn<bool>::get_bool(int y) const { return data[y]; }
-template <> string *TypedColumn<string *>::get_string(int y) const {
-  assert(data[y]);
+template <> inline int TypedColumn<int>::get_int(int y) const {
+  return is_packed ? packed.get(y) : data[y];
+}
+template <> inline float TypedColumn<float>::get_float(int y) const {
   return data[y];
 }
-template <> bool TypedColumn<string *>::equals(const Column &c) const {
-  if (!Column::equals(c)) {
-    return false;
-  }
+template <> inline bool TypedColumn<bool>::get_bool(int y) const {
+  return is_packed ? packed.get(y) : data[y];
+}
 
-  /* Column::equals checks type and length fields so cast should be safe */
-  const TypedColumn<string *> &other =
-      dynamic_cast<const TypedColumn<string *> &>(c);
-  for (int i = 0; i < length(); i++) {
-    if ((is_missing(i) && other.is_missing(i)) ||
-        (data[i]->compare(*other.data[i]) == 0)) {
-      continue;
-    }
-    return false;
-  }
-  return true;
+template <>
+inline void TypedColumn<int>::get_ints(int y, int n, int *out) const {
+  if (is_packed)
+    packed.decode(y, n, out);
+  else
+    memcpy(out, data.data() + y, n * sizeof(int));
+}
+
+template <> inline const int *TypedColumn<int>::int_values() const {
+  return is_packed ? nullptr : data.data();
+}
+template <> inline const float *TypedColumn<float>::float_values() const {
+  return data.data();
 }
 
-Column *Column::create(Data::Type t) {
+inline Column *Column::create(Data::Type t) {
   switch (t) {
   case Data::Type::INT:
     return new TypedColumn<int>();
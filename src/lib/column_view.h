@@ -0,0 +1,252 @@
+#pragma once
+
+#include "column.h"
+
+using namespace std;
+
+/**
+ * A read-only Column which reads the values of a serialized column (see
+ * Column) in place, without copying them. fill only records where the missing
+ * bitmap and values are in the cursor's bytes, so it takes constant time no
+ * matter how many values there are. The bytes must be CHUNK_ALIGN aligned in
+ * memory and outlive the view, e.g. by the owning DataFrameChunk keeping the
+ * received packet alive. Compressed int and bool columns are read in place
+ * with PackedInts.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+template <typename T> class ColumnView : public Column {
+protected:
+  conditional_t<is_same_v<T, bool>, Bitmap, const T *> values{};
+  PackedInts packed;
+  bool is_packed = false;
+
+public:
+  ColumnView() : Column(Data::get_type<T>()) {}
+
+  bool fill(int len, ReadCursor &c) {
+    optional<Encoding> enc = fill_header(len, c, true);
+    if (!enc)
+      return false;
+    assert(*enc != Encoding::OMITTED); // filled as a TypedColumn instead
+    if (*enc != Encoding::PLAIN) {
+      /* only ints and bools are packed */
+      if (is_same_v<T, float> || *enc == Encoding::DICT ||
+          !packed.open(to_packed(*enc), len, c))
+        return false;
+      is_packed = true;
+      return true;
+    }
+    if constexpr (is_same_v<T, bool>) {
+      if (!can_read(c, bitmap_bytes(len)))
+        return false;
+      values.view(len, c.cursor);
+      c.cursor += values.byte_size();
+    } else {
+      if (!can_read(c, (uint64_t)len * sizeof(T)))
+        return false;
+      values = reinterpret_cast<const T *>(c.cursor);
+      c.cursor += len * sizeof(T);
+    }
+    align(c, CHUNK_ALIGN);
+    return true;
+  }
+
+  void serialize(WriteCursor &c) {
+    if (is_packed) {
+      serialize_header(c, from_packed(packed.encoding()));
+      c.ensure_space(packed.byte_size());
+      c.write(packed.byte_size(), packed.bytes());
+      return;
+    }
+    serialize_header(c, Encoding::PLAIN);
+    if constexpr (is_same_v<T, bool>) {
+      c.ensure_space(values.byte_size());
+      c.write(values.byte_size(), values.bytes());
+    } else {
+      c.ensure_space(length() * sizeof(T));
+      c.write(length(), values);
+    }
+    align(c, CHUNK_ALIGN);
+  }
+
+  /* read-only */
+  void push(int val) { assert(false); }
+  void push(float val) { assert(false); }
+  void push(bool val) { assert(false); }
+  void push(string *val) { assert(false); }
+  void push() { assert(false); }
+
+  void set(int y, int val) { assert(false); }
+  void set(int y, float val) { assert(false); }
+  void set(int y, bool val) { assert(false); }
+  void set(int y, string *val) { assert(false); }
+  void set(int y) { assert(false); }
+
+  int get_int(int y) const { assert(false); }
+  float get_float(int y) const { assert(false); }
+  bool get_bool(int y) const { assert(false); }
+  void get_ints(int y, int n, int *out) const { Column::get_ints(y, n, out); }
+  const int *int_values() const { return nullptr; }
+  const float *float_values() const { return nullptr; }
+
+  bool equals(const Column &c) const { return values_equal(c); }
+};
+
+/**
+ * A read-only view of a serialized string column, the uint32 offsets and the
+ * bytes of every string, or of every distinct string and the code of each row
+ * if dictionary-encoded. Like TypedColumn<string *>, get_string_view reads a
+ * cell in place.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+template <> class ColumnView<string *> : public Column {
+protected:
+  const uint8_t *offsets = nullptr; // n_strings + 1 uint32s
+  const char *bytes = nullptr;
+  int n_strings = 0;
+  const uint32_t *codes = nullptr; // only if dictionary-encoded
+
+  uint32_t offset(int i) const {
+    return reinterpret_cast<const uint32_t *>(offsets)[i];
+  }
+  string_view entry(uint32_t i) const {
+    uint32_t start = offset(i);
+    return string_view(bytes + start, offset(i + 1) - start);
+  }
+
+public:
+  ColumnView() : Column(Data::Type::STRING) {}
+
+  bool fill(int len, ReadCursor &c) {
+    optional<Encoding> enc = fill_header(len, c, true);
+    if (!enc)
+      return false;
+    assert(*enc != Encoding::OMITTED); // filled as a TypedColumn instead
+    n_strings = len;
+    if (*enc == Encoding::DICT) {
+      if (!can_read(c, sizeof(uint32_t)))
+        return false;
+      uint32_t n_dict = yield<uint32_t>(c);
+      if (n_dict > INT32_MAX - 1)
+        return false;
+      n_strings = n_dict;
+      align(c, CHUNK_ALIGN);
+    } else if (*enc != Encoding::PLAIN) {
+      return false;
+    }
+    if (!can_read(c, ((uint64_t)n_strings + 1) * sizeof(uint32_t)))
+      return false;
+    offsets = c.cursor;
+    c.cursor += (n_strings + 1) * sizeof(uint32_t);
+    align(c, CHUNK_ALIGN);
+    if (!ascending(reinterpret_cast<const uint32_t *>(offsets), n_strings + 1) ||
+        !can_read(c, offset(n_strings)))
+      return false;
+    bytes = reinterpret_cast<const char *>(c.cursor);
+    c.cursor += offset(n_strings);
+    align(c, CHUNK_ALIGN);
+    if (*enc == Encoding::DICT) {
+      if (!can_read(c, (uint64_t)len * sizeof(uint32_t)))
+        return false;
+      codes = reinterpret_cast<const uint32_t *>(c.cursor);
+      c.cursor += len * sizeof(uint32_t);
+      align(c, CHUNK_ALIGN);
+      if (!codes_in(codes, len, n_strings))
+        return false;
+    }
+    return true;
+  }
+
+  void serialize(WriteCursor &c) {
+    serialize_header(c, codes ? Encoding::DICT : Encoding::PLAIN);
+    if (codes) {
+      pack(c, (uint32_t)n_strings);
+      align(c, CHUNK_ALIGN);
+    }
+    c.ensure_space((n_strings + 1) * sizeof(uint32_t));
+    c.write((n_strings + 1) * sizeof(uint32_t), offsets);
+    align(c, CHUNK_ALIGN);
+    c.ensure_space(offset(n_strings));
+    c.write(offset(n_strings), bytes);
+    align(c, CHUNK_ALIGN);
+    if (codes) {
+      c.ensure_space(length() * sizeof(uint32_t));
+      c.write(length(), codes);
+      align(c, CHUNK_ALIGN);
+    }
+  }
+
+  /* read-only */
+  void push(int val) { assert(false); }
+  void push(float val) { assert(false); }
+  void push(bool val) { assert(false); }
+  void push(string *val) { assert(false); }
+  void push() { assert(false); }
+
+  void set(int y, int val) { assert(false); }
+  void set(int y, float val) { assert(false); }
+  void set(int y, bool val) { assert(false); }
+  void set(int y, string *val) { assert(false); }
+  void set(int y) { assert(false); }
+
+  int get_int(int y) const { assert(false); }
+  float get_float(int y) const { assert(false); }
+  bool get_bool(int y) const { assert(false); }
+  string_view get_string_view(int y) const {
+    assert(!is_missing(y));
+    return entry(codes ? codes[y] : y);
+  }
+
+  int dict_size() const { return codes ? n_strings : 0; }
+  const uint32_t *dict_codes() const { return codes; }
+  string_view dict_entry(uint32_t code) const {
+    assert(codes);
+    return entry(code);
+  }
+
+  bool equals(const Column &c) const { return values_equal(c); }
+};
+
+template <> inline int ColumnView<int>::get_int(int y) const {
+  return is_packed ? packed.get(y) : values[y];
+}
+template <> inline float ColumnView<float>::get_float(int y) const {
+  return values[y];
+}
+template <> inline bool ColumnView<bool>::get_bool(int y) const {
+  return is_packed ? packed.get(y) : values[y];
+}
+
+template <>
+inline void ColumnView<int>::get_ints(int y, int n, int *out) const {
+  if (is_packed)
+    packed.decode(y, n, out);
+  else
+    memcpy(out, values + y, n * sizeof(int));
+}
+
+template <> inline const int *ColumnView<int>::int_values() const {
+  return is_packed ? nullptr : values;
+}
+template <> inline const float *ColumnView<float>::float_values() const {
+  return values;
+}
+
+inline Column *Column::create_view(Data::Type t) {
+  switch (t) {
+  case Data::Type::INT:
+    return new ColumnView<int>();
+  case Data::Type::FLOAT:
+    return new ColumnView<float>();
+  case Data::Type::BOOL:
+    return new ColumnView<bool>();
+  case Data::Type::STRING:
+    return new ColumnView<string *>();
+  case Data::Type::MISSING:
+    return new ColumnView<bool>();
+  default:
+    assert(false);
+  }
+}
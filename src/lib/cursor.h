@@ -23,6 +23,10 @@
  * Also supports checkpoint-ing the cursor position so that a parser can create
  * a checkpoint and then try to do some parsing and if it fails simply roll the
  * cursor position back to the checkpoint it created.
+ *
+ * The cursor can optionally share ownership of the bytes it reads (owner), so
+ * things read from it can keep pointing into the bytes rather than copying
+ * them, e.g. a DataFrameChunk reading straight out of a received packet.
  */
 class ReadCursor {
 public:
@@ -30,14 +34,19 @@ public:
   uint8_t *cursor = nullptr;
   uint8_t const *bytes_end = nullptr;
   std::stack<uint8_t *> *checkpoints;
+  std::shared_ptr<uint8_t> owner;
 
   ReadCursor(long len, uint8_t *b)
       : bytes(b), cursor(b), bytes_end(b + len),
         checkpoints(new std::stack<uint8_t *>()) {}
+  ReadCursor(long len, uint8_t *b, const std::shared_ptr<uint8_t> &owner)
+      : ReadCursor(len, b) {
+    this->owner = owner;
+  }
   ReadCursor(const sized_ptr<uint8_t> data) : ReadCursor(data.len, data.ptr) {}
   ReadCursor(ReadCursor &&c)
       : bytes(c.bytes), cursor(c.cursor), bytes_end(c.bytes_end),
-        checkpoints(c.checkpoints) {
+        checkpoints(c.checkpoints), owner(std::move(c.owner)) {
     c.checkpoints = nullptr;
   }
   ~ReadCursor() { delete checkpoints; }
@@ -112,6 +121,23 @@ template <typename T> inline bool expect(ReadCursor &c, T val) {
 inline bool empty(const ReadCursor &c) { return c.cursor >= c.bytes_end; }
 inline bool has_next(const ReadCursor &c) { return c.cursor < c.bytes_end; }
 
+/**
+ * whether n more bytes can be read from the cursor, to check a length read
+ * from bytes which can't be trusted (e.g. a received packet) before using it
+ */
+inline bool can_read(const ReadCursor &c, uint64_t n) {
+  return c.cursor <= c.bytes_end && n <= (uint64_t)(c.bytes_end - c.cursor);
+}
+
+/**
+ * skip ahead to the next multiple of n bytes from the start of the cursor,
+ * matches align(WriteCursor &, int)
+ */
+inline void align(ReadCursor &c, int n) {
+  long offset = c.cursor - c.bytes;
+  c.cursor += (n - offset % n) % n;
+}
+
 inline void checkpoint(ReadCursor &c) { c.checkpoints->push(c.cursor); }
 inline void commit(ReadCursor &c) { c.checkpoints->pop(); }
 inline void rollback(ReadCursor &c) {
@@ -186,6 +212,17 @@ public:
   uint8_t *end() { return begin() + length(); }
 };
 
+/**
+ * pad with zeros up to the next multiple of n bytes from the start of the
+ * cursor, matches align(ReadCursor &, int)
+ */
+inline void align(WriteCursor &c, int n) {
+  int padding = (n - c.length() % n) % n;
+  c.ensure_space(padding);
+  for (int i = 0; i < padding; i++)
+    c.write((uint8_t)0);
+}
+
 template <typename T> inline void pack(WriteCursor &c, T val) {
   c.ensure_space(sizeof(T));
   c.write(val);
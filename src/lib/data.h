@@ -3,6 +3,7 @@
 #include <cassert>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <variant>
 
 using namespace std;
@@ -16,7 +17,8 @@ using namespace std;
 class Data {
 protected:
   bool missing;
-  variant<int, float, bool, string *> data;
+  /* strings are either given as string* or read in place as a string_view */
+  variant<int, float, bool, string *, string_view> data;
 
 public:
   enum Type : uint8_t { MISSING = 1, BOOL = 2, INT = 3, FLOAT = 4, STRING = 5 };
@@ -65,6 +67,7 @@ public:
   Data(float val) : missing(false), data(val) {}
   Data(bool val) : missing(false), data(val) {}
   Data(string *val) : missing(false), data(val) {}
+  Data(string_view val) : missing(false), data(val) {}
   Data(const Data &d) = default;
   Data(Data &&d) = default;
 
@@ -98,9 +101,23 @@ public:
     missing = false;
     data = val;
   }
+  void set(string_view val) {
+    missing = false;
+    data = val;
+  }
   void set() { missing = true; }
 };
 
+/**
+ * read a string whether it was set as a string* or a string_view
+ */
+template <> inline string_view Data::get<string_view>() const {
+  assert(!is_missing());
+  if (const string *const *s = get_if<string *>(&data))
+    return **s;
+  return std::get<string_view>(data);
+}
+
 template <> inline Data::Type Data::get_type<int>() noexcept {
   return Data::Type::INT;
 }
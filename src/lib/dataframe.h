@@ -54,7 +54,7 @@ public:
           row.set(i, get_bool(idx, i));
           break;
         case Data::Type::STRING:
-          row.set(i, get_string(idx, i));
+          row.set(i, get_string_view(idx, i));
           break;
         default:
           assert(false); // unsupported column type
@@ -82,7 +82,14 @@ public:
   virtual int get_int(int y, int x) const = 0;
   virtual float get_float(int y, int x) const = 0;
   virtual bool get_bool(int y, int x) const = 0;
-  virtual string *get_string(int y, int x) const = 0;
+  /**
+   * strings are read in place, valid until the DataFrame is modified.
+   * get_string copies one into a std::string to keep it.
+   */
+  virtual string_view get_string_view(int y, int x) const = 0;
+  string get_string(int y, int x) const {
+    return string(get_string_view(y, x));
+  }
   virtual bool is_missing(int y, int x) const = 0;
 
   /**
@@ -118,8 +125,6 @@ public:
     const Schema &schema = get_schema();
 
     bool accept = true;
-    string *s;
-    string *os;
     if (schema == other.get_schema() && nrows() == other.nrows()) {
       for (int x = 0; x < ncols(); x++) {
         Data::Type t = schema.col_type(x);
@@ -138,10 +143,7 @@ public:
               accept = get_bool(y, x) == other.get_bool(y, x);
               break;
             case Data::Type::STRING:
-              s = get_string(y, x);
-              os = other.get_string(y, x);
-              accept = s == nullptr || os == nullptr ? s == os
-                                                     : s->compare(*os) == 0;
+              accept = get_string_view(y, x) == other.get_string_view(y, x);
               break;
             case Data::Type::MISSING:
               accept = true;
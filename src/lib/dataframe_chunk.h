@@ -1,8 +1,10 @@
 #pragma once
 
 #include "column.h"
+#include "column_view.h"
 #include "data.h"
 #include "dataframe.h"
+#include "row_batch.h"
 #include <algorithm>
 #include <memory>
 #include <vector>
@@ -11,18 +13,31 @@
 #define DF_CHUNK_SIZE (4096 * 2 * 2 * 2 * 2)
 #endif
 
+/* version of the serialized chunk format, written at the start of every chunk
+ * so a node can't misread a chunk from an incompatible build */
+#define DF_CHUNK_FORMAT_VERSION 6
+
 using namespace std;
 
 /**
  * A class which represents a fixed length chunk of a DataFrame. Designed to be
  * the chunk which is distributed thoughout the EAU2 cluster.
  *
+ * A chunk filled from a ReadCursor which shares ownership of its bytes (e.g.
+ * one over a received Packet's data) is a read-only view: its columns read the
+ * serialized values in place and the chunk keeps the bytes alive, so filling
+ * it doesn't depend on the number of rows.
+ *
  * authors: @grahamwren, @jagen31
  */
 class DataFrameChunk : public DataFrame {
 private:
   const Schema &schema;
   vector<unique_ptr<Column>> columns;
+  /* the serialized bytes read in place by a view */
+  shared_ptr<uint8_t> view_owner;
+  const uint8_t *view_begin = nullptr;
+  long view_len = 0;
 
 public:
   DataFrameChunk(const Schema &scm) : schema(scm) {
@@ -34,36 +49,193 @@ public:
   }
 
   DataFrameChunk(const Schema &scm, ReadCursor &c) : DataFrameChunk(scm) {
-    fill(c);
+    bool filled = fill(c);
+    assert(filled);
   }
 
-  void fill(ReadCursor &c) {
+  /**
+   * fill this chunk from a chunk serialized at the current position of the
+   * ReadCursor, which must be CHUNK_ALIGN aligned from the start of the cursor
+   * like it was when serialized. Returns false if the chunk is from another
+   * version of the format or the cursor ends before it does (see Column::fill),
+   * then this chunk is unusable and should be dropped.
+   */
+  bool fill(ReadCursor &c) {
+    assert(nrows() == 0);
+    assert((c.cursor - c.bytes) % CHUNK_ALIGN == 0);
+    const uint8_t *begin = c.cursor;
+    if (!can_read(c, sizeof(uint32_t) + sizeof(int)))
+      return false;
+    uint32_t version = yield<uint32_t>(c);
     int len = yield<int>(c);
-    /* fill each column from left to right */
+    if (version != DF_CHUNK_FORMAT_VERSION || len < 0 || len > DF_CHUNK_SIZE)
+      return false;
+
+    /* read in place when the bytes will outlive this chunk and are aligned
+     * in memory, otherwise copy them */
+    bool in_place =
+        c.owner && reinterpret_cast<uintptr_t>(c.bytes) % CHUNK_ALIGN == 0;
+    /* fill each column from left to right, omitted columns have no bytes to
+     * read in place */
     for (int i = 0; i < schema.width(); i++) {
-      columns[i]->fill(len, c);
+      if (!can_read(c, 1))
+        return false;
+      if (in_place && !Column::is_omitted(c))
+        columns[i].reset(Column::create_view(schema.col_type(i)));
+      if (!columns[i]->fill(len, c))
+        return false;
     }
+    if (in_place) {
+      view_owner = c.owner;
+      view_begin = begin;
+      view_len = c.cursor - begin;
+    }
+    return true;
   }
 
   DataFrameChunk(DataFrameChunk &&) noexcept = default;
   DataFrameChunk(const DataFrameChunk &) = delete;
 
-  ~DataFrameChunk() {
-    for (int i = 0; i < get_schema().width(); i++) {
-      if (get_schema().col_type(i) == Data::Type::STRING) {
-        for (int y = 0; y < nrows(); y++) {
-          if (!is_missing(y, i)) {
-            delete get_string(y, i);
-          }
-        }
-      }
+  /**
+   * copy any strings this chunk borrows from its input, e.g. after a Parser
+   * filled it from a buffer which is about to be reused
+   */
+  void copy_strings() {
+    if (is_view())
+      return; // nothing borrowed but the bytes it keeps alive
+    for (int i = 0; i < schema.width(); i++) {
+      if (schema.col_type(i) == Data::Type::STRING)
+        static_cast<TypedColumn<string *> &>(*columns[i]).copy_borrowed();
+    }
+  }
+
+  /**
+   * compress every column worth compressing (see Column::compact), e.g.
+   * dictionary-encoding strings and bit-packing ints, and copy any strings
+   * left borrowed, once a Parser is done filling this chunk
+   */
+  void finalize() {
+    if (is_view())
+      return; // already as compact as the bytes it reads
+    for (unique_ptr<Column> &col : columns)
+      col->compact();
+  }
+
+  /**
+   * build a Bloom filter of bits_per_key bits a value for every int column,
+   * see Column::build_bloom_filter, once the chunk is done growing
+   */
+  void build_bloom_filters(double bits_per_key) {
+    assert(!is_view());
+    for (unique_ptr<Column> &col : columns) {
+      if (col->get_type() == Data::Type::INT)
+        col->build_bloom_filter(bits_per_key);
     }
   }
 
   const Schema &get_schema() const { return schema; }
 
+  /**
+   * skip the chunk if the Rower can tell from the zone maps that no row
+   * matters, or give the whole chunk to the Rower, then each RowBatch of it if
+   * the Rower didn't handle it, then each row of a batch the Rower didn't
+   * handle, see Rower::can_skip, Rower::accept_chunk and Rower::accept_batch.
+   * idx_offset is the index of this chunk's first row in its DataFrame. Only
+   * the columns in the Rower's projection are read, see Rower::projection.
+   */
+  void map(Rower &rower, int idx_offset) const {
+    if (rower.can_skip(*this) || rower.accept_chunk(*this))
+      return;
+    RowBatch batch = row_batch(idx_offset);
+    vector<int> cols = projection_of(rower);
+    Row row(schema);
+    /* columns outside the projection stay missing in every row */
+    for (int x = 0; x < ncols(); x++)
+      row.set_missing(x);
+    for (int y = 0; y < nrows(); y += ROW_BATCH_SIZE) {
+      batch.seek(y, min(ROW_BATCH_SIZE, nrows() - y));
+      if (rower.accept_batch(batch))
+        continue;
+      for (int i = 0; i < batch.length(); i++) {
+        batch.fill_row(i, row, cols);
+        rower.accept(row);
+      }
+    }
+  }
+  void map(Rower &rower) const { map(rower, 0); }
+
+  /**
+   * the statistics of column x, see Column::zone_map. Known for chunks which
+   * have been finalized or serialized, or filled from serialized bytes.
+   */
+  const ZoneMap &zone_map(int x) const {
+    assert(x >= 0);
+    assert(x < ncols());
+    return columns[x]->zone_map();
+  }
+
+  /**
+   * the Bloom filter of column x, see Column::bloom_filter. Empty unless built
+   * by build_bloom_filters before the chunk was serialized.
+   */
+  const BloomFilter &bloom_filter(int x) const {
+    assert(x >= 0);
+    assert(x < ncols());
+    return columns[x]->bloom_filter();
+  }
+
+  /**
+   * the valid columns of the Rower's projection, or every column if it has
+   * none
+   */
+  vector<int> projection_of(const Rower &rower) const {
+    optional<vector<int>> proj = rower.projection();
+    vector<int> cols;
+    for (int x = 0; x < ncols(); x++) {
+      if (!proj || find(proj->begin(), proj->end(), x) != proj->end())
+        cols.push_back(x);
+    }
+    return cols;
+  }
+
+  /**
+   * a RowBatch over this chunk's columns, seek it to the rows to read.
+   * idx_offset is the index of this chunk's first row in its DataFrame.
+   */
+  RowBatch row_batch(int idx_offset = 0) const {
+    return RowBatch(schema, columns, idx_offset);
+  }
+
+  /**
+   * the column at x, for reading a column at a time, e.g. in
+   * Rower::accept_chunk
+   */
+  const Column &get_column(int x) const {
+    assert(x >= 0);
+    assert(x < ncols());
+    return *columns[x];
+  }
+
+  /**
+   * whether this chunk is a read-only view of serialized bytes, see fill
+   */
+  bool is_view() const { return view_owner != nullptr; }
+
+  /**
+   * serialize as a version, the number of rows and then each column, see
+   * Column. Must start CHUNK_ALIGN aligned from the start of the WriteCursor so
+   * the column buffers are aligned.
+   */
   void serialize(WriteCursor &wc) const {
+    assert(wc.length() % CHUNK_ALIGN == 0);
+    if (is_view()) {
+      /* already serialized */
+      wc.ensure_space(view_len);
+      wc.write(view_len, view_begin);
+      return;
+    }
     int len = nrows();
+    pack(wc, (uint32_t)DF_CHUNK_FORMAT_VERSION);
     pack(wc, len);
     for (int i = 0; i < schema.width(); i++) {
       assert(columns[i]->length() == len);
@@ -71,6 +243,29 @@ public:
     }
   }
 
+  /**
+   * serialize like serialize, but only the columns in cols, every other column
+   * is serialized as OMITTED (see Column::serialize_omitted) and filled as a
+   * column of only missing values
+   */
+  void serialize(WriteCursor &wc, const vector<int> &cols) const {
+    assert(wc.length() % CHUNK_ALIGN == 0);
+    vector<bool> projected(schema.width(), false);
+    for (int x : cols) {
+      if (x >= 0 && x < schema.width())
+        projected[x] = true;
+    }
+    int len = nrows();
+    pack(wc, (uint32_t)DF_CHUNK_FORMAT_VERSION);
+    pack(wc, len);
+    for (int i = 0; i < schema.width(); i++) {
+      if (projected[i])
+        columns[i]->serialize(wc);
+      else
+        Column::serialize_omitted(wc);
+    }
+  }
+
   int get_int(int y, int x) const {
     assert(y >= 0);      // assert within this chunk
     assert(y < nrows()); // assert within this chunk
@@ -104,7 +299,7 @@ public:
     return col->get_bool(y);
   }
 
-  string *get_string(int y, int x) const {
+  string_view get_string_view(int y, int x) const {
     assert(y >= 0);      // assert within this chunk
     assert(y < nrows()); // assert within this chunk
     assert(x >= 0);
@@ -112,7 +307,7 @@ public:
 
     const unique_ptr<Column> &col = columns[x];
     assert(!col->is_missing(y));
-    return col->get_string(y);
+    return col->get_string_view(y);
   }
 
   bool is_missing(int y, int x) const {
@@ -127,8 +322,19 @@ public:
 
   bool is_full() const { return columns[0]->length() >= DF_CHUNK_SIZE; }
 
+  /**
+   * the column at x, for filling this chunk a column at a time. Every column
+   * must have the same length before the chunk is read from again.
+   */
+  Column &get_column(int x) {
+    assert(x >= 0);
+    assert(x < ncols());
+    return *columns[x];
+  }
+
   void add_row(const Row &row) {
     assert(!is_full());
+    assert(!is_view()); // views are read-only
     for (int i = 0; i < schema.width(); i++) {
       unique_ptr<Column> &col = columns[i];
       if (row.is_missing(i)) {
@@ -145,7 +351,8 @@ public:
           col->push(row.get<bool>(i));
           break;
         case Data::Type::STRING:
-          col->push(row.get<string *>(i));
+          static_cast<TypedColumn<string *> &>(*col).append(
+              row.get<string_view>(i));
           break;
         default:
           assert(false);
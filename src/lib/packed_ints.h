@@ -0,0 +1,458 @@
+#pragma once
+
+#include "cursor.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <inttypes.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKED_INTS_X86 true
+#endif
+
+#ifndef DELTA_BLOCK_SIZE
+#define DELTA_BLOCK_SIZE 128 // values per absolute value in a DELTA column
+#endif
+
+using namespace std;
+
+/**
+ * Lightweight compression for int (and bool) columns. PackedInts::encode
+ * picks the smallest of:
+ *   - FOR:   frame of reference, the min value and then every value minus the
+ *            min bit-packed in as few bits as the range of values needs
+ *   - DELTA: the difference to the previous value bit-packed like FOR, with
+ *            the absolute value of every DELTA_BLOCK_SIZE-th value so reading a
+ *            value doesn't decode from the start, for sorted or dense ranges
+ *   - RLE:   the end and value of every run of equal values
+ *   - PLAIN: 32 bits a value, if none of the above are smaller
+ *
+ * A PackedInts reads the encoded bytes in place, like a ColumnView, so the
+ * same bytes work in memory, on the wire and in a received packet. get reads
+ * a single value, decode unpacks a range of values, which scans should prefer.
+ * decode unpacks and prefix-sums 8 values at a time with AVX2 when the CPU
+ * supports it and a value at a time otherwise, picked once at runtime like
+ * SorScanner. A DELTA get sums every delta since the start of its block, up
+ * to DELTA_BLOCK_SIZE - 1 of them, while decode sums each delta once, so a
+ * smaller DELTA_BLOCK_SIZE trades size for faster gets.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class PackedInts {
+public:
+  /* the int layouts, tagged the same as in Column::Encoding */
+  enum class Encoding : uint8_t { PLAIN = 0, FOR = 2, DELTA = 3, RLE = 4 };
+
+  typedef void (*unpack_fn_t)(const uint64_t *, uint64_t, uint8_t, uint32_t,
+                              int, int32_t *);
+  typedef uint32_t (*running_sum_fn_t)(int32_t *, int, uint32_t);
+
+protected:
+  Encoding enc = Encoding::PLAIN;
+  int len = 0;
+  const uint8_t *begin = nullptr; // the encoded bytes
+  const uint8_t *end = nullptr;
+  const int32_t *plain = nullptr;        // PLAIN
+  int64_t base = 0;                      // FOR min value, DELTA min delta
+  uint8_t width = 0;                     // FOR, DELTA bits per value
+  const uint64_t *words = nullptr;       // FOR, DELTA packed values
+  const int32_t *block_starts = nullptr; // DELTA
+  uint32_t n_runs = 0;                   // RLE
+  const uint32_t *run_ends = nullptr;    // RLE, exclusive
+  const int32_t *run_values = nullptr;   // RLE
+
+  /**
+   * the width bits starting at bit, words must have a word of padding at the
+   * end so reading the word after never goes out of bounds
+   */
+  static uint64_t unpack(const uint64_t *words, uint64_t bit, uint8_t width) {
+    uint64_t k = bit >> 6, s = bit & 63;
+    /* shifting by 1 and then 63 - s avoids an undefined shift by 64 */
+    uint64_t v = (words[k] >> s) | ((words[k + 1] << 1) << (63 - s));
+    return v & ((1ULL << width) - 1);
+  }
+
+  /**
+   * the fastest kernels supported by this CPU, picked once
+   */
+  static unpack_fn_t unpack_kernel() {
+#ifdef PACKED_INTS_X86
+    static const unpack_fn_t fn =
+        __builtin_cpu_supports("avx2") ? unpack_avx2 : unpack_scalar;
+    return fn;
+#else
+    return unpack_scalar;
+#endif
+  }
+  static running_sum_fn_t running_sum_kernel() {
+#ifdef PACKED_INTS_X86
+    static const running_sum_fn_t fn =
+        __builtin_cpu_supports("avx2") ? running_sum_avx2 : running_sum_scalar;
+    return fn;
+#else
+    return running_sum_scalar;
+#endif
+  }
+
+  static uint8_t bits_for(uint64_t range) {
+    uint8_t w = 0;
+    while (w < 64 && range >> w)
+      w++;
+    return w;
+  }
+
+  static size_t n_words(int n, uint8_t width) {
+    /* + 1 word of padding after at least one word, even for 0 bit values */
+    return max(((uint64_t)n * width + 63) / 64, (uint64_t)1) + 1;
+  }
+
+  static void write_packed(WriteCursor &c, const vector<uint64_t> &vals,
+                           uint8_t width) {
+    vector<uint64_t> out(n_words(vals.size(), width), 0);
+    for (size_t i = 0; i < vals.size(); i++) {
+      uint64_t bit = i * width, k = bit >> 6, s = bit & 63;
+      out[k] |= vals[i] << s;
+      if (s + width > 64)
+        out[k + 1] |= vals[i] >> (64 - s);
+    }
+    c.ensure_space(out.size() * sizeof(uint64_t));
+    c.write(out.size(), out.data());
+  }
+
+  /* the run holding y */
+  uint32_t run_of(int y) const {
+    return upper_bound(run_ends, run_ends + n_runs, (uint32_t)y) - run_ends;
+  }
+
+  /* the DELTA value at y, the absolute value of its block plus every delta
+   * after it up to y */
+  int32_t delta_at(int y) const {
+    int block = y / DELTA_BLOCK_SIZE;
+    int first = block * DELTA_BLOCK_SIZE + 1;
+    uint64_t sum = 0;
+    for (int i = first; i <= y; i++)
+      sum += unpack(words, (uint64_t)i * width, width);
+    return (uint32_t)block_starts[block] + (uint32_t)sum +
+           (uint32_t)base * (uint32_t)(y - first + 1);
+  }
+
+public:
+  /**
+   * kernels of decode. unpack writes base plus each of the n width bit values
+   * packed from bit on in words to out. running_sum adds each of the n vals to
+   * v in turn, replacing it with the running total, and returns the total.
+   * Both wrap around like uint32s.
+   */
+  static void unpack_scalar(const uint64_t *words, uint64_t bit, uint8_t width,
+                            uint32_t base, int n, int32_t *out) {
+    for (int i = 0; i < n; i++, bit += width)
+      out[i] = base + (uint32_t)unpack(words, bit, width);
+  }
+  static uint32_t running_sum_scalar(int32_t *vals, int n, uint32_t v) {
+    for (int i = 0; i < n; i++)
+      vals[i] = v += (uint32_t)vals[i];
+    return v;
+  }
+
+#ifdef PACKED_INTS_X86
+  /**
+   * gathers the 8 bytes holding each of 8 values and shifts each down, a
+   * value is at most 32 bits after a shift of at most 7 so it fits in them
+   */
+  __attribute__((target("avx2"))) static void
+  unpack_avx2(const uint64_t *words, uint64_t bit, uint8_t width,
+              uint32_t base, int n, int32_t *out) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(words);
+    const __m256i mask = _mm256_set1_epi64x((1ULL << width) - 1);
+    const __m256i steps_lo = _mm256_setr_epi64x(0, width, 2 * width, 3 * width);
+    const __m256i steps_hi = _mm256_add_epi64(steps_lo,
+                                              _mm256_set1_epi64x(4 * width));
+    const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    const __m256i vbase = _mm256_set1_epi32(base);
+    const __m256i seven = _mm256_set1_epi64x(7);
+    int i = 0;
+    for (; i + 8 <= n; i += 8, bit += 8 * width) {
+      /* bits relative to the byte holding the first value */
+      const long long *p =
+          reinterpret_cast<const long long *>(bytes + (bit >> 3));
+      __m256i first = _mm256_set1_epi64x(bit & 7);
+      __m256i rel_lo = _mm256_add_epi64(first, steps_lo);
+      __m256i rel_hi = _mm256_add_epi64(first, steps_hi);
+      __m256i lo = _mm256_i64gather_epi64(p, _mm256_srli_epi64(rel_lo, 3), 1);
+      __m256i hi = _mm256_i64gather_epi64(p, _mm256_srli_epi64(rel_hi, 3), 1);
+      lo = _mm256_and_si256(
+          _mm256_srlv_epi64(lo, _mm256_and_si256(rel_lo, seven)), mask);
+      hi = _mm256_and_si256(
+          _mm256_srlv_epi64(hi, _mm256_and_si256(rel_hi, seven)), mask);
+      /* the low 32 bits of each 64 bit lane, in order */
+      lo = _mm256_permutevar8x32_epi32(lo, evens);
+      hi = _mm256_permutevar8x32_epi32(hi, evens);
+      __m256i vals = _mm256_inserti128_si256(lo, _mm256_castsi256_si128(hi), 1);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                          _mm256_add_epi32(vals, vbase));
+    }
+    unpack_scalar(words, bit, width, base, n - i, out + i);
+  }
+
+  /**
+   * prefix sums 8 values in log steps, each 128 bit half on its own and then
+   * the low half's total added to the high half
+   */
+  __attribute__((target("avx2"))) static uint32_t
+  running_sum_avx2(int32_t *vals, int n, uint32_t v) {
+    const __m256i last = _mm256_set1_epi32(7);
+    __m256i carry = _mm256_set1_epi32(v);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i *>(vals + i));
+      x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+      x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+      __m128i lo_total = _mm_shuffle_epi32(_mm256_castsi256_si128(x), 0xFF);
+      x = _mm256_add_epi32(
+          x, _mm256_inserti128_si256(_mm256_setzero_si256(), lo_total, 1));
+      x = _mm256_add_epi32(x, carry);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(vals + i), x);
+      carry = _mm256_permutevar8x32_epi32(x, last);
+    }
+    if (i > 0)
+      v = vals[i - 1];
+    return running_sum_scalar(vals + i, n - i, v);
+  }
+#endif
+
+  Encoding encoding() const { return enc; }
+
+  /**
+   * read the layout of len values with the given encoding from c, advancing
+   * past them. c's bytes must be CHUNK_ALIGN aligned and outlive this. Returns
+   * false if the encoding is unknown or c ends before the values do.
+   */
+  bool open(Encoding e, int n, ReadCursor &c) {
+    enc = e;
+    len = n;
+    begin = c.cursor;
+    switch (enc) {
+    case Encoding::PLAIN:
+      if (!can_read(c, (uint64_t)n * sizeof(int32_t)))
+        return false;
+      plain = reinterpret_cast<const int32_t *>(c.cursor);
+      c.cursor += n * sizeof(int32_t);
+      break;
+    case Encoding::FOR:
+    case Encoding::DELTA: {
+      if (!can_read(c, sizeof(int64_t) + 1))
+        return false;
+      if (enc == Encoding::FOR)
+        base = yield<int32_t>(c);
+      else
+        base = yield<int64_t>(c);
+      width = yield<uint8_t>(c);
+      if (width > 32)
+        return false; // never wider than an int32
+      align(c, sizeof(uint64_t));
+      if (enc == Encoding::DELTA) {
+        uint64_t n_blocks = (n + DELTA_BLOCK_SIZE - 1) / DELTA_BLOCK_SIZE;
+        if (!can_read(c, n_blocks * sizeof(int32_t)))
+          return false;
+        block_starts = reinterpret_cast<const int32_t *>(c.cursor);
+        c.cursor += n_blocks * sizeof(int32_t);
+        align(c, sizeof(uint64_t));
+      }
+      if (!can_read(c, n_words(n, width) * sizeof(uint64_t)))
+        return false;
+      words = reinterpret_cast<const uint64_t *>(c.cursor);
+      c.cursor += n_words(n, width) * sizeof(uint64_t);
+      break;
+    }
+    case Encoding::RLE:
+      if (!can_read(c, sizeof(uint32_t)))
+        return false;
+      n_runs = yield<uint32_t>(c);
+      align(c, sizeof(uint64_t));
+      if (!can_read(c, (uint64_t)n_runs * sizeof(uint32_t)))
+        return false;
+      run_ends = reinterpret_cast<const uint32_t *>(c.cursor);
+      c.cursor += n_runs * sizeof(uint32_t);
+      align(c, sizeof(uint64_t));
+      if (!can_read(c, (uint64_t)n_runs * sizeof(int32_t)))
+        return false;
+      run_values = reinterpret_cast<const int32_t *>(c.cursor);
+      c.cursor += n_runs * sizeof(int32_t);
+      /* runs are in order and the last ends at the last value, so a read
+       * never runs past it */
+      if (n > 0 && (n_runs == 0 || run_ends[n_runs - 1] != (uint32_t)n))
+        return false;
+      for (uint32_t r = 0; r < n_runs; r++) {
+        if (run_ends[r] <= (r ? run_ends[r - 1] : 0))
+          return false;
+      }
+      break;
+    default:
+      return false; // not an int encoding
+    }
+    align(c, sizeof(uint64_t));
+    end = c.cursor;
+    return true;
+  }
+
+  /**
+   * the encoded bytes, as read by open
+   */
+  const uint8_t *bytes() const { return begin; }
+  size_t byte_size() const { return end - begin; }
+
+  /* the value at y, see the cost of a DELTA get above */
+  int32_t get(int y) const {
+    switch (enc) {
+    case Encoding::PLAIN:
+      return plain[y];
+    case Encoding::FOR:
+      return (uint32_t)base + (uint32_t)unpack(words, (uint64_t)y * width,
+                                               width);
+    case Encoding::DELTA:
+      return delta_at(y);
+    case Encoding::RLE:
+      return run_values[run_of(y)];
+    default:
+      assert(false);
+    }
+  }
+
+  /**
+   * unpack the n values starting at y into out
+   */
+  void decode(int y, int n, int32_t *out) const {
+    assert(y + n <= len);
+    switch (enc) {
+    case Encoding::PLAIN:
+      memcpy(out, plain + y, n * sizeof(int32_t));
+      break;
+    case Encoding::FOR:
+      unpack_kernel()(words, (uint64_t)y * width, width, base, n, out);
+      break;
+    case Encoding::DELTA: {
+      /* unpack the deltas, then a running sum restarting at each block */
+      unpack_kernel()(words, (uint64_t)y * width, width, base, n, out);
+      for (int i = 0; i < n;) {
+        int in_block = (y + i) % DELTA_BLOCK_SIZE;
+        out[i] = in_block ? delta_at(y + i)
+                          : block_starts[(y + i) / DELTA_BLOCK_SIZE];
+        int block_end = min(n, i + DELTA_BLOCK_SIZE - in_block);
+        running_sum_kernel()(out + i + 1, block_end - i - 1, out[i]);
+        i = block_end;
+      }
+      break;
+    }
+    case Encoding::RLE: {
+      int i = 0;
+      for (uint32_t r = run_of(y); i < n; r++) {
+        int run_end = min((int)run_ends[r] - y, n);
+        fill(out + i, out + run_end, run_values[r]);
+        i = run_end;
+      }
+      break;
+    }
+    default:
+      assert(false);
+    }
+  }
+
+  /**
+   * the smallest encoding for the n values, written to c so open can read it
+   * back. Returns the encoding chosen.
+   */
+  static Encoding encode(const int32_t *vals, int n, WriteCursor &c) {
+    int64_t lo = INT32_MAX, hi = INT32_MIN;
+    int64_t lo_d = INT64_MAX, hi_d = INT64_MIN;
+    uint32_t runs = 0;
+    for (int i = 0; i < n; i++) {
+      lo = min(lo, (int64_t)vals[i]);
+      hi = max(hi, (int64_t)vals[i]);
+      if (i % DELTA_BLOCK_SIZE) {
+        int64_t d = (int64_t)vals[i] - vals[i - 1];
+        lo_d = min(lo_d, d);
+        hi_d = max(hi_d, d);
+      }
+      runs += i == 0 || vals[i] != vals[i - 1];
+    }
+    if (lo_d > hi_d)
+      lo_d = hi_d = 0; // no deltas, every value starts a block
+
+    uint8_t for_width = n ? bits_for(hi - lo) : 0;
+    uint8_t delta_width = bits_for(hi_d - lo_d);
+    int n_blocks = (n + DELTA_BLOCK_SIZE - 1) / DELTA_BLOCK_SIZE;
+    size_t plain_size = n * sizeof(int32_t);
+    size_t for_size = 8 + n_words(n, for_width) * 8;
+    size_t delta_size = 16 + (n_blocks * 4 + 7) / 8 * 8 +
+                        n_words(n, delta_width) * 8;
+    size_t rle_size = 8 + (runs * 4 + 7) / 8 * 8 * 2;
+    if (delta_width > 32)
+      delta_size = SIZE_MAX; // deltas are packed as uint32s
+
+    Encoding e = Encoding::PLAIN;
+    size_t best = plain_size;
+    if (for_size < best) {
+      e = Encoding::FOR;
+      best = for_size;
+    }
+    if (delta_size < best) {
+      e = Encoding::DELTA;
+      best = delta_size;
+    }
+    if (rle_size < best)
+      e = Encoding::RLE;
+
+    switch (e) {
+    case Encoding::PLAIN:
+      c.ensure_space(plain_size);
+      c.write(n, vals);
+      break;
+    case Encoding::FOR: {
+      pack(c, (int32_t)lo);
+      pack(c, for_width);
+      align(c, sizeof(uint64_t));
+      vector<uint64_t> packed(n);
+      for (int i = 0; i < n; i++)
+        packed[i] = vals[i] - lo;
+      write_packed(c, packed, for_width);
+      break;
+    }
+    case Encoding::DELTA: {
+      pack(c, lo_d);
+      pack(c, delta_width);
+      align(c, sizeof(uint64_t));
+      c.ensure_space(n_blocks * sizeof(int32_t));
+      for (int b = 0; b < n_blocks; b++)
+        c.write(vals[b * DELTA_BLOCK_SIZE]);
+      align(c, sizeof(uint64_t));
+      vector<uint64_t> packed(n, 0); // block starts pack as 0
+      for (int i = 0; i < n; i++) {
+        if (i % DELTA_BLOCK_SIZE)
+          packed[i] = (int64_t)vals[i] - vals[i - 1] - lo_d;
+      }
+      write_packed(c, packed, delta_width);
+      break;
+    }
+    case Encoding::RLE: {
+      pack(c, runs);
+      align(c, sizeof(uint64_t));
+      c.ensure_space(runs * sizeof(uint32_t) * 2);
+      for (int i = 1; i <= n; i++) {
+        if (i == n || vals[i] != vals[i - 1])
+          c.write((uint32_t)i);
+      }
+      align(c, sizeof(uint64_t));
+      for (int i = 0; i < n; i++) {
+        if (i == 0 || vals[i] != vals[i - 1])
+          c.write(vals[i]);
+      }
+      break;
+    }
+    default:
+      assert(false);
+    }
+    align(c, sizeof(uint64_t));
+    return e;
+  }
+};
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <inttypes.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REDUCE_X86 true
+#endif
+
+using namespace std;
+
+/**
+ * sum, count, min and max of the present values of an int column
+ */
+struct IntReduction {
+  int64_t sum = 0;
+  int64_t count = 0;
+  int32_t min = INT32_MAX;
+  int32_t max = INT32_MIN;
+
+  void join(const IntReduction &o) {
+    sum += o.sum;
+    count += o.count;
+    min = std::min(min, o.min);
+    max = std::max(max, o.max);
+  }
+};
+
+/**
+ * sum (in double precision), count, min and max of the present values of a
+ * float column
+ */
+struct FloatReduction {
+  double sum = 0;
+  int64_t count = 0;
+  float min = INFINITY;
+  float max = -INFINITY;
+
+  void join(const FloatReduction &o) {
+    sum += o.sum;
+    count += o.count;
+    min = std::min(min, o.min);
+    max = std::max(max, o.max);
+  }
+};
+
+/**
+ * Aggregation kernels over a span of column values and its missing bitmap
+ * (bit i % 8 of byte i / 8 set if value i is missing, see RowBatch), adding
+ * the present values to a reduction. 8 values are reduced at a time with AVX2
+ * when the CPU supports it, 4 at a time with SSE2 otherwise, and a value at a
+ * time on other architectures, picked once at runtime like SorScanner.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class Reduce {
+public:
+  typedef void (*int_fn_t)(const int32_t *, const uint8_t *, int,
+                           IntReduction &);
+  typedef void (*float_fn_t)(const float *, const uint8_t *, int,
+                             FloatReduction &);
+
+  static bool is_missing(const uint8_t *missing, int i) {
+    return missing && missing[i / 8] >> (i % 8) & 1;
+  }
+
+  /**
+   * add the present values of the n values at vals to out, missing is nullptr
+   * if no value is missing
+   */
+  static void ints(const int32_t *vals, const uint8_t *missing, int n,
+                   IntReduction &out) {
+    int_kernel()(vals, missing, n, out);
+  }
+  static void floats(const float *vals, const uint8_t *missing, int n,
+                     FloatReduction &out) {
+    float_kernel()(vals, missing, n, out);
+  }
+
+  /* from value i on, a value at a time, for tails shorter than a vector */
+  static void ints_scalar(const int32_t *vals, const uint8_t *missing, int n,
+                          IntReduction &out, int i = 0) {
+    for (; i < n; i++) {
+      if (is_missing(missing, i))
+        continue;
+      out.sum += vals[i];
+      out.count++;
+      out.min = min(out.min, vals[i]);
+      out.max = max(out.max, vals[i]);
+    }
+  }
+  static void floats_scalar(const float *vals, const uint8_t *missing, int n,
+                            FloatReduction &out, int i = 0) {
+    for (; i < n; i++) {
+      if (is_missing(missing, i))
+        continue;
+      out.sum += vals[i];
+      out.count++;
+      out.min = min(out.min, vals[i]);
+      out.max = max(out.max, vals[i]);
+    }
+  }
+
+#ifdef REDUCE_X86
+  /* lanes of present values of the 8 starting at i, all ones if present */
+  __attribute__((target("avx2"))) static __m256i
+  present_avx2(const uint8_t *missing, int i) {
+    if (!missing)
+      return _mm256_set1_epi32(-1);
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i m = _mm256_and_si256(_mm256_set1_epi32(missing[i / 8]), bits);
+    return _mm256_cmpeq_epi32(m, _mm256_setzero_si256());
+  }
+
+  __attribute__((target("avx2"))) static void
+  ints_avx2(const int32_t *vals, const uint8_t *missing, int n,
+            IntReduction &out) {
+    __m256i sum = _mm256_setzero_si256(); // 4 int64s
+    __m256i lo = _mm256_set1_epi32(INT32_MAX);
+    __m256i hi = _mm256_set1_epi32(INT32_MIN);
+    int64_t count = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(vals + i));
+      __m256i present = present_avx2(missing, i);
+      __m256i zeroed = _mm256_and_si256(v, present);
+      sum = _mm256_add_epi64(
+          sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(zeroed)));
+      sum = _mm256_add_epi64(
+          sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(zeroed, 1)));
+      lo = _mm256_min_epi32(
+          lo, _mm256_blendv_epi8(_mm256_set1_epi32(INT32_MAX), v, present));
+      hi = _mm256_max_epi32(
+          hi, _mm256_blendv_epi8(_mm256_set1_epi32(INT32_MIN), v, present));
+      count += missing ? 8 - __builtin_popcount(missing[i / 8]) : 8;
+    }
+    int64_t sums[4];
+    int32_t los[8], his[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums), sum);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(los), lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(his), hi);
+    out.sum += sums[0] + sums[1] + sums[2] + sums[3];
+    out.count += count;
+    out.min = min(out.min, *min_element(los, los + 8));
+    out.max = max(out.max, *max_element(his, his + 8));
+    ints_scalar(vals, missing, n, out, i);
+  }
+
+  __attribute__((target("avx2"))) static void
+  floats_avx2(const float *vals, const uint8_t *missing, int n,
+              FloatReduction &out) {
+    __m256d sum = _mm256_setzero_pd();
+    __m256 lo = _mm256_set1_ps(INFINITY);
+    __m256 hi = _mm256_set1_ps(-INFINITY);
+    int64_t count = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256 v = _mm256_loadu_ps(vals + i);
+      __m256 present = _mm256_castsi256_ps(present_avx2(missing, i));
+      __m256 zeroed = _mm256_and_ps(v, present);
+      sum = _mm256_add_pd(sum,
+                          _mm256_cvtps_pd(_mm256_castps256_ps128(zeroed)));
+      sum = _mm256_add_pd(sum,
+                          _mm256_cvtps_pd(_mm256_extractf128_ps(zeroed, 1)));
+      lo = _mm256_min_ps(lo,
+                         _mm256_blendv_ps(_mm256_set1_ps(INFINITY), v, present));
+      hi = _mm256_max_ps(
+          hi, _mm256_blendv_ps(_mm256_set1_ps(-INFINITY), v, present));
+      count += missing ? 8 - __builtin_popcount(missing[i / 8]) : 8;
+    }
+    double sums[4];
+    float los[8], his[8];
+    _mm256_storeu_pd(sums, sum);
+    _mm256_storeu_ps(los, lo);
+    _mm256_storeu_ps(his, hi);
+    out.sum += sums[0] + sums[1] + sums[2] + sums[3];
+    out.count += count;
+    out.min = min(out.min, *min_element(los, los + 8));
+    out.max = max(out.max, *max_element(his, his + 8));
+    floats_scalar(vals, missing, n, out, i);
+  }
+
+  /* lanes of present values of the 4 starting at i, all ones if present */
+  static __m128i present_sse2(const uint8_t *missing, int i) {
+    if (!missing)
+      return _mm_set1_epi32(-1);
+    const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+    int nibble = missing[i / 8] >> (i % 8) & 0xf;
+    __m128i m = _mm_and_si128(_mm_set1_epi32(nibble), bits);
+    return _mm_cmpeq_epi32(m, _mm_setzero_si128());
+  }
+
+  /* a where mask is set, otherwise b */
+  static __m128i select_sse2(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+  }
+
+  static void ints_sse2(const int32_t *vals, const uint8_t *missing, int n,
+                        IntReduction &out) {
+    __m128i sum = _mm_setzero_si128(); // 2 int64s
+    __m128i lo = _mm_set1_epi32(INT32_MAX);
+    __m128i hi = _mm_set1_epi32(INT32_MIN);
+    int64_t count = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(vals + i));
+      __m128i present = present_sse2(missing, i);
+      __m128i zeroed = _mm_and_si128(v, present);
+      /* sign-extend to int64s by interleaving with the sign bits */
+      __m128i sign = _mm_srai_epi32(zeroed, 31);
+      sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(zeroed, sign));
+      sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(zeroed, sign));
+      __m128i v_lo = select_sse2(present, v, _mm_set1_epi32(INT32_MAX));
+      __m128i v_hi = select_sse2(present, v, _mm_set1_epi32(INT32_MIN));
+      lo = select_sse2(_mm_cmplt_epi32(v_lo, lo), v_lo, lo);
+      hi = select_sse2(_mm_cmpgt_epi32(v_hi, hi), v_hi, hi);
+      count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(present)));
+    }
+    int64_t sums[2];
+    int32_t los[4], his[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(sums), sum);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(los), lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(his), hi);
+    out.sum += sums[0] + sums[1];
+    out.count += count;
+    out.min = min(out.min, *min_element(los, los + 4));
+    out.max = max(out.max, *max_element(his, his + 4));
+    ints_scalar(vals, missing, n, out, i);
+  }
+
+  static void floats_sse2(const float *vals, const uint8_t *missing, int n,
+                          FloatReduction &out) {
+    __m128d sum = _mm_setzero_pd();
+    __m128 lo = _mm_set1_ps(INFINITY);
+    __m128 hi = _mm_set1_ps(-INFINITY);
+    int64_t count = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128 v = _mm_loadu_ps(vals + i);
+      __m128 present = _mm_castsi128_ps(present_sse2(missing, i));
+      __m128 zeroed = _mm_and_ps(v, present);
+      sum = _mm_add_pd(sum, _mm_cvtps_pd(zeroed));
+      sum = _mm_add_pd(sum, _mm_cvtps_pd(_mm_movehl_ps(zeroed, zeroed)));
+      lo = _mm_min_ps(lo, _mm_or_ps(_mm_and_ps(present, v),
+                                    _mm_andnot_ps(present,
+                                                  _mm_set1_ps(INFINITY))));
+      hi = _mm_max_ps(hi, _mm_or_ps(_mm_and_ps(present, v),
+                                    _mm_andnot_ps(present,
+                                                  _mm_set1_ps(-INFINITY))));
+      count += __builtin_popcount(_mm_movemask_ps(present));
+    }
+    double sums[2];
+    float los[4], his[4];
+    _mm_storeu_pd(sums, sum);
+    _mm_storeu_ps(los, lo);
+    _mm_storeu_ps(his, hi);
+    out.sum += sums[0] + sums[1];
+    out.count += count;
+    out.min = min(out.min, *min_element(los, los + 4));
+    out.max = max(out.max, *max_element(his, his + 4));
+    floats_scalar(vals, missing, n, out, i);
+  }
+#endif
+
+  static void ints_scalar_fn(const int32_t *vals, const uint8_t *missing,
+                             int n, IntReduction &out) {
+    ints_scalar(vals, missing, n, out);
+  }
+  static void floats_scalar_fn(const float *vals, const uint8_t *missing,
+                               int n, FloatReduction &out) {
+    floats_scalar(vals, missing, n, out);
+  }
+
+  /**
+   * the fastest kernels supported by this CPU, picked once
+   */
+  static int_fn_t int_kernel() {
+#ifdef REDUCE_X86
+    static const int_fn_t fn =
+        __builtin_cpu_supports("avx2") ? ints_avx2 : ints_sse2;
+    return fn;
+#else
+    return ints_scalar_fn;
+#endif
+  }
+  static float_fn_t float_kernel() {
+#ifdef REDUCE_X86
+    static const float_fn_t fn =
+        __builtin_cpu_supports("avx2") ? floats_avx2 : floats_sse2;
+    return fn;
+#else
+    return floats_scalar_fn;
+#endif
+  }
+};
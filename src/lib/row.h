@@ -106,7 +106,9 @@ public:
 
   /**
    * Getters: get the value at the given column. If the column is not
-   * of the requested type, the result is undefined.
+   * of the requested type, the result is undefined. Strings can always be read
+   * as a string_view, but only as a string* if they were set as one, Rows
+   * filled from a DataFrame hold views of its strings (see DataFrame::fill_row)
    */
   template <typename T> T get(int col) const { return data[col].get<T>(); }
   bool is_missing(int i) const { return data[i].is_missing(); }
@@ -142,6 +144,12 @@ public:
     data[col].set(val);
   }
 
+  /* val must outlive its use in this row */
+  void set(int col, string_view val) {
+    assert(col < width());
+    data[col].set(val);
+  }
+
   void set(int col, const Data &val) {
     assert(col < width());
 
@@ -154,8 +162,6 @@ public:
     const Schema &schema = get_schema();
 
     bool accept = true;
-    string *s;
-    string *os;
     if (schema == other.get_schema()) {
       for (int x = 0; x < schema.width(); x++) {
         if (is_missing(x)) {
@@ -172,11 +178,7 @@ public:
             accept = get<bool>(x) == other.get<bool>(x);
             break;
           case Data::Type::STRING:
-            s = get<string *>(x);
-            os = other.get<string *>(x);
-            accept = s == nullptr || os == nullptr
-                         ? s == os
-                         : s->compare(*other.get<string *>(x)) == 0;
+            accept = get<string_view>(x) == other.get<string_view>(x);
             break;
           case Data::Type::MISSING:
             accept = true;
@@ -223,11 +225,8 @@ public:
         break;
       }
       case Data::Type::STRING: {
-        string *s = get<string *>(i);
-        if (s)
-          pack(c, sized_ptr(s->size(), s->c_str()));
-        else
-          pack(c, sized_ptr<char>(0, 0));
+        string_view s = get<string_view>(i);
+        pack(c, sized_ptr(s.size(), s.data()));
         break;
       }
       default:
@@ -256,9 +255,7 @@ public:
           cout << get<bool>(i);
           break;
         case 'S':
-          string *s = get<string *>(i);
-          assert(s);
-          cout << '"' << get<string *>(i)->c_str() << '"';
+          cout << '"' << get<string_view>(i) << '"';
           break;
         }
       }
@@ -275,3 +272,4 @@ template int Row::get<int>(int) const;
 template float Row::get<float>(int) const;
 template bool Row::get<bool>(int) const;
 template string *Row::get<string *>(int) const;
+template string_view Row::get<string_view>(int) const;
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "column.h"
+#include "row.h"
+#include "schema.h"
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#ifndef ROW_BATCH_SIZE
+#define ROW_BATCH_SIZE 1024 // rows given to Rower::accept_batch at a time
+#endif
+
+using namespace std;
+
+/**
+ * A batch of up to ROW_BATCH_SIZE consecutive rows of a DataFrameChunk, given
+ * to Rower::accept_batch so a Rower can read whole columns at a time instead of
+ * a Row at a time.
+ *
+ * Each column is a span of typed values, one per row of the batch, plus the
+ * missing bitmap of the batch (bit i set if row i is missing, the value of a
+ * missing row is meaningless). Spans are read on first use, so a Rower only
+ * pays for the columns it reads: uncompressed int and float columns are read
+ * in place, compressed ints are decoded a batch at a time (see
+ * Column::get_ints) and everything else is copied through the getters. Spans
+ * are valid until the batch moves on to the next rows.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class RowBatch {
+protected:
+  /* the values of one column for the current rows, read on first use */
+  struct Span {
+    bool ready = false;
+    const void *values = nullptr;
+    vector<int> ints;
+    vector<uint8_t> bools;
+    vector<string_view> strings;
+  };
+
+  const Schema &schema;
+  const vector<unique_ptr<Column>> &columns;
+  int idx_offset;
+  int start = 0;
+  int len = 0;
+  mutable vector<Span> spans;
+
+  const Column &column(int x, Data::Type t) const {
+    assert(x >= 0 && x < schema.width());
+    assert(schema.col_type(x) == t);
+    return *columns[x];
+  }
+
+public:
+  /**
+   * batches over the given columns of a chunk, idx_offset is the index of the
+   * chunk's first row in its DataFrame, see Row::get_idx
+   */
+  RowBatch(const Schema &scm, const vector<unique_ptr<Column>> &cols,
+           int idx_offset = 0)
+      : schema(scm), columns(cols), idx_offset(idx_offset),
+        spans(scm.width()) {}
+  RowBatch(const RowBatch &) = delete;
+
+  /**
+   * move to the n rows starting at row y of the chunk, y must be a multiple of
+   * 8 so the missing bitmaps start on a byte
+   */
+  void seek(int y, int n) {
+    assert(y % 8 == 0);
+    assert(n <= ROW_BATCH_SIZE);
+    start = y;
+    len = n;
+    for (Span &s : spans)
+      s.ready = false;
+  }
+
+  const Schema &get_schema() const { return schema; }
+  int length() const { return len; }
+  /* the index in the DataFrame of the first row of the batch */
+  int first_idx() const { return idx_offset + start; }
+
+  const int *ints(int x) const {
+    const Column &col = column(x, Data::Type::INT);
+    Span &s = spans[x];
+    if (!s.ready) {
+      if (const int *vals = col.int_values()) {
+        s.values = vals + start;
+      } else {
+        s.ints.resize(ROW_BATCH_SIZE);
+        col.get_ints(start, len, s.ints.data());
+        s.values = s.ints.data();
+      }
+      s.ready = true;
+    }
+    return static_cast<const int *>(s.values);
+  }
+
+  const float *floats(int x) const {
+    const Column &col = column(x, Data::Type::FLOAT);
+    Span &s = spans[x];
+    if (!s.ready) {
+      s.values = col.float_values() + start;
+      s.ready = true;
+    }
+    return static_cast<const float *>(s.values);
+  }
+
+  /* one byte per row, 0 or 1 */
+  const uint8_t *bools(int x) const {
+    const Column &col = column(x, Data::Type::BOOL);
+    Span &s = spans[x];
+    if (!s.ready) {
+      s.bools.resize(ROW_BATCH_SIZE);
+      for (int i = 0; i < len; i++)
+        s.bools[i] = !col.is_missing(start + i) && col.get_bool(start + i);
+      s.values = s.bools.data();
+      s.ready = true;
+    }
+    return static_cast<const uint8_t *>(s.values);
+  }
+
+  /* empty for missing rows */
+  const string_view *strings(int x) const {
+    const Column &col = column(x, Data::Type::STRING);
+    Span &s = spans[x];
+    if (!s.ready) {
+      s.strings.resize(ROW_BATCH_SIZE);
+      for (int i = 0; i < len; i++)
+        s.strings[i] = col.is_missing(start + i)
+                           ? string_view()
+                           : col.get_string_view(start + i);
+      s.values = s.strings.data();
+      s.ready = true;
+    }
+    return static_cast<const string_view *>(s.values);
+  }
+
+  /**
+   * the missing bitmap of column x for the batch, (length() + 7) / 8 bytes
+   * with bit i % 8 of byte i / 8 set if row i is missing
+   */
+  const uint8_t *missing_bits(int x) const {
+    return columns[x]->missing_bitmap().bytes() + start / 8;
+  }
+  bool is_missing(int i, int x) const {
+    return missing_bits(x)[i / 8] >> (i % 8) & 1;
+  }
+  /**
+   * false if column x is known to have no missing values, so a Rower can
+   * skip checking missing_bits
+   */
+  bool may_have_missing(int x) const {
+    const ZoneMap &zone = columns[x]->zone_map();
+    return !zone.known || zone.null_count > 0;
+  }
+
+  /**
+   * fill row with row i of the batch, from the column spans, for Rowers which
+   * only accept a Row at a time
+   */
+  void fill_row(int i, Row &row) const {
+    assert(row.width() == schema.width());
+    assert(i < len);
+    row.set_idx(first_idx() + i);
+    for (int x = 0; x < schema.width(); x++)
+      fill_cell(i, x, row);
+  }
+
+  /**
+   * fill only the columns in cols of row with row i of the batch, leaving the
+   * other columns of row as they were, see Rower::projection
+   */
+  void fill_row(int i, Row &row, const vector<int> &cols) const {
+    assert(row.width() == schema.width());
+    assert(i < len);
+    row.set_idx(first_idx() + i);
+    for (int x : cols)
+      fill_cell(i, x, row);
+  }
+
+protected:
+  void fill_cell(int i, int x, Row &row) const {
+    if (is_missing(i, x)) {
+      row.set_missing(x);
+      return;
+    }
+    switch (schema.col_type(x)) {
+    case Data::Type::INT:
+      row.set(x, ints(x)[i]);
+      break;
+    case Data::Type::FLOAT:
+      row.set(x, floats(x)[i]);
+      break;
+    case Data::Type::BOOL:
+      row.set(x, (bool)bools(x)[i]);
+      break;
+    case Data::Type::STRING:
+      row.set(x, strings(x)[i]);
+      break;
+    default:
+      assert(false); // unsupported column type
+    }
+  }
+};
@@ -2,10 +2,14 @@
 
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <vector>
 
 using namespace std;
 
 class Row;
+class RowBatch;
+class DataFrameChunk;
 class WriteCursor;
 class ReadCursor;
 
@@ -17,7 +21,7 @@ class ReadCursor;
  */
 class Rower {
 public:
-  enum Type : uint8_t { SUM, WORD_COUNT, SEARCH_INT_INT };
+  enum Type : uint8_t { SUM, WORD_COUNT, SEARCH_INT_INT, FLOAT_STATS };
   virtual ~Rower() {}
   virtual Type get_type() const { assert(false); }
 
@@ -29,6 +33,36 @@ public:
    */
   virtual bool accept(const Row &r) = 0;
 
+  /**
+   * the columns this Rower reads, or nullopt if it may read any. Only these
+   * columns are read from a chunk being mapped, every other column is missing
+   * in the Rows given to accept.
+   */
+  virtual optional<vector<int>> projection() const { return nullopt; }
+
+  /**
+   * called with each chunk of a DataFrame being mapped before any of its rows,
+   * so a Rower can process a whole chunk at once, e.g. aggregating on the
+   * codes of a dictionary-encoded column (see Column::dict_codes). Returns
+   * true if the chunk was handled, then accept isn't called for its rows.
+   */
+  virtual bool accept_chunk(const DataFrameChunk &) { return false; }
+
+  /**
+   * called with each batch of rows of a chunk not handled by accept_chunk, so
+   * a Rower can read typed spans of the columns it needs instead of every cell
+   * of every Row, see RowBatch. Returns true if the batch was handled,
+   * otherwise accept is called for each of its rows.
+   */
+  virtual bool accept_batch(const RowBatch &) { return false; }
+
+  /**
+   * a predicate on the zone maps of a chunk (see DataFrameChunk::zone_map),
+   * true if no row in the chunk can change this Rower's results, in which case
+   * the chunk is skipped without being read at all
+   */
+  virtual bool can_skip(const DataFrameChunk &) const { return false; }
+
   /**
    * join results from the other rower into the results of this Rower
    */
@@ -69,6 +103,9 @@ inline ostream &operator<<(ostream &output, const Rower::Type type) {
   case Rower::Type::SEARCH_INT_INT:
     output << "SEARCH_INT_INT";
     break;
+  case Rower::Type::FLOAT_STATS:
+    output << "FLOAT_STATS";
+    break;
   default:
     output << "<unknown Rower::Type>";
     break;
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "cursor.h"
+#include "dataframe_chunk.h"
+#include "reduce.h"
 #include "row.h"
 #include "rower.h"
 #include <set>
+#include <string_view>
 #include <unordered_map>
 
 using namespace std;
@@ -28,12 +31,32 @@ public:
   SumRower(int col) : col(col), sum_result(0) {}
   SumRower(ReadCursor &c) : SumRower(yield<int>(c)) {}
   Type get_type() const { return Type::SUM; }
+  optional<vector<int>> projection() const { return vector<int>{col}; }
 
   bool accept(const Row &row) {
     sum_result += row.get<int>(col);
     return true;
   }
 
+  /* nothing to add if every value is missing */
+  bool can_skip(const DataFrameChunk &dfc) const {
+    const ZoneMap &zone = dfc.zone_map(col);
+    return zone.known && zone.null_count == dfc.nrows();
+  }
+
+  /**
+   * sum a batch of the column at a time with the SIMD kernel, see Reduce
+   */
+  bool accept_batch(const RowBatch &batch) {
+    IntReduction red;
+    Reduce::ints(batch.ints(col),
+                 batch.may_have_missing(col) ? batch.missing_bits(col)
+                                             : nullptr,
+                 batch.length(), red);
+    sum_result += red.sum;
+    return true;
+  }
+
   void join(const Rower &o) {
     const SumRower &other = dynamic_cast<const SumRower &>(o);
     sum_result += other.sum_result;
@@ -57,6 +80,88 @@ public:
   unique_ptr<Rower> clone() const { return make_unique<SumRower>(col); };
 };
 
+/**
+ * Rower for the sum, count, min and max of the present floats in a column
+ *
+ * Arguments:
+ * - col  int  float column to reduce
+ *
+ * Results:
+ * - get_results()  FloatReduction  sum (as a double), count, min and max of
+ *                                  the present values in the given column
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class FloatStatsRower : public Rower {
+private:
+  int col;
+  FloatReduction results;
+
+public:
+  FloatStatsRower(int col) : col(col) {}
+  FloatStatsRower(ReadCursor &c) : FloatStatsRower(yield<int>(c)) {}
+  Type get_type() const { return Type::FLOAT_STATS; }
+  optional<vector<int>> projection() const { return vector<int>{col}; }
+
+  bool accept(const Row &row) {
+    if (!row.is_missing(col)) {
+      float val = row.get<float>(col);
+      Reduce::floats(&val, nullptr, 1, results);
+    }
+    return true;
+  }
+
+  /* nothing to add if every value is missing */
+  bool can_skip(const DataFrameChunk &dfc) const {
+    const ZoneMap &zone = dfc.zone_map(col);
+    return zone.known && zone.null_count == dfc.nrows();
+  }
+
+  bool accept_batch(const RowBatch &batch) {
+    Reduce::floats(batch.floats(col),
+                   batch.may_have_missing(col) ? batch.missing_bits(col)
+                                               : nullptr,
+                   batch.length(), results);
+    return true;
+  }
+
+  void join(const Rower &o) {
+    const FloatStatsRower &other = dynamic_cast<const FloatStatsRower &>(o);
+    results.join(other.results);
+  }
+
+  void serialize(WriteCursor &c) const {
+    pack(c, get_type());
+    pack(c, col);
+  }
+
+  void serialize_results(WriteCursor &c) const {
+    pack(c, results.sum);
+    pack(c, results.count);
+    pack(c, results.min);
+    pack(c, results.max);
+  }
+
+  void join_serialized(ReadCursor &c) {
+    FloatReduction other;
+    other.sum = yield<double>(c);
+    other.count = yield<int64_t>(c);
+    other.min = yield<float>(c);
+    other.max = yield<float>(c);
+    results.join(other);
+  }
+
+  void out(ostream &output) const {
+    output << "col: " << col << ", sum: " << results.sum
+           << ", count: " << results.count << ", min: " << results.min
+           << ", max: " << results.max;
+  }
+
+  const FloatReduction &get_results() const { return results; }
+
+  unique_ptr<Rower> clone() const { return make_unique<FloatStatsRower>(col); }
+};
+
 /**
  * Rower for counting usages of words in the given column of a DF
  * Arguments:
@@ -74,32 +179,59 @@ class WordCountRower : public Rower {
 private:
   int col;
   unordered_map<string, int> results;
+  /* the counts in results keyed by views of results' own keys, so counting a
+   * word already seen doesn't allocate a string for it */
+  unordered_map<string_view, int *> counts;
+
+  void add(string_view s, int n) {
+    auto it = counts.find(s);
+    if (it == counts.end()) {
+      auto &e = *results.emplace(string(s), 0).first;
+      it = counts.emplace(e.first, &e.second).first;
+    }
+    *it->second += n;
+  }
 
 public:
   WordCountRower(int col) : col(col) {}
   WordCountRower(ReadCursor &c) : WordCountRower(yield<int>(c)) {}
+  WordCountRower(const WordCountRower &) = delete;
   Type get_type() const { return Type::WORD_COUNT; }
+  optional<vector<int>> projection() const { return vector<int>{col}; }
 
   bool accept(const Row &row) {
     /* if missing, skip */
-    if (row.is_missing(col))
-      return true;
-
-    string *s = row.get<string *>(col);
+    if (!row.is_missing(col))
+      add(row.get<string_view>(col), 1);
+    return true;
+  }
 
-    if (s) {
-      results.try_emplace(*s, 0);
-      results.insert_or_assign(*s, results.at(*s) + 1);
+  /**
+   * count a dictionary-encoded column by its codes, looking up each distinct
+   * word once per chunk rather than once per row
+   */
+  bool accept_chunk(const DataFrameChunk &dfc) {
+    const Column &column = dfc.get_column(col);
+    const uint32_t *codes = column.dict_codes();
+    if (!codes)
+      return false;
+
+    vector<int> code_counts(column.dict_size(), 0);
+    for (int y = 0; y < column.length(); y++) {
+      if (!column.is_missing(y))
+        code_counts[codes[y]]++;
+    }
+    for (int i = 0; i < code_counts.size(); i++) {
+      if (code_counts[i])
+        add(column.dict_entry(i), code_counts[i]);
     }
     return true;
   }
 
   void join(const Rower &o) {
     const WordCountRower &other = dynamic_cast<const WordCountRower &>(o);
-    for (auto &e : other.results) {
-      results.try_emplace(e.first, 0);
-      results.insert_or_assign(e.first, results.at(e.first) + e.second);
-    }
+    for (auto &e : other.results)
+      add(e.first, e.second);
   }
 
   void serialize(WriteCursor &c) const {
@@ -118,8 +250,7 @@ public:
     while (has_next(c)) {
       string s = yield<string>(c);
       int i = yield<int>(c);
-      results.try_emplace(s, 0);
-      results.insert_or_assign(s, results.at(s) + i);
+      add(s, i);
     }
   }
 
@@ -169,6 +300,30 @@ public:
       terms.emplace(yield<int>(c));
   }
   Type get_type() const { return Type::SEARCH_INT_INT; }
+  optional<vector<int>> projection() const {
+    return vector<int>{search_col, result_col};
+  }
+
+  /**
+   * skip chunks where no term is between the min and max of search_col, or
+   * where search_col's Bloom filter rules out every term that is
+   */
+  bool can_skip(const DataFrameChunk &dfc) const {
+    const ZoneMap &zone = dfc.zone_map(search_col);
+    auto begin = terms.begin(), end = terms.end();
+    if (zone.known) {
+      if (zone.min > zone.max)
+        return true; // no present values to match
+      begin = terms.lower_bound((int)zone.min);
+      end = terms.upper_bound((int)zone.max);
+    }
+    const BloomFilter &bloom = dfc.bloom_filter(search_col);
+    for (auto it = begin; it != end; it++) {
+      if (bloom.may_contain(*it))
+        return false;
+    }
+    return true;
+  }
 
   bool accept(const Row &row) {
     int val = row.get<int>(search_col);
@@ -179,6 +334,24 @@ public:
     return true;
   }
 
+  /**
+   * probe a batch of search_col at a time, reading result_col only for the
+   * rows which match
+   */
+  bool accept_batch(const RowBatch &batch) {
+    const int *search = batch.ints(search_col);
+    const int *results = nullptr;
+    for (int i = 0; i < batch.length(); i++) {
+      if (batch.is_missing(i, search_col) || !has_term(search[i]) ||
+          batch.is_missing(i, result_col))
+        continue;
+      if (!results)
+        results = batch.ints(result_col);
+      new_results.emplace(results[i]);
+    }
+    return true;
+  }
+
   void join(const Rower &o) {
     const SearchIntIntRower &other = dynamic_cast<const SearchIntIntRower &>(o);
     new_results.insert(other.new_results.begin(), other.new_results.end());
@@ -239,6 +412,8 @@ inline unique_ptr<Rower> unpack_rower(ReadCursor &c) {
     return make_unique<WordCountRower>(c);
   case Rower::Type::SEARCH_INT_INT:
     return make_unique<SearchIntIntRower>(c);
+  case Rower::Type::FLOAT_STATS:
+    return make_unique<FloatStatsRower>(c);
   default:
     assert(false); // unsupported Rower::Type
   }
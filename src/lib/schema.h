@@ -58,6 +58,19 @@ public:
     types[i] = type;
   }
 
+  /**
+   * combine the types of the other Schema into this one with Data::combine,
+   * adding any columns this Schema does not have yet
+   */
+  void combine(const Schema &other) {
+    for (int i = 0; i < other.width(); i++) {
+      if (i < width())
+        types[i] = Data::combine(types[i], other.col_type(i));
+      else
+        types.push_back(other.col_type(i));
+    }
+  }
+
   /**
    * Return type of column at idx. An idx >= width is undefined behavior.
    */
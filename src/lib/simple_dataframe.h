@@ -60,7 +60,7 @@ protected:
           row.set(i, col.get_bool(idx));
           break;
         case Data::Type::STRING:
-          row.set(i, col.get_string(idx));
+          row.set(i, col.get_string_view(idx));
           break;
         case Data::Type::MISSING:
           row.set_missing(i);
@@ -130,7 +130,8 @@ public:
           col.push(row.get<float>(i));
           break;
         case Data::Type::STRING:
-          col.push(row.get<string *>(i));
+          static_cast<TypedColumn<string *> &>(col).append(
+              row.get<string_view>(i));
           break;
         case Data::Type::MISSING:
           col.push();
@@ -193,10 +194,10 @@ public:
     assert(x >= 0);
     return columns[x]->get_bool(y);
   }
-  virtual string *get_string(int y, int x) const {
+  virtual string_view get_string_view(int y, int x) const {
     assert(x < ncols());
     assert(x >= 0);
-    return columns[x]->get_string(y);
+    return columns[x]->get_string_view(y);
   }
   virtual bool is_missing(int y, int x) const {
     assert(x < ncols());
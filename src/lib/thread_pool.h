@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <inttypes.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A pool of long-lived worker threads which run jobs of many small tasks,
+ * e.g. mapping a Rower over each chunk of a PartialDataFrame, so a job doesn't
+ * pay to start threads.
+ *
+ * run blocks until every task of the job is done, with the calling thread
+ * working on the job too. Each of the slots() threads working on a job (the
+ * workers and the caller) starts with a contiguous range of its tasks and
+ * takes them from the front. A thread which runs out steals the back half of
+ * the remaining range of another, so a job takes as long as its total work
+ * split evenly, not as long as the slowest starting range. Several jobs can
+ * run at once, e.g. from concurrent commands, workers help with the oldest.
+ *
+ * shared() is the pool for the whole process, e.g. a KV node, sized by
+ * set_shared_threads before it is first used.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class ThreadPool {
+public:
+  /* run the task with the given index, on the thread working as the slot */
+  typedef function<void(int task, int slot)> task_fn_t;
+
+protected:
+  /**
+   * the tasks of one call to run. ranges[s] holds the [begin, end) of the
+   * tasks left to slot s, packed into one word so it can be claimed from and
+   * stolen from with a single compare and swap.
+   */
+  struct Job {
+    const task_fn_t &fn;
+    int n_tasks;
+    int n_slots;
+    unique_ptr<atomic<uint64_t>[]> ranges;
+    atomic<int> done{0};
+    mutex done_mtx;
+    condition_variable done_cv;
+
+    Job(const task_fn_t &fn, int n_tasks, int n_slots)
+        : fn(fn), n_tasks(n_tasks), n_slots(n_slots),
+          ranges(new atomic<uint64_t>[n_slots]) {
+      for (int s = 0; s < n_slots; s++) {
+        uint32_t begin = (int64_t)n_tasks * s / n_slots;
+        uint32_t end = (int64_t)n_tasks * (s + 1) / n_slots;
+        ranges[s] = pack_range(begin, end);
+      }
+    }
+
+    static uint64_t pack_range(uint32_t begin, uint32_t end) {
+      return (uint64_t)end << 32 | begin;
+    }
+
+    /* the next task of slot's own range, or -1 if it is empty */
+    int claim(int slot) {
+      uint64_t r = ranges[slot].load();
+      while (true) {
+        uint32_t begin = r, end = r >> 32;
+        if (begin >= end)
+          return -1;
+        if (ranges[slot].compare_exchange_weak(r, pack_range(begin + 1, end)))
+          return begin;
+      }
+    }
+
+    /* move the back half of another slot's range to slot's, false if every
+     * range is empty */
+    bool steal(int slot) {
+      for (int i = 1; i < n_slots; i++) {
+        int victim = (slot + i) % n_slots;
+        uint64_t r = ranges[victim].load();
+        while (true) {
+          uint32_t begin = r, end = r >> 32;
+          if (begin >= end)
+            break;
+          uint32_t mid = end - max((end - begin) / 2, 1u);
+          if (ranges[victim].compare_exchange_weak(r, pack_range(begin, mid))) {
+            ranges[slot] = pack_range(mid, end);
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+
+    /* run tasks as slot until there are none left to claim or steal */
+    void work(int slot) {
+      while (true) {
+        int task = claim(slot);
+        if (task < 0) {
+          if (!steal(slot))
+            return;
+          continue;
+        }
+        fn(task, slot);
+        if (done.fetch_add(1) + 1 == n_tasks) {
+          lock_guard<mutex> lock(done_mtx);
+          done_cv.notify_all();
+        }
+      }
+    }
+  };
+
+  vector<thread> workers;
+  mutex mtx;
+  condition_variable cv;
+  list<shared_ptr<Job>> jobs; // jobs which may have tasks left, oldest first
+  bool stopping = false;
+
+  void worker_loop(int slot) {
+    while (true) {
+      shared_ptr<Job> job;
+      {
+        unique_lock<mutex> lock(mtx);
+        cv.wait(lock, [&]() { return stopping || !jobs.empty(); });
+        if (stopping)
+          return;
+        job = jobs.front();
+      }
+      job->work(slot);
+      /* nothing left to claim, stop offering the job to workers */
+      lock_guard<mutex> lock(mtx);
+      jobs.remove(job);
+    }
+  }
+
+  static int &shared_threads() {
+    static int n = 0;
+    return n;
+  }
+
+public:
+  /**
+   * a pool which runs jobs on n_threads threads, n_threads - 1 workers and the
+   * thread calling run
+   */
+  ThreadPool(int n_threads) {
+    assert(n_threads > 0);
+    for (int i = 0; i < n_threads - 1; i++)
+      workers.emplace_back([this, i]() { worker_loop(i); });
+  }
+  ThreadPool(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      lock_guard<mutex> lock(mtx);
+      stopping = true;
+    }
+    cv.notify_all();
+    for (thread &t : workers)
+      t.join();
+  }
+
+  /**
+   * the number of threads which work on a job, the slot passed to a task is
+   * less than this
+   */
+  int slots() const { return workers.size() + 1; }
+
+  /**
+   * run fn on every task in [0, n_tasks) and return once they are all done.
+   * Within a job each slot is one thread, so a task can use per-slot state of
+   * the job without locking.
+   */
+  void run(int n_tasks, const task_fn_t &fn) {
+    if (n_tasks <= 0)
+      return;
+    auto job = make_shared<Job>(fn, n_tasks, slots());
+    if (slots() > 1 && n_tasks > 1) {
+      lock_guard<mutex> lock(mtx);
+      jobs.push_back(job);
+      cv.notify_all();
+    }
+    job->work(slots() - 1);
+    {
+      unique_lock<mutex> lock(job->done_mtx);
+      job->done_cv.wait(lock, [&]() { return job->done == n_tasks; });
+    }
+    lock_guard<mutex> lock(mtx);
+    jobs.remove(job);
+  }
+
+  /**
+   * size the shared pool, before it is first used, defaults to the number of
+   * hardware threads
+   */
+  static void set_shared_threads(int n_threads) {
+    assert(n_threads > 0);
+    shared_threads() = n_threads;
+  }
+
+  static ThreadPool &shared() {
+    static ThreadPool pool(shared_threads() > 0
+                               ? shared_threads()
+                               : max((int)thread::hardware_concurrency(), 1));
+    return pool;
+  }
+};
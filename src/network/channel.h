@@ -0,0 +1,203 @@
+#pragma once
+
+#include "packet.h"
+#include "sock.h"
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+using namespace std;
+
+/**
+ * A long-lived connection to one Node, shared by every thread sending requests
+ * to it. Each request gets an id in its header which the Node echoes in its
+ * response, so several requests can be in flight at once on the one socket: a
+ * reader thread matches each response to the request waiting for it, in
+ * whatever order the Node responds.
+ *
+ * authors: @grahamwren @jagen31
+ */
+class Channel {
+protected:
+  /* a request waiting for its response */
+  struct Waiter {
+    optional<Packet> resp;
+    bool done = false;
+    condition_variable cv;
+  };
+
+  const IpV4Addr addr;
+  DataSock sock;
+  mutex send_mtx; // one Packet on the socket at a time
+  mutex mtx;      // guards everything below
+  unordered_map<uint32_t, Waiter *> waiting;
+  uint32_t next_id = 1;
+  bool broken = false;
+  thread reader;
+
+  /* fail every waiting request, called with mtx held */
+  void break_channel() {
+    broken = true;
+    for (auto &e : waiting) {
+      e.second->done = true;
+      e.second->cv.notify_one();
+    }
+    waiting.clear();
+  }
+
+  void read_loop() {
+    while (true) {
+      optional<Packet> pkt = sock.recv_pkt();
+      lock_guard lock(mtx);
+      if (!pkt) {
+        break_channel();
+        return;
+      }
+      auto it = waiting.find(pkt->hdr.req_id);
+      if (it == waiting.end()) {
+        cout << "ERROR: unexpected response " << pkt->hdr.req_id << " from "
+             << addr << endl;
+        continue;
+      }
+      Waiter &w = *it->second;
+      waiting.erase(it);
+      w.resp.emplace(move(*pkt));
+      w.done = true;
+      w.cv.notify_one();
+    }
+  }
+
+public:
+  Channel(const IpV4Addr &a) : addr(a), sock(addr) {}
+  Channel(const Channel &) = delete;
+  ~Channel() {
+    if (reader.joinable()) {
+      sock.shutdown();
+      reader.join();
+    }
+  }
+
+  /**
+   * open the connection, false if the Node can't be reached
+   */
+  bool connect() {
+    if (sock.connect() < 0)
+      return false;
+    reader = thread([this]() { read_loop(); });
+    return true;
+  }
+
+  /* whether the connection failed, e.g. the Node closed it */
+  bool is_broken() {
+    lock_guard lock(mtx);
+    return broken || sock.peer_closed();
+  }
+
+  /**
+   * send req and wait for its response, nullopt if the connection broke first.
+   * sent is set to whether req made it onto the connection, if not it is safe
+   * to retry on a new one.
+   */
+  optional<Packet> fetch(const Packet &req, bool &sent) {
+    sent = false;
+    Waiter w;
+    uint32_t id;
+    {
+      lock_guard lock(mtx);
+      if (broken)
+        return nullopt;
+      id = next_id++;
+      waiting.emplace(id, &w);
+    }
+
+    Packet pkt(req.hdr.src_addr, req.hdr.dst_addr, req.hdr.type, req.data, id);
+    int sres;
+    {
+      lock_guard lock(send_mtx);
+      sres = sock.send_pkt(pkt);
+    }
+
+    unique_lock lock(mtx);
+    if (sres == -1) {
+      /* at most part of pkt was sent, which the Node can't have handled */
+      waiting.erase(id);
+      break_channel();
+      sock.shutdown(); // stop the reader too
+      return nullopt;
+    }
+    sent = true;
+    w.cv.wait(lock, [&]() { return w.done; });
+    return move(w.resp);
+  }
+};
+
+/**
+ * The Channels of this process, one per Node, opened on first use and reopened
+ * once broken, e.g. after the Node restarted.
+ *
+ * authors: @grahamwren @jagen31
+ */
+class ChannelPool {
+protected:
+  /* the Channel to one Node, its lock is held while (re)connecting */
+  struct Slot {
+    mutex mtx;
+    shared_ptr<Channel> ch;
+  };
+
+  mutex mtx; // guards slots, not the Slots
+  unordered_map<uint32_t, shared_ptr<Slot>> slots;
+
+  shared_ptr<Channel> get(const IpV4Addr &a) {
+    shared_ptr<Slot> slot;
+    {
+      lock_guard lock(mtx);
+      shared_ptr<Slot> &s = slots[a];
+      if (!s)
+        s = make_shared<Slot>();
+      slot = s;
+    }
+    /* connect outside the pool's lock, so only requests to this Node wait */
+    lock_guard lock(slot->mtx);
+    if (!slot->ch || slot->ch->is_broken()) {
+      auto ch = make_shared<Channel>(a);
+      if (!ch->connect()) {
+        slot->ch = nullptr;
+        return nullptr;
+      }
+      slot->ch = move(ch);
+    }
+    return slot->ch;
+  }
+
+public:
+  /**
+   * send pkt to its destination on the pooled connection and wait for the
+   * response. Retries once on a new connection if the pooled one had broken
+   * before pkt was sent. Returns an ERR Packet if the Node can't be reached.
+   */
+  Packet fetch(const Packet &pkt) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+      shared_ptr<Channel> ch = get(pkt.hdr.dst_addr);
+      if (!ch)
+        break;
+      bool sent;
+      optional<Packet> resp = ch->fetch(pkt, sent);
+      if (resp)
+        return move(*resp);
+      if (sent)
+        break;
+    }
+    cout << "ERROR: failed to fetch from " << pkt.hdr.dst_addr << endl;
+    return Packet(pkt.hdr.dst_addr, pkt.hdr.src_addr, PacketType::ERR);
+  }
+
+  static ChannelPool &shared() {
+    static ChannelPool pool;
+    return pool;
+  }
+};
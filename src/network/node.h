@@ -3,14 +3,26 @@
 #include "kv/command.h"
 #include "lib/cursor.h"
 #include "lib/sized_ptr.h"
+#include "channel.h"
 #include "packet.h"
 #include "sock.h"
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <shared_mutex>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
@@ -18,8 +30,27 @@ using namespace std;
 #define NODE_LOG false
 #endif
 
+#ifndef NODE_WORKERS
+#define NODE_WORKERS 0 // threads handling packets, 0 for one per core
+#endif
+
+#ifndef NODE_MAX_EVENTS
+#define NODE_MAX_EVENTS 64 // epoll events handled per wakeup
+#endif
+
 /**
  * a class which handles network communication
+ *
+ * start runs an event loop on the calling thread: it waits with epoll on the
+ * listening socket and every open connection, all non-blocking, accepting new
+ * connections and reading Packets as bytes arrive. Each complete Packet is
+ * handed to a pool of worker threads, which handle it and respond, so many
+ * connections are served in parallel and a slow request doesn't hold up the
+ * others. Connections are long-lived (see Channel) and the event loop keeps
+ * reading a connection while its earlier Packets are handled, so a client can
+ * have many requests in flight on one connection. Responses carry the req_id
+ * of their request and may be sent in any order.
+ *
  * authors: @grahamwren @jagen31
  */
 class Node {
@@ -44,66 +75,148 @@ public:
       handler_fn_t;
 
 protected:
-  bool should_continue;
+  /* an accepted connection and the Packet being read from it */
+  struct Connection {
+    DataSock sock;
+    mutex send_mtx; // one response on the socket at a time
+    alignas(PacketHeader) uint8_t hdr_buf[sizeof(PacketHeader)];
+    int hdr_read = 0;
+    shared_ptr<uint8_t> data;
+    int data_read = 0;
+
+    Connection(int fd, const IpV4Addr &a) : sock(fd, a) {}
+
+    /* send the response to req, with req's id */
+    void respond(const IpV4Addr &src, const Packet &req, PacketType type,
+                 const DataChunk &data = DataChunk()) {
+      Packet resp(src, req.hdr.src_addr, type, data, req.hdr.req_id);
+      lock_guard lock(send_mtx);
+      sock.send_pkt(resp);
+    }
+
+    /**
+     * read what is available without blocking, sets pkt once a whole Packet
+     * has been read. Returns false if the connection is closed or broken.
+     */
+    bool read(optional<Packet> &pkt) {
+      while (true) {
+        bool in_hdr = hdr_read < (int)sizeof(PacketHeader);
+        PacketHeader *hdr = (PacketHeader *)hdr_buf;
+        uint8_t *dst = in_hdr ? hdr_buf + hdr_read : data.get() + data_read;
+        int want = in_hdr ? sizeof(PacketHeader) - hdr_read
+                          : hdr->data_len() - data_read;
+        int rres = recv(sock.fd(), dst, want, 0);
+        if (rres == 0)
+          return false; // closed
+        if (rres == -1) {
+          if (errno == EINTR)
+            continue;
+          return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        if (in_hdr) {
+          hdr_read += rres;
+          if (hdr_read < (int)sizeof(PacketHeader))
+            continue;
+          /* whole header, drop the connection if it's garbage */
+          if (!PacketHeader::parse(hdr_buf) ||
+              hdr->pkt_len < sizeof(PacketHeader))
+            return false;
+          if (SOCK_LOG)
+            cout << "DataSock.recv_hdr(hdr: " << *hdr << ")" << endl;
+          if (hdr->data_len() > 0) {
+            data = shared_ptr<uint8_t>(new uint8_t[hdr->data_len()],
+                                       [](uint8_t *ptr) { delete[] ptr; });
+            continue;
+          }
+        } else {
+          data_read += rres;
+          if (data_read < hdr->data_len())
+            continue;
+        }
+
+        /* whole Packet, reset for the next */
+        if (hdr->data_len() > 0)
+          pkt.emplace(*hdr, data);
+        else
+          pkt.emplace(*hdr);
+        hdr_read = 0;
+        data.reset();
+        data_read = 0;
+        return true;
+      }
+    }
+  };
+
+  atomic<bool> should_continue;
   const IpV4Addr my_addr;
   ListenSock listen_s;
   set<IpV4Addr> peers;
+  mutable mutex peers_mtx;
   handler_fn_t data_handler;
 
-  void handle_pkt(const DataSock &sock, const Packet &pkt) {
+  int epoll_fd = -1;
+  int wake_fd = -1; // written to wake the event loop, e.g. to stop it
+  /* only touched by the event loop, workers share a connection while they
+   * respond on it */
+  unordered_map<int, shared_ptr<Connection>> connections;
+
+  /* Packets read by the event loop, waiting for a worker */
+  vector<thread> workers;
+  deque<pair<shared_ptr<Connection>, Packet>> pending;
+  mutex pending_mtx;
+  condition_variable pending_cv;
+  bool stopping = false; // guarded by pending_mtx
+
+  void handle_pkt(Connection &conn, const Packet &pkt) {
     switch (pkt.hdr.type) {
     case PacketType::REGISTER:
-      handle_register_pkt(sock, pkt);
+      handle_register_pkt(conn, pkt);
       break;
     case PacketType::NEW_PEER:
-      handle_new_peer_pkt(sock, pkt);
+      handle_new_peer_pkt(conn, pkt);
       break;
     case PacketType::DATA:
-      handle_data_pkt(sock, pkt);
+      handle_data_pkt(conn, pkt);
       break;
     case PacketType::GET_PEERS:
-      handle_get_peers_pkt(sock, pkt);
+      handle_get_peers_pkt(conn, pkt);
       break;
     case PacketType::SHUTDOWN:
-      handle_shutdown_pkt(sock, pkt);
+      handle_shutdown_pkt(conn, pkt);
       break;
     default:
       assert(false); // fail if missing type
     }
   }
 
-  void handle_get_peers_pkt(const DataSock &sock, const Packet &req) {
-    const IpV4Addr &src = req.hdr.src_addr;
-    const int n_peers = peers.size();
-    IpV4Addr ips[n_peers];
-    int i = 0;
-    for (auto peer : peers) {
-      ips[i++] = peer;
-    }
+  vector<IpV4Addr> get_peers() const {
+    lock_guard lock(peers_mtx);
+    return vector<IpV4Addr>(peers.begin(), peers.end());
+  }
+
+  void handle_get_peers_pkt(Connection &conn, const Packet &req) {
+    vector<IpV4Addr> ips = get_peers();
 
-    sized_ptr<uint8_t> resp_d(sizeof(IpV4Addr) * n_peers, (uint8_t *)ips);
-    Packet resp(my_addr, src, PacketType::OK, resp_d);
-    sock.send_pkt(resp);
+    sized_ptr<uint8_t> resp_d(sizeof(IpV4Addr) * ips.size(),
+                              (uint8_t *)ips.data());
+    conn.respond(my_addr, req, PacketType::OK, resp_d);
   }
 
-  void handle_register_pkt(const DataSock &sock, const Packet &req) {
+  void handle_register_pkt(Connection &conn, const Packet &req) {
     const IpV4Addr &src = req.hdr.src_addr;
-    const int n_peers = peers.size();
-    IpV4Addr ips[n_peers];
-    int i = 0;
-    for (auto peer : peers) {
-      ips[i++] = peer;
-    }
-
-    sized_ptr<uint8_t> resp_d(sizeof(IpV4Addr) * n_peers, (uint8_t *)ips);
-    Packet resp(my_addr, src, PacketType::OK, resp_d);
-    sock.send_pkt(resp);
+    vector<IpV4Addr> ips = get_peers();
 
-    bool seen_peer = src == my_addr || peers.find(src) != peers.end();
-    if (seen_peer)
-      return;
+    sized_ptr<uint8_t> resp_d(sizeof(IpV4Addr) * ips.size(),
+                              (uint8_t *)ips.data());
+    conn.respond(my_addr, req, PacketType::OK, resp_d);
 
-    peers.emplace(src);
+    {
+      lock_guard lock(peers_mtx);
+      bool seen_peer = src == my_addr || !peers.emplace(src).second;
+      if (seen_peer)
+        return;
+    }
 
     if (NODE_LOG) {
       cout << "New peer(" << src << ") ";
@@ -111,56 +224,48 @@ protected:
     }
 
     /* notify peers of new peer */
-    for (IpV4Addr peer : peers) {
+    for (IpV4Addr peer : get_peers()) {
       if (peer != my_addr && peer != src) {
         sized_ptr<uint8_t> d(sizeof(IpV4Addr), (uint8_t *)&src);
         Packet pkt(my_addr, peer, PacketType::NEW_PEER, d);
-        const Packet resp = DataSock::fetch(pkt);
+        const Packet resp = ChannelPool::shared().fetch(pkt);
         assert(resp.ok());
       }
     }
   }
 
-  void handle_new_peer_pkt(const DataSock &sock, const Packet &req) {
+  void handle_new_peer_pkt(Connection &conn, const Packet &req) {
     /* assume data is an IpV4Addr */
     assert(req.data.ptr());
     assert(req.hdr.data_len() == sizeof(IpV4Addr));
 
-    Packet resp(my_addr, req.hdr.src_addr, PacketType::OK);
-    sock.send_pkt(resp);
+    conn.respond(my_addr, req, PacketType::OK);
 
     const IpV4Addr &a = *(IpV4Addr *)req.data.ptr().get();
     /* if my_addr then ignore */
     if (a == my_addr)
       return;
 
-    auto it = peers.find(a);
-    /* if not found in peers list */
-    if (it == peers.end()) {
-      /* add peer */
-      peers.emplace(a);
+    unique_lock lock(peers_mtx);
+    /* add peer if not found in peers list */
+    if (peers.emplace(a).second) {
+      lock.unlock();
       print_peers();
     } else {
       cout << "ERROR: already seen peer " << a << endl;
     }
   }
 
-  void handle_shutdown_pkt(const DataSock &sock, const Packet &req) {
-    Packet ok_resp(my_addr, req.hdr.src_addr, PacketType::OK);
-    sock.send_pkt(ok_resp);
+  void handle_shutdown_pkt(Connection &conn, const Packet &req) {
+    conn.respond(my_addr, req, PacketType::OK);
     should_continue = false;
+    wake();
   }
 
-  void handle_data_pkt(const DataSock &sock, const Packet &req) const {
-    ReadCursor rc(req.data.data());
+  void handle_data_pkt(Connection &conn, const Packet &req) const {
+    ReadCursor rc = req.data.cursor();
     respond_fn_t resp_fn = {[&](bool res, const DataChunk &data) {
-      if (res) {
-        Packet ok_resp(my_addr, req.hdr.src_addr, PacketType::OK, data);
-        sock.send_pkt(ok_resp);
-      } else {
-        Packet err_resp(my_addr, req.hdr.src_addr, PacketType::ERR, data);
-        sock.send_pkt(err_resp);
-      }
+      conn.respond(my_addr, req, res ? PacketType::OK : PacketType::ERR, data);
     }};
     data_handler(req.hdr.src_addr, rc, resp_fn);
     assert(resp_fn.called);
@@ -172,7 +277,7 @@ protected:
 
     /* try to register with server */
     Packet req(my_addr, server_a, PacketType::REGISTER);
-    const Packet resp = DataSock::fetch(req);
+    const Packet resp = ChannelPool::shared().fetch(req);
     if (NODE_LOG)
       cout << "Node.recv(" << resp << ")" << endl;
 
@@ -187,6 +292,7 @@ protected:
   void print_peers() const {
     if (!NODE_LOG)
       return;
+    lock_guard lock(peers_mtx);
     cout << "Peers[";
     auto it = peers.begin();
     if (it != peers.end())
@@ -197,6 +303,86 @@ protected:
     cout << ']' << endl;
   }
 
+  /* wake the event loop from another thread, e.g. a worker */
+  void wake() const {
+    uint64_t one = 1;
+    if (wake_fd != -1)
+      write(wake_fd, &one, sizeof(one));
+  }
+
+  void accept_connections() {
+    int fd;
+    while ((fd = listen_s.accept_nonblocking()) != -1) {
+      auto conn = make_shared<Connection>(fd, my_addr);
+      conn->sock.set_nodelay();
+      struct epoll_event ev = {};
+      ev.events = EPOLLIN | EPOLLRDHUP;
+      ev.data.ptr = conn.get();
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+      connections.emplace(fd, move(conn));
+    }
+  }
+
+  void close_connection(Connection *conn) {
+    int fd = conn->sock.fd();
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    connections.erase(fd);
+  }
+
+  /* read from conn, handing each whole Packet to the workers */
+  void read_connection(Connection *conn) {
+    while (true) {
+      optional<Packet> pkt;
+      if (!conn->read(pkt)) {
+        close_connection(conn);
+        return;
+      }
+      if (!pkt)
+        return; // wait for more
+      if (NODE_LOG)
+        cout << "Node.asyncRecv(" << *pkt << ")" << endl;
+      {
+        lock_guard lock(pending_mtx);
+        pending.emplace_back(connections.at(conn->sock.fd()), move(*pkt));
+      }
+      pending_cv.notify_one();
+    }
+  }
+
+  void worker_loop() {
+    while (true) {
+      unique_lock lock(pending_mtx);
+      pending_cv.wait(lock, [&]() { return stopping || !pending.empty(); });
+      if (stopping)
+        return;
+      shared_ptr<Connection> conn = move(pending.front().first);
+      Packet pkt = move(pending.front().second);
+      pending.pop_front();
+      lock.unlock();
+
+      handle_pkt(*conn, pkt);
+    }
+  }
+
+  void start_workers() {
+    int n_workers = NODE_WORKERS > 0
+                        ? NODE_WORKERS
+                        : max((int)thread::hardware_concurrency(), 2);
+    for (int i = 0; i < n_workers; i++)
+      workers.emplace_back([this]() { worker_loop(); });
+  }
+
+  void stop_workers() {
+    {
+      lock_guard lock(pending_mtx);
+      stopping = true;
+    }
+    pending_cv.notify_all();
+    for (thread &t : workers)
+      t.join();
+    workers.clear();
+  }
+
 public:
   Node(const IpV4Addr &a)
       : should_continue(true), my_addr(a), listen_s(a),
@@ -213,15 +399,49 @@ public:
 
   const IpV4Addr &addr() const { return my_addr; }
 
+  /**
+   * serve Packets until a SHUTDOWN Packet is received, see the class comment
+   */
   void start() {
+    listen_s.set_nonblocking();
+    epoll_fd = epoll_create1(0);
+    assert(epoll_fd != -1);
+    wake_fd = eventfd(0, EFD_NONBLOCK);
+    assert(wake_fd != -1);
+
+    /* the listening socket and wake_fd are told apart by data.ptr */
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listen_s;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_s.fd(), &ev);
+    ev.data.ptr = &wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+    start_workers();
+    struct epoll_event events[NODE_MAX_EVENTS];
     while (should_continue) {
       if (NODE_LOG)
         cout << "waiting for packet..." << endl;
-      const DataSock ds = listen_s.accept_connection();
-      const Packet pkt = ds.get_pkt();
-      if (NODE_LOG)
-        cout << "Node.asyncRecv(" << pkt << ")" << endl;
-      handle_pkt(ds, pkt);
+      int n = epoll_wait(epoll_fd, events, NODE_MAX_EVENTS, -1);
+      for (int i = 0; i < n && should_continue; i++) {
+        void *ptr = events[i].data.ptr;
+        if (ptr == &listen_s) {
+          accept_connections();
+        } else if (ptr == &wake_fd) {
+          uint64_t n;
+          read(wake_fd, &n, sizeof(n));
+        } else {
+          read_connection(static_cast<Connection *>(ptr));
+        }
+      }
     }
+    stop_workers();
+
+    pending.clear();
+    connections.clear();
+    ::close(wake_fd);
+    wake_fd = -1;
+    ::close(epoll_fd);
+    epoll_fd = -1;
   }
 };
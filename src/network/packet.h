@@ -85,16 +85,23 @@ public:
   unsigned int hdr_checksum;  // 4 bytes  │
   const IpV4Addr src_addr;    // 4 bytes  │
   const IpV4Addr dst_addr;    // 4 bytes  │
-  const PacketType type;      // 4 bytes ─┴─ 20 bytes
+  const PacketType type;      // 4 bytes  │
+  const uint32_t req_id;      // 4 bytes ─┴─ 24 bytes
 
-  PacketHeader(IpV4Addr src, IpV4Addr dst, int packet_len, PacketType t)
-      : pkt_len(packet_len), src_addr(src), dst_addr(dst), type(t) {
+  /**
+   * req_id tells apart requests in flight on one connection, a response
+   * carries the id of its request, see Channel
+   */
+  PacketHeader(IpV4Addr src, IpV4Addr dst, int packet_len, PacketType t,
+               uint32_t req_id = 0)
+      : pkt_len(packet_len), src_addr(src), dst_addr(dst), type(t),
+        req_id(req_id) {
     /* packet must be at least header sized */
     assert(packet_len >= sizeof(PacketHeader));
     hdr_checksum = this->compute_checksum();
   }
   PacketHeader(const PacketHeader &h)
-      : PacketHeader(h.src_addr, h.dst_addr, h.pkt_len, h.type) {}
+      : PacketHeader(h.src_addr, h.dst_addr, h.pkt_len, h.type, h.req_id) {}
 
   /**
    * reinterprets the passed in input into a PacketHeader
@@ -116,7 +123,7 @@ public:
   unsigned int compute_checksum() const {
     size_t result = 0;
     const unsigned int *raw_pkt = (const unsigned int *)this;
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < sizeof(PacketHeader) / sizeof(unsigned int); i++) {
       if (i == 1) // skip current checksum
         continue;
 
@@ -132,7 +139,7 @@ public:
   int data_len() const { return pkt_len - sizeof(PacketHeader); }
 };
 
-static_assert(sizeof(PacketHeader) == 20, "PacketHeader was incorrect size");
+static_assert(sizeof(PacketHeader) == 24, "PacketHeader was incorrect size");
 
 /**
  * Packet: represents a packet which is received over a socket or which can be
@@ -150,10 +157,12 @@ public:
       : hdr(h), data(hdr.data_len(), src_data) {}
 
   // build to send
-  Packet(IpV4Addr src, IpV4Addr dst, PacketType type)
-      : hdr(src, dst, sizeof(PacketHeader), type) {}
-  Packet(IpV4Addr src, IpV4Addr dst, PacketType type, const DataChunk &data)
-      : hdr(src, dst, data.len() + sizeof(PacketHeader), type), data(data) {}
+  Packet(IpV4Addr src, IpV4Addr dst, PacketType type, uint32_t req_id = 0)
+      : hdr(src, dst, sizeof(PacketHeader), type, req_id) {}
+  Packet(IpV4Addr src, IpV4Addr dst, PacketType type, const DataChunk &data,
+         uint32_t req_id = 0)
+      : hdr(src, dst, data.len() + sizeof(PacketHeader), type, req_id),
+        data(data) {}
 
   bool ok() const { return hdr.type == PacketType::OK; }
   bool error() const { return hdr.type == PacketType::ERR; }
@@ -197,7 +206,8 @@ ostream &operator<<(ostream &output, const PacketType type) {
 ostream &operator<<(ostream &output, const PacketHeader &hdr) {
   output << "PacketHeader<" << (void *)&hdr << ">(pkt_len: " << hdr.pkt_len
          << ", hdr_checksum: " << hdr.hdr_checksum << ", src: " << hdr.src_addr
-         << ", dst: " << hdr.dst_addr << ", type: " << hdr.type << ")";
+         << ", dst: " << hdr.dst_addr << ", type: " << hdr.type
+         << ", req_id: " << hdr.req_id << ")";
   return output;
 }
 
@@ -3,11 +3,17 @@
 #include "packet.h"
 #include <algorithm>
 #include <arpa/inet.h>
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
 #include <iostream>
 #include <netdb.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 using namespace std;
@@ -20,10 +26,6 @@ using namespace std;
 #define SOCK_LOG false
 #endif
 
-#ifndef MAX_DATA_SIZE
-#define MAX_DATA_SIZE 32768
-#endif
-
 /**
  * a class to encapsulate a socket handle
  * authors: @grahamwren @jagen31
@@ -45,6 +47,28 @@ public:
     address.sin_port = htons(PROTO_PORT);
     return address;
   }
+  int fd() const { return sock_fd; }
+
+  /**
+   * send each Packet as soon as it's written instead of waiting to coalesce
+   * it with the next, a Packet is already one write
+   */
+  void set_nodelay() const {
+    int one = 1;
+    setsockopt(sock_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+
+  /**
+   * make reads and writes on this socket return instead of blocking, see
+   * send_iov for writing to one anyway
+   */
+  void set_nonblocking() const {
+    int flags = fcntl(sock_fd, F_GETFL, 0);
+    assert(flags != -1);
+    int fres = fcntl(sock_fd, F_SETFL, flags | O_NONBLOCK);
+    assert(fres != -1);
+  }
+
   int close() {
     int cres = -1;
     if (sock_fd > 0) {
@@ -68,6 +92,7 @@ public:
     /* create socket */
     sock_fd = socket(AF_INET, SOCK_STREAM, 0);
     assert(sock_fd != -1);
+    set_nodelay();
 
     /* create and setup sockaddr */
     struct sockaddr_in address = get_addr(addr);
@@ -84,44 +109,74 @@ public:
   }
 
   /**
-   * send a Packet over this DataSock
+   * send every byte of the n_iov buffers of iov in as few sendmsg calls as
+   * the socket allows, waiting for it to be writable if it is non-blocking.
+   * iov is advanced past what was sent. Returns -1 if the connection failed.
+   */
+  int send_iov(struct iovec *iov, int n_iov) const {
+    int sent_bytes = 0;
+    while (n_iov > 0) {
+      struct msghdr msg = {};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = n_iov;
+      int sres = sendmsg(sock_fd, &msg, MSG_NOSIGNAL);
+      if (sres == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          struct pollfd pfd = {sock_fd, POLLOUT, 0};
+          poll(&pfd, 1, -1);
+          continue;
+        } else if (errno == EINTR) {
+          continue;
+        }
+        return -1; // failed
+      }
+      sent_bytes += sres;
+
+      /* skip the buffers sent, and the sent part of the next */
+      while (n_iov > 0 && sres >= (int)iov->iov_len) {
+        sres -= iov->iov_len;
+        iov++;
+        n_iov--;
+      }
+      if (n_iov > 0) {
+        iov->iov_base = (uint8_t *)iov->iov_base + sres;
+        iov->iov_len -= sres;
+      }
+    }
+    return sent_bytes;
+  }
+
+  /**
+   * send a Packet over this DataSock, the header and data in one sendmsg
+   * unless the socket takes only part of it
    */
   int send_pkt(const Packet &pkt) const {
     if (SOCK_LOG)
       cout << "DataSock.send(" << pkt << ")" << endl;
 
-    /* send header first */
     uint8_t buffer[sizeof(PacketHeader)];
     pkt.hdr.pack(buffer);
-    size_t sres = send(sock_fd, buffer, sizeof(PacketHeader), 0);
-    if (sres == -1)
-      return sres; // failed
-
-    int sent_bytes = 0;
-    while (sent_bytes < pkt.hdr.data_len()) {
-      int send_len = fmin(MAX_DATA_SIZE, pkt.hdr.data_len() - sent_bytes);
-      sres = send(sock_fd, pkt.data.ptr().get() + sent_bytes, send_len, 0);
-      sent_bytes += send_len;
-      if (sres == -1)
-        return sres; // failed
-    }
-
-    return sres;
+    struct iovec iov[2] = {
+        {buffer, sizeof(PacketHeader)},
+        {pkt.data.ptr().get(), (size_t)pkt.hdr.data_len()}};
+    return send_iov(iov, 2);
   };
 
   /**
    * try to receive a Packet over this DataSock,
    * blocks until packet is available.
    *
-   * Returns empty optional if checksum invalid
+   * Returns empty optional if the connection closed or failed, or the checksum
+   * was invalid
    */
-  Packet get_pkt() const {
-    uint8_t hdr_buf[sizeof(PacketHeader)];
+  optional<Packet> recv_pkt() const {
+    alignas(PacketHeader) uint8_t hdr_buf[sizeof(PacketHeader)];
     int rres = recv(sock_fd, hdr_buf, sizeof(PacketHeader), MSG_WAITALL);
-    assert(rres != -1);
+    if (rres != sizeof(PacketHeader))
+      return nullopt;
     PacketHeader *hdr_ptr = PacketHeader::parse(hdr_buf);
-    /* assert checksum was valid, kinda unsafe but whatever */
-    assert(hdr_ptr);
+    if (!hdr_ptr)
+      return nullopt;
 
     PacketHeader &hdr = *hdr_ptr;
 
@@ -129,15 +184,19 @@ public:
       cout << "DataSock.recv_hdr(hdr: " << hdr << ")" << endl;
 
     if (hdr.data_len() > 0) {
+      /* all of the data straight into the Packet's buffer, one recv unless a
+       * signal interrupts it */
       shared_ptr<uint8_t> recv_buf(new uint8_t[hdr.data_len()],
                                    [](uint8_t *ptr) { delete[] ptr; });
       int recv_bytes = 0;
       while (recv_bytes < hdr.data_len()) {
-        int recv_len = min(MAX_DATA_SIZE, hdr.data_len() - recv_bytes);
-        rres =
-            recv(sock_fd, recv_buf.get() + recv_bytes, recv_len, MSG_WAITALL);
-        recv_bytes += recv_len;
-        assert(rres != -1);
+        rres = recv(sock_fd, recv_buf.get() + recv_bytes,
+                    hdr.data_len() - recv_bytes, MSG_WAITALL);
+        if (rres == -1 && errno == EINTR)
+          continue;
+        if (rres <= 0)
+          return nullopt;
+        recv_bytes += rres;
         if (SOCK_LOG)
           cout << "DataSock.recv_data(" << recv_bytes << " out of "
                << hdr.data_len() << ")" << endl;
@@ -148,6 +207,35 @@ public:
     }
   };
 
+  /**
+   * receive a Packet over this DataSock, blocks until packet is available,
+   * asserting the connection didn't fail
+   */
+  Packet get_pkt() const {
+    optional<Packet> pkt = recv_pkt();
+    /* assert checksum was valid, kinda unsafe but whatever */
+    assert(pkt);
+    return move(*pkt);
+  };
+
+  /**
+   * whether the other end closed or reset the connection, without blocking
+   */
+  bool peer_closed() const {
+    struct pollfd pfd = {sock_fd, POLLRDHUP, 0};
+    return poll(&pfd, 1, 0) == 1 &&
+           (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR));
+  }
+
+  /**
+   * stop reading and writing on this socket, waking any thread blocked on it
+   */
+  void shutdown() const { ::shutdown(sock_fd, SHUT_RDWR); }
+
+  /**
+   * send pkt on a new connection and wait for the response, see
+   * ChannelPool::fetch for a connection that lasts
+   */
   static Packet fetch(const Packet &pkt) {
     DataSock ds(pkt.hdr.dst_addr);
     ds.connect();
@@ -176,6 +264,10 @@ public:
     IpV4Addr a(0);
     struct sockaddr_in address = get_addr(a);
 
+    /* rebind right away after a restart, despite connections in TIME_WAIT */
+    int reuse = 1;
+    setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     /* bind socket, use assert to handle error case */
     int bres = ::bind(sock_fd, (struct sockaddr *)&address, sizeof(address));
     assert(bres != -1);
@@ -201,4 +293,15 @@ public:
     assert(data_sock_fd != -1);
     return DataSock(data_sock_fd, addr);
   }
+
+  /**
+   * accept a pending connection as a non-blocking socket, -1 if there is none
+   * (for a non-blocking ListenSock)
+   */
+  int accept_nonblocking() const {
+    int data_sock_fd = accept4(sock_fd, 0, 0, SOCK_NONBLOCK);
+    if (SOCK_LOG && data_sock_fd != -1)
+      cout << "ListenSock.accept(" << addr << ")" << endl;
+    return data_sock_fd;
+  }
 };
@@ -4,11 +4,20 @@
 #include "kv/command.h"
 #include "kv/key.h"
 #include "lib/dataframe_chunk.h"
+#include "network/channel.h"
 #include "network/packet.h"
 #include "network/sock.h"
+#include "parallel_parser.h"
 #include "parser.h"
+#include "stream_parser.h"
+#include "utils/decompressor.h"
+#include "utils/mapped_file.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <thread>
@@ -18,6 +27,14 @@
 #define CLUSTER_LOG false
 #endif
 
+#ifndef MAX_PENDING_PUTS
+#define MAX_PENDING_PUTS 4
+#endif
+
+#ifndef MAP_POLL_MAX_MS
+#define MAP_POLL_MAX_MS 50 // longest wait between polls for a map's result
+#endif
+
 using namespace std;
 
 /**
@@ -52,7 +69,7 @@ protected:
 
   void get_nodes_in_cluster(const IpV4Addr &addr) {
     Packet req(0, addr, PacketType::GET_PEERS);
-    Packet resp = DataSock::fetch(req);
+    Packet resp = ChannelPool::shared().fetch(req);
     assert(resp.ok());
 
     /* assume response is list of ips */
@@ -89,7 +106,7 @@ protected:
                                const sized_ptr<uint8_t> &data) const {
     /* borrow memory from data for DataChunk */
     Packet req(0, ip, PacketType::DATA, DataChunk(data, true));
-    Packet resp = DataSock::fetch(req);
+    Packet resp = ChannelPool::shared().fetch(req);
     if (CLUSTER_LOG)
       cout << "Cluster.recv(" << resp << ")" << endl;
     if (resp.ok())
@@ -98,6 +115,32 @@ protected:
       return nullopt;
   }
 
+  /**
+   * build the chunk's Bloom filters if the DataFrame's options ask for them,
+   * then serialize and PUT the given chunk at chunk_idx on a new thread. The
+   * chunk must outlive the returned thread.
+   */
+  thread start_put(const Key &key, DFInfo &df_info, int chunk_idx,
+                   DataFrameChunk &dfc) const {
+    df_info.try_update_largest_chunk_idx(chunk_idx);
+    const IpV4Addr &ip = seek_in_nodes(df_info.get_owner(), chunk_idx);
+    if (CLUSTER_LOG)
+      cout << "Cluster.start_thread(:put_chunk, ip: " << ip << ", key: " << key
+           << ", idx: " << chunk_idx << ")" << endl;
+    DataFrameChunk *chunk = &dfc;
+    double bloom_bits = df_info.get_options().bloom_bits();
+    return thread([this, key, chunk, chunk_idx, ip, bloom_bits]() {
+      if (bloom_bits > 0)
+        chunk->build_bloom_filters(bloom_bits);
+      WriteCursor wc;
+      PutCommand::serialize_chunk(
+          wc, ChunkKey(key, chunk_idx),
+          [&](WriteCursor &wc) { chunk->serialize(wc); });
+      optional<DataChunk> result = send_cmd(ip, wc);
+      assert(result); // just Exit if we fail to put a chunk
+    });
+  }
+
 public:
   Cluster(const IpV4Addr &register_a) { connect_to_cluster(register_a); }
 
@@ -142,43 +185,50 @@ public:
 
   /**
    * get a chunk by Key and index, returns an optional which will be nullopt if
-   * the Key or chunk do not exist in the cluster.
+   * the Key or chunk do not exist in the cluster. If given columns, only those
+   * columns are fetched and every other column of the chunk is missing.
    */
-  optional<DataFrameChunk> get(const Key &key, int index) const {
+  optional<DataFrameChunk> get(const Key &key, int index,
+                               const vector<int> &cols = {}) const {
     auto df_info_opt = get_df_info(key);
     if (df_info_opt) {
       const DFInfo &df_info = df_info_opt->get();
       const IpV4Addr &ip = seek_in_nodes(df_info.get_owner(), index);
-      GetCommand get_cmd(key, index);
+      GetCommand get_cmd(key, index, cols);
       optional<DataChunk> result = send_cmd(ip, get_cmd);
       if (result) {
-        ReadCursor rc(result->len(), result->ptr().get());
-        return DataFrameChunk(df_info.get_schema(), rc);
+        /* the chunk reads straight out of the response's bytes */
+        ReadCursor rc = result->cursor();
+        DataFrameChunk dfc(df_info.get_schema());
+        if (dfc.fill(rc))
+          return dfc;
       }
     }
     return nullopt;
   }
 
   /**
-   * put a chunk into the cluster for the given key and at the given chunk_idx.
-   * Undefined behavior of DF with given Key has not been created in the cluster
-   * yet. Returns whether the put was successful or not
+   * put a chunk into the cluster for the given key and at the given chunk_idx,
+   * first building its Bloom filters if the DataFrame's options ask for them,
+   * see DFOptions. Undefined behavior of DF with given Key has not been created
+   * in the cluster yet. Returns whether the put was successful or not
    */
-  bool put(const Key &key, int chunk_idx, const DataFrameChunk &dfc) {
+  bool put(const Key &key, int chunk_idx, DataFrameChunk &dfc) {
     auto df_info_opt = get_df_info(key);
     if (df_info_opt) {
       DFInfo &df_info = df_info_opt->get();
       /* update DFInfo for this DF if this is a new chunk_idx, thread-safe */
       df_info.try_update_largest_chunk_idx(chunk_idx);
 
+      double bloom_bits = df_info.get_options().bloom_bits();
+      if (bloom_bits > 0)
+        dfc.build_bloom_filters(bloom_bits);
+
       const IpV4Addr &ip = seek_in_nodes(df_info.get_owner(), chunk_idx);
       WriteCursor wc;
-      dfc.serialize(wc);
-
-      /* since the WriteCursor and this cmd have the same lifetime, borrow the
-       * data for the chunk */
-      PutCommand put_cmd(ChunkKey(key, chunk_idx), DataChunk(wc, true));
-      optional<DataChunk> result = send_cmd(ip, put_cmd);
+      PutCommand::serialize_chunk(wc, ChunkKey(key, chunk_idx),
+                                  [&](WriteCursor &wc) { dfc.serialize(wc); });
+      optional<DataChunk> result = send_cmd(ip, wc);
       return !!result;
     } else
       return false;
@@ -228,10 +278,27 @@ public:
           cout << "Cluster.start_thread(:fetch_map_res, ip: " << ip
                << ", result_id: " << result_id << ")" << endl;
         threads.emplace_back([&, ip, result_id]() {
-          FetchMapResultCommand fetch_cmd(result_id);
-          optional<DataChunk> result = send_cmd(ip, fetch_cmd);
+          /* poll rather than wait, so the Node can serve others meanwhile */
+          FetchMapResultCommand fetch_cmd(result_id, false);
+          optional<DataChunk> result;
+          pair<int, int> progress;
+          auto backoff = chrono::milliseconds(1);
+          while (true) {
+            result = send_cmd(ip, fetch_cmd);
+            if (!result)
+              break;
+            ReadCursor rc(result->data());
+            if (FetchMapResultCommand::unpack_progress(rc, progress))
+              break;
+            if (CLUSTER_LOG)
+              cout << "Cluster.map(ip: " << ip << ", progress: "
+                   << progress.first << "/" << progress.second << ")" << endl;
+            this_thread::sleep_for(backoff);
+            backoff = min(backoff * 2, chrono::milliseconds(MAP_POLL_MAX_MS));
+          }
           if (result) {
             ReadCursor rc(result->data());
+            FetchMapResultCommand::unpack_progress(rc, progress);
             unique_lock lock(join_mtx);
             rower->join_serialized(rc);
             lock.unlock();
@@ -266,7 +333,8 @@ public:
     return success;
   }
 
-  bool create(const Key &key, const Schema &schema) {
+  bool create(const Key &key, const Schema &schema,
+              const DFOptions &opts = DFOptions()) {
     /* return failure if DF already exists for this Key */
     if (get_df_info(key))
       return false;
@@ -274,7 +342,7 @@ public:
     /* pick IP to own this DF */
     const IpV4Addr &ip = *nodes.begin();
     /* add to dataframes info mapping */
-    dataframes.emplace(key, DFInfo(key, schema, ip, 0));
+    dataframes.emplace(key, DFInfo(key, schema, ip, 0, opts));
 
     bool success = true;
     NewCommand cmd(key, schema);
@@ -285,96 +353,173 @@ public:
     return success;
   }
 
-  bool load_file(const Key &key, const char *filename) {
+  /**
+   * load a SOR file into the cluster under the given Key. Regular files are
+   * memory-mapped and parsed in parallel, each batch of chunks PUT while the
+   * next is parsed. Anything else (e.g. a pipe) or a filename of "-" for stdin
+   * is streamed with load_stream. Files ending in .gz or .zst are decompressed
+   * on a separate thread while the decompressed bytes are parsed and the
+   * parsed chunks PUT. The schema is sampled from across the whole file unless
+   * one is given. opts configure how the chunks are stored, see DFOptions.
+   */
+  bool load_file(const Key &key, const char *filename,
+                 const optional<Schema> &schema = nullopt,
+                 const DFOptions &opts = DFOptions()) {
     /* if key already exists in cluster, return failure */
     if (get_df_info(key))
       return false;
 
-    FILE *fd = fopen(filename, "r");
-    if (fd == 0) {
-      if (CLUSTER_LOG)
-        cout << "ERROR: failed to find file: " << filename << endl;
-      return false;
+    if (strcmp(filename, "-") == 0)
+      return load_stream(key, STDIN_FILENO, schema, opts);
+
+    Decompressor::Codec codec = Decompressor::codec_for(filename);
+    if (codec != Decompressor::Codec::NONE) {
+      if (!Decompressor::supported(codec)) {
+        if (CLUSTER_LOG)
+          cout << "ERROR: not built with support for: " << filename << endl;
+        return false;
+      }
+      int fd = open(filename, O_RDONLY);
+      if (fd < 0) {
+        if (CLUSTER_LOG)
+          cout << "ERROR: failed to open file: " << filename << endl;
+        return false;
+      }
+      bool res;
+      {
+        Decompressor dec(fd, codec);
+        StreamParser parser(
+            [&dec](char *buf, long n) { return dec.read(buf, n); });
+        res = load_stream(key, parser, schema, opts);
+      }
+      close(fd);
+      if (!res && CLUSTER_LOG)
+        cout << "ERROR: failed to decompress file: " << filename << endl;
+      return res;
     }
 
-    fseek(fd, 0, SEEK_END);
-    long length = ftell(fd);
-    fseek(fd, 0, SEEK_SET);
+    MappedFile file(filename);
+    if (!file.ok()) {
+      int fd = open(filename, O_RDONLY);
+      if (fd < 0) {
+        if (CLUSTER_LOG)
+          cout << "ERROR: failed to open file: " << filename << endl;
+        return false;
+      }
+      /* can't be mapped, but can be read, so stream it */
+      bool res = load_stream(key, fd, schema, opts);
+      close(fd);
+      return res;
+    }
+    long length = file.length();
 
     if (CLUSTER_LOG)
-      cout << "Cluster.read_file(file: " << filename << ", len: " << length
+      cout << "Cluster.map_file(file: " << filename << ", len: " << length
            << ")" << endl;
 
-    char *buf = new char[length];
-    fread(buf, length, 1, fd);
-    fclose(fd);
-
-    Parser parser(length, buf);
+    /* parse straight out of the mapping, no copy of the file */
+    Parser parser(length, file.data());
     Schema scm;
-    parser.infer_schema(scm);
+    if (schema)
+      scm = *schema;
+    else
+      parser.infer_schema_sampled(scm);
 
     if (CLUSTER_LOG)
       cout << "Cluster.infer_schema(scm: " << scm << ")" << endl;
 
     /* create DF in cluster */
-    create(key, scm);
+    create(key, scm, opts);
     auto df_info_opt = get_df_info(key);
     DFInfo &df_info = df_info_opt->get();
 
-    bool more_to_parse = true;
-    vector<thread> threads;
-    threads.reserve(nodes.size());
+    /* parse chunks in parallel on the shared pool, a batch large enough to
+     * keep every core and every node busy at a time */
+    ParallelParser pparser(scm, parser);
+    int batch_size = max((int)nodes.size(), ThreadPool::shared().slots());
+    /* PUT a batch in the background while the next one is parsed, as
+     * load_stream does, at most a batch or MAX_PENDING_PUTS in flight */
+    int max_pending = max(batch_size, MAX_PENDING_PUTS);
+    deque<pair<unique_ptr<DataFrameChunk>, thread>> pending;
     vector<DataFrameChunk> dfcs;
-    dfcs.reserve(nodes.size());
     int chunk_idx = 0;
-    while (more_to_parse) {
-      /* parse a chunk for each node sequentially */
-      for (int i = 0; i < nodes.size(); i++) {
-        dfcs.emplace_back(scm);
-        bool good_parse = parser.parse_n_lines(DF_CHUNK_SIZE, dfcs.back());
-        if (!good_parse) {
-          dfcs.pop_back(); // if parse failed, remove DFC we just added
-          more_to_parse = false;
-          break;
+    while (pparser.parse_chunks(batch_size, dfcs) > 0) {
+      for (DataFrameChunk &parsed : dfcs) {
+        /* wait for the oldest PUT before starting another */
+        if ((int)pending.size() >= max_pending) {
+          pending.front().second.join();
+          pending.pop_front();
         }
-
-        /* there is more to parse if we successfully filled a chunk */
-        more_to_parse = good_parse && dfcs.back().is_full();
-        /* if not, break out early */
-        if (!more_to_parse)
-          break;
+        auto dfc = make_unique<DataFrameChunk>(move(parsed));
+        thread t = start_put(key, df_info, chunk_idx++, *dfc);
+        pending.emplace_back(move(dfc), move(t));
       }
+    }
 
-      /* send out parsed chunks in parallel */
-      for (DataFrameChunk &dfc : dfcs) {
-        int ci = chunk_idx++;
-        df_info.try_update_largest_chunk_idx(ci);
-        const IpV4Addr &ip = seek_in_nodes(df_info.get_owner(), ci);
-        if (CLUSTER_LOG)
-          cout << "Cluster.start_thread(:put_chunk, ip: " << ip
-               << ", key: " << key << ", idx: " << ci << ")" << endl;
-        threads.emplace_back([&, ci, ip]() {
-          WriteCursor wc;
-          dfc.serialize(wc);
-
-          /* since the WriteCursor and this cmd have the same lifetime, borrow
-           * the data for the chunk */
-          PutCommand put_cmd(ChunkKey(key, ci), DataChunk(wc, true));
-          optional<DataChunk> result = send_cmd(ip, put_cmd);
-          assert(result); // just Exit if we fail to put a chunk
-        });
-      }
-      /* join to all put threads */
-      while (threads.size()) {
-        threads.back().join();
-        threads.pop_back();
+    for (auto &e : pending)
+      e.second.join();
+    return true;
+  }
+
+  /**
+   * load SOR input read incrementally from the given file descriptor, e.g. a
+   * pipe from zcat, into the cluster under the given Key. Chunks are PUT in the
+   * background while the next one is parsed, with at most MAX_PENDING_PUTS
+   * chunks in flight so memory use does not depend on the input size. Only the
+   * first window of input is available to infer the schema from, so give one
+   * if later rows may widen a column's type.
+   */
+  bool load_stream(const Key &key, int fd,
+                   const optional<Schema> &schema = nullopt,
+                   const DFOptions &opts = DFOptions()) {
+    StreamParser parser(fd);
+    return load_stream(key, parser, schema, opts);
+  }
+
+  /**
+   * load_stream from any StreamParser, e.g. one reading from a Decompressor.
+   * Returns false if reading the input failed part way through, the chunks
+   * parsed before that are still loaded.
+   */
+  bool load_stream(const Key &key, StreamParser &parser,
+                   const optional<Schema> &schema = nullopt,
+                   const DFOptions &opts = DFOptions()) {
+    if (get_df_info(key))
+      return false;
+
+    Schema scm;
+    if (schema)
+      scm = *schema;
+    else
+      parser.infer_schema(scm);
+
+    if (CLUSTER_LOG)
+      cout << "Cluster.infer_schema(scm: " << scm << ")" << endl;
+
+    create(key, scm, opts);
+    auto df_info_opt = get_df_info(key);
+    DFInfo &df_info = df_info_opt->get();
+
+    /* chunks being PUT, in order, with the thread sending each */
+    deque<pair<unique_ptr<DataFrameChunk>, thread>> pending;
+    int chunk_idx = 0;
+    while (true) {
+      auto dfc = make_unique<DataFrameChunk>(scm);
+      if (!parser.next_chunk(*dfc))
+        break;
+
+      /* wait for the oldest PUT before starting another */
+      if (pending.size() >= MAX_PENDING_PUTS) {
+        pending.front().second.join();
+        pending.pop_front();
       }
-      /* clear out chunks once all sent */
-      dfcs.clear();
+      thread t = start_put(key, df_info, chunk_idx++, *dfc);
+      pending.emplace_back(move(dfc), move(t));
     }
 
-    delete[] buf;
-    return true;
+    for (auto &e : pending)
+      e.second.join();
+    return !parser.read_error();
   }
 
   bool shutdown() const {
@@ -383,7 +528,7 @@ public:
       Packet req(0, ip, PacketType::SHUTDOWN);
       if (CLUSTER_LOG)
         cout << "Cluster.send(" << req << ")" << endl;
-      Packet resp = DataSock::fetch(req);
+      Packet resp = ChannelPool::shared().fetch(req);
       if (CLUSTER_LOG)
         cout << "Cluster.recv(" << resp << ")" << endl;
       success = success && resp.ok();
@@ -2,12 +2,39 @@
 
 #include "kv/key.h"
 #include "lib/schema.h"
+#include "lib/bloom_filter.h"
 #include "network/packet.h"
 #include <algorithm>
 #include <atomic>
 
 using namespace std;
 
+/**
+ * Options for how the chunks of a DataFrame are stored, given when it is
+ * created or loaded.
+ *
+ * Bloom filters let a scan looking up equal ints (e.g. SearchIntIntRower) skip
+ * chunks which hold none of the values it looks for. One is built for every int
+ * column of every chunk loaded, at bloom_bits_per_key bits of memory per value,
+ * or at as many bits as a false positive rate of bloom_fpr needs. Neither set
+ * builds no filters.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+struct DFOptions {
+  double bloom_fpr = 0;
+  double bloom_bits_per_key = 0;
+
+  /* the bits per value of each Bloom filter, 0 for none */
+  double bloom_bits() const {
+    if (bloom_bits_per_key > 0)
+      return bloom_bits_per_key;
+    if (bloom_fpr > 0 && bloom_fpr < 1)
+      return BloomFilter::bits_per_key_for(bloom_fpr);
+    return 0;
+  }
+};
+
 /**
  * Container for information stored by the Cluster SDK to interact with a
  * DataFrame stored in the EAU2 cluster.
@@ -19,6 +46,7 @@ private:
   const Key key;
   Schema schema;
   IpV4Addr owner;
+  DFOptions options;
   atomic<int> largest_chunk_idx;
 
   void try_update_largest_chunk_idx(int new_idx) {
@@ -33,16 +61,18 @@ public:
   DFInfo(const Key &k, int largest_chunk_idx)
       : key(k), largest_chunk_idx(largest_chunk_idx) {}
   DFInfo(const Key &k, const Schema &scm, const IpV4Addr &owner,
-         int largest_chunk_idx)
-      : key(k), schema(scm), owner(owner),
+         int largest_chunk_idx, const DFOptions &opts = DFOptions())
+      : key(k), schema(scm), owner(owner), options(opts),
         largest_chunk_idx(largest_chunk_idx) {}
   DFInfo(const DFInfo &dfi)
       : key(dfi.key), schema(dfi.schema), owner(dfi.owner),
+        options(dfi.options),
         largest_chunk_idx(dfi.largest_chunk_idx.load()) {}
 
   const Key &get_key() const { return key; }
   const Schema &get_schema() const { return schema; }
   const IpV4Addr &get_owner() const { return owner; }
+  const DFOptions &get_options() const { return options; }
   int get_largest_chunk_idx() const { return largest_chunk_idx.load(); }
 
   // Cluster is allowed to access/modify private members
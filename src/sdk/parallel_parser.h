@@ -0,0 +1,129 @@
+#pragma once
+
+#include "lib/dataframe_chunk.h"
+#include "lib/thread_pool.h"
+#include "parser.h"
+#include <vector>
+
+using namespace std;
+
+/**
+ * Parses SOR input into DataFrameChunks on multiple threads. The input is split
+ * at new-lines into ranges of DF_CHUNK_SIZE lines and every range is parsed
+ * into its own DataFrameChunk, one task per range on a ThreadPool.
+ *
+ * Chunk indices are identical to those of a sequential Parser calling
+ * parse_n_lines(DF_CHUNK_SIZE) repeatedly. If a range fails to parse (e.g. a
+ * value spans multiple lines) the remaining input is parsed sequentially from
+ * the start of that range so the result is the same as the sequential parse.
+ *
+ * Each chunk is finalized by the thread which parsed it, so its string columns
+ * are dictionary-encoded straight from views of the input, copying only the
+ * distinct strings, or else copied out of the input.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class ParallelParser {
+protected:
+  const Schema &schema;
+  ThreadPool &pool;
+  vector<sized_ptr<char>> ranges;
+  const char *input_end;
+  int next_range = 0;
+  /* sequential parser for the remaining input, only set after a failed range */
+  unique_ptr<Parser> fallback;
+  bool done = false;
+
+  /**
+   * parse ranges [next_range, next_range + n) in parallel, returns the number
+   * of leading ranges which parsed successfully
+   */
+  int parse_ranges(int n, vector<DataFrameChunk> &dest) {
+    int start = dest.size();
+    for (int i = 0; i < n; i++)
+      dest.emplace_back(schema);
+
+    vector<uint8_t> accepted(n, false);
+    pool.run(n, [&](int i, int slot) {
+      const sized_ptr<char> &range = ranges[next_range + i];
+      Parser parser(range.len, range.ptr);
+      DataFrameChunk &dfc = dest[start + i];
+      bool is_last = next_range + i == ranges.size() - 1;
+      /* only the last range may produce a partial chunk, otherwise a row
+       * must have spanned multiple lines */
+      accepted[i] = parser.parse_n_lines(DF_CHUNK_SIZE, dfc) &&
+                    (is_last || dfc.is_full());
+      dfc.finalize();
+    });
+
+    int good = 0;
+    while (good < n && accepted[good])
+      good++;
+
+    /* drop chunks following a failed range */
+    while (dest.size() > start + good)
+      dest.pop_back();
+    return good;
+  }
+
+  /**
+   * parse up to n chunks sequentially with the fallback parser
+   */
+  int parse_sequential(int n, vector<DataFrameChunk> &dest) {
+    int parsed = 0;
+    while (parsed < n && !done) {
+      dest.emplace_back(schema);
+      if (!fallback->parse_n_lines(DF_CHUNK_SIZE, dest.back())) {
+        dest.pop_back();
+        done = true;
+      } else {
+        parsed++;
+        done = !dest.back().is_full();
+        dest.back().finalize();
+      }
+    }
+    return parsed;
+  }
+
+public:
+  /**
+   * build a ParallelParser over the remaining input of the given Parser,
+   * parsing on the given pool
+   */
+  ParallelParser(const Schema &scm, const Parser &parser,
+                 ThreadPool &pool = ThreadPool::shared())
+      : schema(scm), pool(pool),
+        input_end(reinterpret_cast<const char *>(parser.cursor.bytes_end)) {
+    parser.split_lines(DF_CHUNK_SIZE, ranges);
+  }
+
+  /**
+   * parse up to n of the next chunks into dest, clearing dest first. Returns
+   * the number of chunks parsed, 0 once all input has been consumed.
+   */
+  int parse_chunks(int n, vector<DataFrameChunk> &dest) {
+    dest.clear();
+    dest.reserve(n);
+    if (done)
+      return 0;
+
+    if (fallback)
+      return parse_sequential(n, dest);
+
+    int count = min(n, (int)ranges.size() - next_range);
+    int good = parse_ranges(count, dest);
+    next_range += good;
+
+    if (good < count) {
+      /* range failed, parse the rest of the input sequentially from its start
+       * to guarantee the same chunks as a sequential parse */
+      char *start = ranges[next_range].ptr;
+      fallback = make_unique<Parser>(input_end - start, start);
+      return good + parse_sequential(n - good, dest);
+    }
+
+    done = next_range == ranges.size() ||
+           (good > 0 && !dest.back().is_full());
+    return good;
+  }
+};
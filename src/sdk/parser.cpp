@@ -1,7 +1,10 @@
 #include "parser.h"
 #include "lib/dataframe.h"
+#include "lib/dataframe_chunk.h"
 #include "lib/row.h"
 #include "lib/schema.h"
+#include <atomic>
+#include <thread>
 
 Parser::Parser(long len, char *d)
     : cursor(len, reinterpret_cast<uint8_t *>(d)) {}
@@ -10,14 +13,26 @@ Parser::Parser(const char *d) : Parser(strlen(d), const_cast<char *>(d)) {}
 bool Parser::out_of_input() const { return empty(cursor); }
 long Parser::parse_pos() const { return cursor.cursor - cursor.bytes; }
 
+/**
+ * free the strings set in the first n_cols columns of the row, the Parser
+ * allocates them and DataFrames copy the strings they are given
+ */
+static void free_strings(const Schema &scm, Row &row, int n_cols) {
+  for (int i = 0; i < n_cols; i++) {
+    if (scm.col_type(i) == Data::Type::STRING && !row.is_missing(i))
+      delete row.get<string *>(i);
+  }
+}
+
 bool Parser::parse_file(DataFrame &dest) {
   checkpoint(cursor);
 
   bool accept = false;
   Row row(dest.get_schema());
-  while (has_next(cursor) && parse_row(dest.get_schema(), row)) {
+  while (has_next(cursor) && next_row(dest.get_schema(), row)) {
     accept = true; // parsed at least one row
     dest.add_row(row);
+    free_strings(dest.get_schema(), row, row.width());
   }
   accept = accept && empty(cursor);
 
@@ -36,9 +51,10 @@ bool Parser::parse_n_lines(int n, DataFrame &dest) {
   Row row(dest.get_schema());
   int row_count = 0;
   while (row_count < n && has_next(cursor) &&
-         parse_row(dest.get_schema(), row)) {
+         next_row(dest.get_schema(), row)) {
     accept = true; // parsed at least one row
     dest.add_row(row);
+    free_strings(dest.get_schema(), row, row.width());
     row_count++;
   }
   accept = accept && (empty(cursor) || row_count == n);
@@ -68,6 +84,59 @@ bool Parser::infer_schema(Schema &scm) {
   return true;
 }
 
+bool Parser::infer_schema_sampled(Schema &scm, int n_windows) {
+  const char *start = reinterpret_cast<const char *>(cursor.cursor);
+  const char *end = reinterpret_cast<const char *>(cursor.bytes_end);
+  long len = end - start;
+
+  /* every window but the first starts at the first line after its offset */
+  vector<const char *> windows{start};
+  for (int w = 1; w < n_windows; w++) {
+    const char *offset = start + len * w / n_windows;
+    const void *nl = memchr(offset, '\n', end - offset);
+    if (!nl)
+      break;
+    windows.push_back(reinterpret_cast<const char *>(nl) + 1);
+  }
+
+  vector<Schema> results(windows.size());
+  atomic<int> next(0);
+  auto worker = [&]() {
+    for (int w = next++; w < windows.size(); w = next++) {
+      Parser parser(end - windows[w], const_cast<char *>(windows[w]));
+      parser.infer_schema(results[w]);
+    }
+  };
+
+  /* run the worker on this thread as well as the others */
+  vector<thread> threads;
+  int n_threads = min((int)THREAD_COUNT, (int)windows.size());
+  for (int i = 1; i < n_threads; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (thread &t : threads)
+    t.join();
+
+  for (const Schema &result : results)
+    scm.combine(result);
+  return true;
+}
+
+void Parser::split_lines(int n, vector<sized_ptr<char>> &dest) const {
+  const char *start = reinterpret_cast<const char *>(cursor.cursor);
+  const char *end = reinterpret_cast<const char *>(cursor.bytes_end);
+  while (start < end) {
+    /* skip forward n new-lines, memchr is much faster than peek-ing */
+    const char *range_end = start;
+    for (int i = 0; i < n && range_end < end; i++) {
+      const void *nl = memchr(range_end, '\n', end - range_end);
+      range_end = nl ? reinterpret_cast<const char *>(nl) + 1 : end;
+    }
+    dest.emplace_back(range_end - start, const_cast<char *>(start));
+    start = range_end;
+  }
+}
+
 /**
  * parse_row_types: parse types from row, combining types if some already exist
  */
@@ -120,6 +189,333 @@ bool Parser::parse_row(const Schema &scm, Row &dest) {
   /* accept if we've read the entire input or found a new-line */
   accept = accept && (empty(cursor) || expect<char>(cursor, '\n'));
 
+  if (accept) {
+    commit(cursor);
+  } else {
+    /* a rejected row is never added, so nothing else will free its strings */
+    free_strings(scm, dest, scm.width());
+    rollback(cursor);
+  }
+  return accept;
+}
+
+/**
+ * the int value of the validated span [+-]?[[:digit:]]+
+ */
+static int to_int(const char *s, const char *e) {
+  int result = 0;
+  /* from_chars doesn't accept a leading '+' */
+  from_chars(s + (*s == '+'), e, result);
+  return result;
+}
+
+/* powers of ten which are exact floats */
+static const float exact_pow10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                    1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+/**
+ * the float value of the validated span [+-]?[[:digit:]]+(\.[[:digit:]]+)?,
+ * bit-identical to strtof
+ */
+static float to_float(const char *s, const char *e) {
+  bool negative = *s == '-';
+  const char *p = s + (*s == '+' || *s == '-');
+
+  /* fast path: when the digits without the '.' fit in a float's mantissa and
+   * the power of ten is exact, one correctly rounded division gives the
+   * correctly rounded result (Clinger's algorithm). Stop at 19 digits, which
+   * always fit in mantissa, anything longer takes the slow path */
+  uint64_t mantissa = 0;
+  int n_digits = 0, n_frac = -1;
+  for (; p < e && n_digits < 19; p++) {
+    if (*p == '.') {
+      n_frac = 0;
+    } else {
+      mantissa = mantissa * 10 + (*p - '0');
+      n_digits++;
+      n_frac += n_frac >= 0;
+    }
+  }
+  n_frac = max(n_frac, 0);
+  if (p == e && mantissa <= (1 << 24) && n_frac <= 10) {
+    float result = (float)mantissa / exact_pow10[n_frac];
+    return negative ? -result : result;
+  }
+
+  /* slow path, also correctly rounded */
+#ifdef __cpp_lib_to_chars
+  float result;
+  auto res = from_chars(s + (*s == '+'), e, result);
+  if (res.ec == errc())
+    return result;
+#endif
+  /* strtof needs a null terminated string, and handles over/underflow */
+  return strtof(string(s, e - s).c_str(), nullptr);
+}
+
+/**
+ * the type of the unquoted value [s, e), the first type which accepts it of
+ * [MISSING, BOOL, INT, FLOAT, STRING], found in one pass over the value
+ */
+static Data::Type classify(const char *s, const char *e) {
+  if (s == e)
+    return Data::Type::MISSING;
+  if (e - s == 1 && (*s == '0' || *s == '1'))
+    return Data::Type::BOOL;
+
+  const char *p = s + (*s == '+' || *s == '-');
+  const char *int_start = p;
+  while (p < e && isdigit(*p))
+    p++;
+  if (p == int_start)
+    return Data::Type::STRING;
+  if (p == e)
+    return Data::Type::INT;
+  if (*p != '.')
+    return Data::Type::STRING;
+
+  const char *frac_start = ++p;
+  while (p < e && isdigit(*p))
+    p++;
+  return p > frac_start && p == e ? Data::Type::FLOAT : Data::Type::STRING;
+}
+
+/**
+ * parse the value in [s, e) as a bool, the span excludes the brackets. Accepts
+ * exactly what parse_bool would accept for a single value.
+ */
+static bool scan_bool(const char *s, const char *e, bool &dest) {
+  if (classify(s, e) != Data::Type::BOOL)
+    return false;
+  dest = *s == '1';
+  return true;
+}
+
+/**
+ * parse the value in [s, e) as an int, see scan_bool. "0" and "1" are ints as
+ * well as bools.
+ */
+static bool scan_int(const char *s, const char *e, int &dest) {
+  Data::Type t = classify(s, e);
+  if (t != Data::Type::INT && t != Data::Type::BOOL)
+    return false;
+  dest = to_int(s, e);
+  return true;
+}
+
+/**
+ * parse the value in [s, e) as a float, see scan_bool
+ */
+static bool scan_float(const char *s, const char *e, float &dest) {
+  Data::Type t = classify(s, e);
+  if (t != Data::Type::FLOAT && t != Data::Type::INT && t != Data::Type::BOOL)
+    return false;
+  dest = to_float(s, e);
+  return true;
+}
+
+/**
+ * scan_values sink which sets the values of a Row
+ */
+class RowSink {
+public:
+  const Schema &scm;
+  Row &row;
+
+  RowSink(const Schema &scm, Row &row) : scm(scm), row(row) {}
+
+  void set(int i, int val) { row.set(i, val); }
+  void set(int i, float val) { row.set(i, val); }
+  void set(int i, bool val) { row.set(i, val); }
+  void set_string(int i, const char *s, long len) {
+    row.set(i, new string(s, len));
+  }
+  void set_missing(int i) { row.set_missing(i); }
+
+  /* free the strings already set in the first n_set columns */
+  void fail(int n_set) { free_strings(scm, row, n_set); }
+};
+
+/**
+ * scan_values sink which appends values straight onto the typed columns of a
+ * DataFrameChunk, without a Row, a Data or a virtual call per value
+ */
+class ChunkSink {
+public:
+  const Schema &scm;
+  vector<Column *> columns;
+  int row_start;
+
+  ChunkSink(DataFrameChunk &dfc)
+      : scm(dfc.get_schema()), row_start(dfc.nrows()) {
+    for (int i = 0; i < scm.width(); i++)
+      columns.push_back(&dfc.get_column(i));
+  }
+
+  template <typename T> TypedColumn<T> &col(int i) {
+    return *static_cast<TypedColumn<T> *>(columns[i]);
+  }
+
+  void set(int i, int val) { col<int>(i).append(val); }
+  void set(int i, float val) { col<float>(i).append(val); }
+  void set(int i, bool val) { col<bool>(i).append(val); }
+  void set_string(int i, const char *s, long len) {
+    col<string *>(i).append_view(s, len); // no copy until finalize
+  }
+  void set_missing(int i) {
+    switch (scm.col_type(i)) {
+    case Data::Type::INT:
+      col<int>(i).append_missing();
+      break;
+    case Data::Type::FLOAT:
+      col<float>(i).append_missing();
+      break;
+    case Data::Type::STRING:
+      col<string *>(i).append_missing();
+      break;
+    default: // BOOL and MISSING are both bool columns
+      col<bool>(i).append_missing();
+    }
+  }
+
+  /* remove the values of the failed row from the first n_set columns */
+  void fail(int n_set) {
+    for (int j = 0; j < n_set; j++) {
+      switch (scm.col_type(j)) {
+      case Data::Type::INT:
+        col<int>(j).truncate(row_start);
+        break;
+      case Data::Type::FLOAT:
+        col<float>(j).truncate(row_start);
+        break;
+      case Data::Type::STRING:
+        col<string *>(j).truncate(row_start);
+        break;
+      default:
+        col<bool>(j).truncate(row_start);
+      }
+    }
+  }
+};
+
+template <typename Sink>
+bool Parser::scan_values(const Schema &scm, Sink &dest) {
+  const char *pos = reinterpret_cast<const char *>(cursor.cursor);
+  const char *end = reinterpret_cast<const char *>(cursor.bytes_end);
+
+  /* undo the values already set for this row, it is parsed again by
+   * parse_row */
+  auto fail = [&](int n_set) {
+    dest.fail(n_set);
+    return false;
+  };
+
+  for (int i = 0; i < scm.width(); i++) {
+    if (pos == end || *pos == '\n') {
+      /* short row, the rest of the columns are missing */
+      if (i == 0)
+        return false;
+      for (int j = i; j < scm.width(); j++)
+        dest.set_missing(j);
+      break;
+    }
+    if (*pos != '<')
+      return fail(i);
+
+    Data::Type type = scm.col_type(i);
+    const char *start = pos + 1;
+    const char *close;
+    if (start < end && *start == '"') {
+      if (type != Data::Type::STRING)
+        return fail(i);
+      /* quoted string, skip '>' until the closing quote */
+      const char *quote = scanner.next(start + 1, end);
+      while (quote && *quote == '>')
+        quote = scanner.next(quote + 1, end);
+      if (!quote || *quote == '\n' || quote + 1 == end || quote[1] != '>')
+        return fail(i);
+      close = quote + 1;
+      dest.set_string(i, start + 1, quote - start - 1);
+    } else {
+      /* unquoted value, skip '"' until the closing bracket */
+      close = scanner.next(start, end);
+      while (close && *close == '"')
+        close = scanner.next(close + 1, end);
+      if (!close || *close == '\n')
+        return fail(i);
+
+      bool accept = true;
+      if (start == close) {
+        dest.set_missing(i); // "<>" is missing for every type
+      } else {
+        switch (type) {
+        case Data::Type::BOOL: {
+          bool b;
+          if ((accept = scan_bool(start, close, b)))
+            dest.set(i, b);
+          break;
+        }
+        case Data::Type::INT: {
+          int n;
+          if ((accept = scan_int(start, close, n)))
+            dest.set(i, n);
+          break;
+        }
+        case Data::Type::FLOAT: {
+          float f;
+          if ((accept = scan_float(start, close, f)))
+            dest.set(i, f);
+          break;
+        }
+        case Data::Type::STRING:
+          dest.set_string(i, start, close - start);
+          break;
+        default:
+          accept = false; // MISSING columns only accept "<>"
+        }
+      }
+      if (!accept)
+        return fail(i);
+    }
+    pos = close + 1;
+  }
+
+  /* same as parse_row, must be at the end of the input or a new-line */
+  if (pos < end) {
+    if (*pos != '\n')
+      return fail(scm.width());
+    pos++;
+  }
+  cursor.cursor = reinterpret_cast<uint8_t *>(const_cast<char *>(pos));
+  return true;
+}
+
+bool Parser::scan_row(const Schema &scm, Row &dest) {
+  RowSink sink(scm, dest);
+  return scan_values(scm, sink);
+}
+
+bool Parser::parse_n_lines(int n, DataFrameChunk &dest) {
+  checkpoint(cursor);
+
+  const Schema &scm = dest.get_schema();
+  ChunkSink sink(dest);
+  Row row(scm); // only for rows the scanner leaves to parse_row
+  bool accept = false;
+  int row_count = 0;
+  while (row_count < n && has_next(cursor)) {
+    if (!use_scanner || !scan_values(scm, sink)) {
+      if (!parse_row(scm, row))
+        break;
+      dest.add_row(row);
+      free_strings(scm, row, row.width());
+    }
+    sink.row_start++;
+    accept = true; // parsed at least one row
+    row_count++;
+  }
+  accept = accept && (empty(cursor) || row_count == n);
+
   if (accept) {
     commit(cursor);
   } else {
@@ -178,32 +574,34 @@ bool Parser::parse_val(const Data::Type type, Data &dest) {
  * parse a value in brackets (i.e. "<...>") by trying to infer the type
  * matched by first successful parse in this order:
  *   [MISSING, BOOL, INT, FLOAT, STRING]
+ * The value is found and classified in a single pass rather than trying each
+ * parse in turn.
  */
 bool Parser::parse_val_type(Data::Type &type) {
-  checkpoint(cursor);
-
-  Data data;
-  bool accept = expect<char>(cursor, '<') &&
-                ((parse_missing(data) && expect<char>(cursor, '>') &&
-                  (type = Data::Type::MISSING)) ||
-                 (parse_bool(data) && expect<char>(cursor, '>') &&
-                  (type = Data::Type::BOOL)) ||
-                 (parse_int(data) && expect<char>(cursor, '>') &&
-                  (type = Data::Type::INT)) ||
-                 (parse_float(data) && expect<char>(cursor, '>') &&
-                  (type = Data::Type::FLOAT)) ||
-                 (parse_string(data) && expect<char>(cursor, '>') &&
-                  (type = Data::Type::STRING)));
-
-  if (accept && type == Data::Type::STRING)
-    delete data.get<string *>();
-
-  if (accept) {
-    commit(cursor);
+  const char *start = reinterpret_cast<const char *>(cursor.cursor);
+  const char *end = reinterpret_cast<const char *>(cursor.bytes_end);
+  if (start == end || *start != '<')
+    return false;
+  start++;
+
+  const char *close;
+  if (start < end && *start == '"') {
+    /* quoted string, up to the next quote which must be followed by '>' */
+    const char *quote = reinterpret_cast<const char *>(
+        memchr(start + 1, '"', end - start - 1));
+    if (!quote || quote + 1 == end || quote[1] != '>')
+      return false;
+    close = quote + 1;
+    type = Data::Type::STRING;
   } else {
-    rollback(cursor);
+    close = reinterpret_cast<const char *>(memchr(start, '>', end - start));
+    if (!close)
+      return false;
+    type = classify(start, close);
   }
-  return accept;
+
+  cursor.cursor = reinterpret_cast<uint8_t *>(const_cast<char *>(close + 1));
+  return true;
 }
 
 /**
@@ -215,44 +613,42 @@ bool Parser::parse_missing(Data &dest) {
 }
 
 /**
- * parses an int (i.e. "[+-]?[[:digit:]]+>?")
+ * find the end of the number starting at the cursor (i.e.
+ * "[+-]?[[:digit:]]+(\.[[:digit:]]+)?" without the fraction unless
+ * allow_frac), returns nullptr if the number is not followed by '>' or the end
+ * of the input
  */
-bool Parser::parse_int(Data &dest) {
-  checkpoint(cursor);
-
-  int i = 0;
-  char val[MAX_VAL_LEN];
-  bool accept = false;
-
-  char c = peek<char>(cursor); // read first digit
-  /* if is: "[+-[:digit:]]", set accept if we read a digit */
-  if (c == '+' || c == '-' || (accept = isdigit(c))) {
-    val[i++] = yield<char>(cursor);
-  } else { // if is: "[^+-[:digit:]]", fail immediately
-    rollback(cursor);
-    return accept;
-  }
-
-  /* read: "[[:digit:]]*" */
-  while (has_next(cursor) && isdigit(peek<char>(cursor))) {
-    /* since we've read a digit we can accept this input */
-    accept = true;
-    val[i++] = yield<char>(cursor);
+static const char *number_end(const ReadCursor &cursor, bool allow_frac) {
+  const char *p = reinterpret_cast<const char *>(cursor.cursor);
+  const char *end = reinterpret_cast<const char *>(cursor.bytes_end);
+  if (p < end && (*p == '+' || *p == '-'))
+    p++;
+  const char *int_start = p;
+  while (p < end && isdigit(*p))
+    p++;
+  if (p == int_start)
+    return nullptr;
+  if (allow_frac && p < end && *p == '.') {
+    const char *frac_start = ++p;
+    while (p < end && isdigit(*p))
+      p++;
+    if (p == frac_start)
+      return nullptr;
   }
-  /* successful if accepting and we've consumed entire val */
-  accept = accept && (empty(cursor) || peek<char>(cursor) == '>');
+  return p == end || *p == '>' ? p : nullptr;
+}
 
-  /* if can be safely converted to an int */
-  if (accept) {
-    val[i] = '\0'; // ensure null terminated
-    int result;
-    from_chars(val, val + i, result);
-    dest.set(result);
-    commit(cursor);
-  } else {
-    rollback(cursor);
-  }
-  return accept;
+/**
+ * parses an int (i.e. "[+-]?[[:digit:]]+>?"), reading the digits in place
+ */
+bool Parser::parse_int(Data &dest) {
+  const char *start = reinterpret_cast<const char *>(cursor.cursor);
+  const char *end = number_end(cursor, false);
+  if (!end)
+    return false;
+  dest.set(to_int(start, end));
+  cursor.cursor = reinterpret_cast<uint8_t *>(const_cast<char *>(end));
+  return true;
 }
 
 /**
@@ -281,58 +677,17 @@ bool Parser::parse_bool(Data &dest) {
 }
 
 /**
- * parses a float (i.e. "[+-]?[[:digit:]]+(\.[[:digit]]+)?>?")
+ * parses a float (i.e. "[+-]?[[:digit:]]+(\.[[:digit]]+)?>?"), reading the
+ * digits in place
  */
 bool Parser::parse_float(Data &dest) {
-  checkpoint(cursor);
-
-  int i = 0;
-  char val[MAX_VAL_LEN];
-  bool accept = false;
-
-  const char &c = peek<char>(cursor); // read first digit
-  /* if is: "[+-[:digit:]]", set accept if we read a digit */
-  if (c == '+' || c == '-' || (accept = isdigit(c))) {
-    val[i++] = yield<char>(cursor);
-  } else { // if is: "[^+-[:digit:]]", fail immediately
-    rollback(cursor);
-    return accept;
-  }
-
-  /* read: "[[:digit:]]*" */
-  while (has_next(cursor) && isdigit(peek<char>(cursor))) {
-    /* since we've read a digit we can accept this input */
-    accept = true;
-    val[i++] = yield<char>(cursor);
-  }
-
-  /* TODO: above duplicated from parse_int */
-
-  /* if: "(?<=[[:digit:]])\." */
-  if (accept && peek<char>(cursor) == '.') {
-    val[i++] = yield<char>(cursor);
-    accept = false; // reset accept to require numbers after the dec
-    /* read: "[[:digit:]]+" */
-    while (has_next(cursor) && isdigit(peek<char>(cursor))) {
-      accept = true;
-      val[i++] = yield<char>(cursor);
-    }
-  }
-
-  /* if can be safely converted to a float */
-  if (accept) {
-    val[i] = '\0'; // ensure null terminated
-    dest.set(strtof(val, nullptr));
-    /* successful if we've consumed entire val */
-    accept = empty(cursor) || peek<char>(cursor) == '>';
-  }
-
-  if (accept) {
-    commit(cursor);
-  } else {
-    rollback(cursor);
-  }
-  return accept;
+  const char *start = reinterpret_cast<const char *>(cursor.cursor);
+  const char *end = number_end(cursor, true);
+  if (!end)
+    return false;
+  dest.set(to_float(start, end));
+  cursor.cursor = reinterpret_cast<uint8_t *>(const_cast<char *>(end));
+  return true;
 }
 
 /**
@@ -353,13 +708,11 @@ bool Parser::parse_string(Data &dest) {
     }
   } else {
     start = reinterpret_cast<char *>(cursor.cursor);
-    while (has_next(cursor) && yield<char>(cursor) != '>') {
+    /* stop on the '>', even if it is the last char of the input */
+    while (has_next(cursor) && peek<char>(cursor) != '>') {
+      yield<char>(cursor);
       i++;
     }
-    // if we stopped because we found a '>'
-    if (has_next(cursor)) {
-      unyield<char>(cursor); // move back over '>'
-    }
   }
 
   accept = (accept || i > 0) && (empty(cursor) || peek<char>(cursor) == '>');
@@ -2,21 +2,24 @@
 
 #include "lib/cursor.h"
 #include "lib/data.h"
+#include "sor_scanner.h"
 #include <cassert>
 #include <charconv>
 #include <cstring>
 #include <inttypes.h>
 #include <iostream>
 #include <utility>
+#include <vector>
 
-#ifndef MAX_VAL_LEN
-#define MAX_VAL_LEN 1024
+#ifndef SCHEMA_SAMPLE_WINDOWS
+#define SCHEMA_SAMPLE_WINDOWS 64
 #endif
 
 using namespace std;
 
 class Schema;
 class DataFrame;
+class DataFrameChunk;
 class Row;
 
 /**
@@ -28,6 +31,9 @@ class Parser {
 public:
   ReadCursor cursor;
   bool debug = false;
+  /* parse rows using the SIMD structural index, falls back to parse_row for
+   * any row it can't handle */
+  bool use_scanner = true;
 
   Parser(long len, char *d);
   Parser(const char *d);
@@ -39,8 +45,31 @@ public:
 
   bool parse_n_lines(int, DataFrame &);
 
+  /**
+   * parse up to n lines straight into the typed columns of the chunk, skipping
+   * the Row and Data used for other DataFrames. String values are views of the
+   * input, which must outlive the chunk or its DataFrameChunk::finalize call.
+   */
+  bool parse_n_lines(int, DataFrameChunk &);
+
   bool infer_schema(Schema &scm);
 
+  /**
+   * infer the schema from n_windows evenly spaced windows of lines across the
+   * whole input rather than just its first lines, inferred in parallel and
+   * combined. The first window is the same lines infer_schema reads. Does not
+   * move the cursor.
+   */
+  bool infer_schema_sampled(Schema &scm,
+                            int n_windows = SCHEMA_SAMPLE_WINDOWS);
+
+  /**
+   * split the remaining input into ranges of n lines. Every range but the last
+   * ends just after a new-line so each one can be handed to its own Parser.
+   * Does not move the cursor.
+   */
+  void split_lines(int n, vector<sized_ptr<char>> &dest) const;
+
   /**
    * parse_row: parse a row without a known schema
    */
@@ -53,6 +82,14 @@ public:
    */
   bool parse_row(const Schema &scm, Row &dest);
 
+  /**
+   * scan_row: parse a row based on the given schema by jumping between the
+   * structural chars found by the SorScanner. Only handles rows where every
+   * value is well-formed for its column, returns false without moving the
+   * cursor otherwise so the row can be parsed by parse_row.
+   */
+  bool scan_row(const Schema &scm, Row &dest);
+
   /**
    * @brief parse a val in brackets (i.e. "<...>") of an expected type
    *
@@ -94,4 +131,20 @@ public:
    * parses a string (i.e. '("[^"]*"|[^>]*)>?')
    */
   bool parse_string(Data &dest);
+
+protected:
+  SorScanner scanner;
+
+  /**
+   * scan a row like scan_row, passing each value to the given sink (see
+   * RowSink and ChunkSink in parser.cpp)
+   */
+  template <typename Sink> bool scan_values(const Schema &scm, Sink &dest);
+
+  /**
+   * parse up to and including the next row, with scan_row if possible
+   */
+  bool next_row(const Schema &scm, Row &dest) {
+    return (use_scanner && scan_row(scm, dest)) || parse_row(scm, dest);
+  }
 };
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <inttypes.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOR_SCANNER_X86 true
+#endif
+
+#ifndef SCAN_WINDOW_SIZE
+#define SCAN_WINDOW_SIZE (1 << 16) // 64KB
+#endif
+
+using namespace std;
+
+/**
+ * Structural index over SOR input. Finds the positions of every '>', '"' and
+ * '\n' in the input 64 bytes at a time with SIMD compares (AVX2 when the CPU
+ * supports it, SSE2 otherwise) and records them in order so a parser can jump
+ * from one structural character to the next instead of testing every byte.
+ * '<' is not indexed, it always directly follows the previous '>' or '\n'.
+ *
+ * The input is indexed lazily in windows of SCAN_WINDOW_SIZE bytes so the
+ * index stays small no matter how large the input is. The index only knows
+ * where the characters are, not whether they are inside quotes, that is left
+ * to the parser.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class SorScanner {
+protected:
+  const char *win_begin = nullptr;
+  const char *win_end = nullptr;
+  /* offsets from win_begin of structural chars in [win_begin, win_end) */
+  vector<uint32_t> index;
+  size_t next_idx = 0;
+
+  static bool is_structural(char c) {
+    return c == '>' || c == '"' || c == '\n';
+  }
+
+#ifdef SOR_SCANNER_X86
+  /**
+   * bit i is set if p[i] is a structural char, p must have 64 readable bytes
+   */
+  __attribute__((target("avx2"))) static uint64_t
+  block_mask_avx2(const char *p) {
+    const __m256i gt = _mm256_set1_epi8('>');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+    __m256i lo_eq = _mm256_or_si256(_mm256_cmpeq_epi8(lo, gt),
+                                    _mm256_cmpeq_epi8(lo, quote));
+    lo_eq = _mm256_or_si256(lo_eq, _mm256_cmpeq_epi8(lo, nl));
+    __m256i hi_eq = _mm256_or_si256(_mm256_cmpeq_epi8(hi, gt),
+                                    _mm256_cmpeq_epi8(hi, quote));
+    hi_eq = _mm256_or_si256(hi_eq, _mm256_cmpeq_epi8(hi, nl));
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(lo_eq) |
+           ((uint64_t)(uint32_t)_mm256_movemask_epi8(hi_eq) << 32);
+  }
+
+  static uint64_t block_mask_sse2(const char *p) {
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i nl = _mm_set1_epi8('\n');
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+      __m128i eq = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(v, gt), _mm_cmpeq_epi8(v, quote)),
+          _mm_cmpeq_epi8(v, nl));
+      mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(eq) << i;
+    }
+    return mask;
+  }
+#endif
+
+  static uint64_t block_mask_scalar(const char *p) {
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i++)
+      mask |= (uint64_t)is_structural(p[i]) << i;
+    return mask;
+  }
+
+  typedef uint64_t (*block_mask_fn_t)(const char *);
+
+  /**
+   * the fastest block scan supported by this CPU, picked once
+   */
+  static block_mask_fn_t block_mask() {
+#ifdef SOR_SCANNER_X86
+    static const block_mask_fn_t fn =
+        __builtin_cpu_supports("avx2") ? block_mask_avx2 : block_mask_sse2;
+    return fn;
+#else
+    return block_mask_scalar;
+#endif
+  }
+
+  /**
+   * replace the index with the structural chars in [begin, end)
+   */
+  void index_window(const char *begin, const char *end) {
+    win_begin = begin;
+    win_end = end;
+    index.clear();
+    next_idx = 0;
+
+    block_mask_fn_t fn = block_mask();
+    long len = end - begin;
+    long i = 0;
+    for (; i + 64 <= len; i += 64) {
+      for (uint64_t m = fn(begin + i); m; m &= m - 1)
+        index.push_back(i + __builtin_ctzll(m));
+    }
+    /* tail shorter than a block */
+    for (; i < len; i++) {
+      if (is_structural(begin[i]))
+        index.push_back(i);
+    }
+  }
+
+public:
+  /**
+   * find the first structural char at or after p and before end, returns
+   * nullptr if there is none. Fastest when called with increasing p.
+   */
+  const char *next(const char *p, const char *end) {
+    if (p >= end)
+      return nullptr;
+    if (p < win_begin || p >= win_end)
+      index_window(p, p + min((long)SCAN_WINDOW_SIZE, (long)(end - p)));
+    else if (next_idx > 0 && win_begin + index[next_idx - 1] >= p)
+      next_idx = 0; // moved backwards, search the window again
+
+    while (true) {
+      while (next_idx < index.size() && win_begin + index[next_idx] < p)
+        next_idx++;
+      if (next_idx < index.size())
+        return win_begin + index[next_idx];
+      if (win_end >= end)
+        return nullptr;
+      long len = min((long)SCAN_WINDOW_SIZE, (long)(end - win_end));
+      index_window(win_end, win_end + len);
+    }
+  }
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "lib/dataframe_chunk.h"
+#include "parser.h"
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <unistd.h>
+#include <vector>
+
+#ifndef STREAM_WINDOW_SIZE
+#define STREAM_WINDOW_SIZE (1 << 22) // 4MB
+#endif
+
+using namespace std;
+
+/**
+ * Parses SOR input which is read incrementally, e.g. from a pipe or stdin, one
+ * DataFrameChunk at a time. Input is read into a fixed-size window, only the
+ * complete lines in the window are parsed and the partial line at the end is
+ * carried over to the start of the window before reading more. Memory use is
+ * the window plus the chunk being built no matter how large the input is.
+ *
+ * Assumes rows do not span lines, which holds for SOR files without
+ * new-lines inside values.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class StreamParser {
+public:
+  /* reads up to n bytes into the buffer, returns the number of bytes read, 0
+   * at the end of the input and < 0 on error */
+  typedef function<long(char *, long)> read_fn_t;
+
+protected:
+  read_fn_t read_fn;
+  vector<char> window;
+  long window_len = 0; // number of valid bytes in window
+  long parsed = 0;     // offset of the first unparsed byte in window
+  bool eof = false;
+  bool failed = false;
+  bool read_failed = false;
+
+  /**
+   * move unparsed bytes to the front of the window and read more input after
+   * them, growing the window if a single line does not fit. Returns false if
+   * no more input could be read.
+   */
+  bool refill() {
+    if (eof)
+      return false;
+
+    long remaining = window_len - parsed;
+    memmove(window.data(), window.data() + parsed, remaining);
+    window_len = remaining;
+    parsed = 0;
+
+    if (window_len == window.size())
+      window.resize(window.size() * 2);
+
+    long n = read_fn(window.data() + window_len, window.size() - window_len);
+    if (n <= 0) {
+      eof = true;
+      read_failed = n < 0;
+      return false;
+    }
+    window_len += n;
+    return true;
+  }
+
+  /**
+   * offset just past the last complete line in the window, the whole window if
+   * the input has ended
+   */
+  long complete_lines_end() const {
+    if (eof)
+      return window_len;
+    for (long i = window_len; i > parsed; i--) {
+      if (window[i - 1] == '\n')
+        return i;
+    }
+    return parsed;
+  }
+
+public:
+  StreamParser(read_fn_t fn, long window_size = STREAM_WINDOW_SIZE)
+      : read_fn(fn), window(window_size) {}
+
+  /**
+   * stream from a file descriptor, e.g. 0 for stdin
+   */
+  StreamParser(int fd, long window_size = STREAM_WINDOW_SIZE)
+      : StreamParser(
+            [fd](char *buf, long n) {
+              long res;
+              do {
+                res = ::read(fd, buf, n);
+              } while (res < 0 && errno == EINTR);
+              return res;
+            },
+            window_size) {}
+
+  /**
+   * infer the schema from the first window of input, does not consume input
+   */
+  bool infer_schema(Schema &scm) {
+    /* fill the first window, or read all of the input if it is smaller */
+    while (window_len < window.size() && refill())
+      ;
+    long end = complete_lines_end();
+    Parser parser(end - parsed, window.data() + parsed);
+    return parser.infer_schema(scm);
+  }
+
+  /**
+   * parse the next DF_CHUNK_SIZE rows into dest, which should be empty. Every
+   * chunk but the last is full. Returns false if there were no more rows or a
+   * row failed to parse, in which case parsing stops like Parser::parse_n_lines
+   */
+  bool next_chunk(DataFrameChunk &dest) {
+    if (failed)
+      return false;
+
+    while (!dest.is_full()) {
+      long end = complete_lines_end();
+      if (end > parsed) {
+        Parser parser(end - parsed, window.data() + parsed);
+        bool accept = parser.parse_n_lines(DF_CHUNK_SIZE - dest.nrows(), dest);
+        /* strings point into the window, copy them before it is refilled */
+        dest.copy_strings();
+        if (!accept) {
+          failed = true;
+          return false;
+        }
+        parsed += parser.parse_pos();
+      } else if (eof) {
+        break; // out of input
+      } else {
+        /* at the end of input the partial last line becomes complete */
+        refill();
+      }
+    }
+    dest.finalize();
+    return dest.nrows() > 0;
+  }
+
+  /**
+   * true if reading the input failed, e.g. corrupt compressed input, rather
+   * than ending normally
+   */
+  bool read_error() const { return read_failed; }
+};
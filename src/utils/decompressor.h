@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifndef DECOMPRESS_BLOCK_SIZE
+#define DECOMPRESS_BLOCK_SIZE (1 << 20) // 1MB
+#endif
+
+#ifndef DECOMPRESS_QUEUE_LEN
+#define DECOMPRESS_QUEUE_LEN 4
+#endif
+
+using namespace std;
+
+/**
+ * Decompresses a gzip or zstd stream from a file descriptor on its own thread.
+ * Decompressed blocks are handed to the reader through a queue of at most
+ * DECOMPRESS_QUEUE_LEN blocks, so decompression runs ahead of the reader (e.g.
+ * a StreamParser) while memory use stays bounded. zstd support requires
+ * building with USE_ZSTD and linking libzstd.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class Decompressor {
+public:
+  enum class Codec { NONE, GZIP, ZSTD };
+
+  /**
+   * the Codec for a file from its extension, NONE if it is not compressed
+   */
+  static Codec codec_for(const char *filename) {
+    auto ends_with = [filename](const char *ext) {
+      int len = strlen(filename), ext_len = strlen(ext);
+      return len >= ext_len && strcmp(filename + len - ext_len, ext) == 0;
+    };
+    if (ends_with(".gz"))
+      return Codec::GZIP;
+    if (ends_with(".zst"))
+      return Codec::ZSTD;
+    return Codec::NONE;
+  }
+
+  /**
+   * whether this build can decompress the given Codec
+   */
+  static bool supported(Codec codec) {
+#ifdef USE_ZSTD
+    return codec != Codec::NONE;
+#else
+    return codec == Codec::GZIP;
+#endif
+  }
+
+protected:
+  const int fd;
+  thread worker;
+  mutex mtx;
+  condition_variable cv;
+  deque<vector<char>> blocks;
+  bool done = false;     // no more blocks will be queued
+  bool failed = false;   // the input was not a valid compressed stream
+  bool stopping = false; // the reader has gone away
+  /* block being read from and the read position in it */
+  vector<char> current;
+  size_t current_pos = 0;
+
+  long read_input(char *buf, long n) {
+    long res;
+    do {
+      res = ::read(fd, buf, n);
+    } while (res < 0 && errno == EINTR);
+    return res;
+  }
+
+  /**
+   * queue a block of decompressed bytes, waiting while the queue is full.
+   * Returns false if the reader has gone away.
+   */
+  bool push_block(vector<char> &&block) {
+    unique_lock lock(mtx);
+    cv.wait(lock, [this]() {
+      return stopping || blocks.size() < DECOMPRESS_QUEUE_LEN;
+    });
+    if (stopping)
+      return false;
+    blocks.push_back(move(block));
+    cv.notify_all();
+    return true;
+  }
+
+  void finish(bool ok) {
+    unique_lock lock(mtx);
+    done = true;
+    failed = !ok;
+    cv.notify_all();
+  }
+
+  /**
+   * inflate gzip input, including multiple concatenated gzip members
+   */
+  bool run_gzip() {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    /* 32 enables gzip and zlib header detection */
+    if (inflateInit2(&zs, 15 + 32) != Z_OK)
+      return false;
+
+    vector<char> in(DECOMPRESS_BLOCK_SIZE);
+    int res = Z_OK;
+    bool ok = true;
+    while (ok) {
+      if (zs.avail_in == 0) {
+        long n = read_input(in.data(), in.size());
+        if (n < 0) {
+          ok = false;
+          break;
+        }
+        if (n == 0) {
+          ok = res == Z_STREAM_END; // input must end with a complete member
+          break;
+        }
+        zs.next_in = reinterpret_cast<Bytef *>(in.data());
+        zs.avail_in = n;
+      }
+      if (res == Z_STREAM_END)
+        inflateReset(&zs); // next member
+
+      vector<char> out(DECOMPRESS_BLOCK_SIZE);
+      zs.next_out = reinterpret_cast<Bytef *>(out.data());
+      zs.avail_out = out.size();
+      res = inflate(&zs, Z_NO_FLUSH);
+      if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR) {
+        ok = false;
+        break;
+      }
+      out.resize(out.size() - zs.avail_out);
+      if (out.size() && !push_block(move(out)))
+        break;
+    }
+    inflateEnd(&zs);
+    return ok;
+  }
+
+#ifdef USE_ZSTD
+  bool run_zstd() {
+    ZSTD_DCtx *ctx = ZSTD_createDCtx();
+    vector<char> in(ZSTD_DStreamInSize());
+    ZSTD_inBuffer zin = {in.data(), 0, 0};
+    size_t res = 0;
+    bool ok = true;
+    while (ok) {
+      if (zin.pos == zin.size) {
+        long n = read_input(in.data(), in.size());
+        if (n <= 0) {
+          ok = n == 0 && res == 0; // input must end with a complete frame
+          break;
+        }
+        zin.size = n;
+        zin.pos = 0;
+      }
+
+      vector<char> out(DECOMPRESS_BLOCK_SIZE);
+      ZSTD_outBuffer zout = {out.data(), out.size(), 0};
+      res = ZSTD_decompressStream(ctx, &zout, &zin);
+      if (ZSTD_isError(res)) {
+        ok = false;
+        break;
+      }
+      out.resize(zout.pos);
+      if (out.size() && !push_block(move(out)))
+        break;
+    }
+    ZSTD_freeDCtx(ctx);
+    return ok;
+  }
+#endif
+
+public:
+  /**
+   * start decompressing from fd, which must stay open until this is destroyed
+   */
+  Decompressor(int fd, Codec codec) : fd(fd) {
+    assert(supported(codec));
+    worker = thread([this, codec]() {
+#ifdef USE_ZSTD
+      finish(codec == Codec::ZSTD ? run_zstd() : run_gzip());
+#else
+      finish(run_gzip());
+#endif
+    });
+  }
+
+  Decompressor(const Decompressor &) = delete;
+
+  ~Decompressor() {
+    unique_lock lock(mtx);
+    stopping = true;
+    cv.notify_all();
+    lock.unlock();
+    worker.join();
+  }
+
+  /**
+   * read up to n decompressed bytes into buf, returns the number of bytes
+   * read, 0 at the end of the input and -1 if the input was corrupt. Usable as
+   * a StreamParser::read_fn_t.
+   */
+  long read(char *buf, long n) {
+    if (current_pos == current.size()) {
+      unique_lock lock(mtx);
+      cv.wait(lock, [this]() { return done || !blocks.empty(); });
+      if (blocks.empty())
+        return failed ? -1 : 0;
+      current = move(blocks.front());
+      blocks.pop_front();
+      current_pos = 0;
+      cv.notify_all();
+    }
+    long len = min(n, (long)(current.size() - current_pos));
+    memcpy(buf, current.data() + current_pos, len);
+    current_pos += len;
+    return len;
+  }
+};
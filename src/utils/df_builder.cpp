@@ -38,25 +38,27 @@ string *rand_string(string *dest) {
 /**
  * Script for generating dataframes in SOR format for testing parser. Takes 2
  * positional arguments: first the number of lines and second the schema of the
- * DataFrame.
+ * DataFrame. Optionally takes a third, the seed for the random generator, so
+ * the same file can be generated again (e.g. for benchmarks), and a fourth,
+ * the percent chance for each value to be missing (default 20).
  *
  * e.g.
  * $ df_builder 100000 ISFBSSIIIIIIISSBF
+ * $ df_builder 100000 IFSB 4500 90
  */
 int main(int argc, char **argv) {
-  // use current time as seed for random generator
-  srand(time(nullptr));
-
-  assert(argc == 3);
+  assert(argc >= 3 && argc <= 5);
   int length = atoi(argv[1]);
   Schema scm(argv[2]);
+  // use current time as seed for random generator unless one is given
+  srand(argc > 3 ? atoi(argv[3]) : time(nullptr));
+  int missing_pct = argc > 4 ? atoi(argv[4]) : 20;
   SimpleDataFrame df(scm);
 
   Row r(scm);
   for (int y = 0; y < length; y++) {
     for (int x = 0; x < scm.width(); x++) {
-      /* 1 in 5 chance for missing */
-      if (rand() % 5 == 0) {
+      if (rand() % 100 < missing_pct) {
         r.set_missing(x);
       } else {
         switch (scm.col_type(x)) {
@@ -79,6 +81,11 @@ int main(int argc, char **argv) {
       }
     }
     df.add_row(r);
+    /* the DataFrame copies strings, free the Row's */
+    for (int x = 0; x < scm.width(); x++) {
+      if (scm.col_type(x) == Data::Type::STRING && !r.is_missing(x))
+        delete r.get<string *>(x);
+    }
   }
   df.print();
 }
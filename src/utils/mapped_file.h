@@ -0,0 +1,68 @@
+#pragma once
+
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * A read-only memory mapping of a whole file. The kernel pages the file in as
+ * the mapping is read so a Parser can start on the first rows immediately, and
+ * the pages are clean page-cache which can be evicted under memory pressure
+ * rather than a second private copy of the file.
+ *
+ * authors: @grahamwren, @jagen31
+ */
+class MappedFile {
+private:
+  char *bytes = nullptr;
+  long len = 0;
+  bool mapped = false;
+
+public:
+  MappedFile(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+      return;
+
+    struct stat st;
+    /* only regular files can be mapped, e.g. not pipes */
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+      len = st.st_size;
+      if (len == 0) {
+        mapped = true; // nothing to map, but not a failure
+      } else {
+        void *addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+          bytes = reinterpret_cast<char *>(addr);
+          mapped = true;
+          /* hint the kernel to read ahead aggressively, we parse front to
+           * back, and to back the mapping with huge pages where it can */
+          madvise(addr, len, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+          madvise(addr, len, MADV_HUGEPAGE);
+#endif
+        }
+      }
+    }
+    close(fd); // the mapping keeps its own reference to the file
+  }
+
+  MappedFile(const MappedFile &) = delete;
+
+  ~MappedFile() {
+    if (bytes)
+      munmap(bytes, len);
+  }
+
+  /* whether the file was successfully mapped */
+  bool ok() const { return mapped; }
+
+  long length() const { return len; }
+
+  /* the mapping is read-only, Parser never writes to its input */
+  char *data() const { return bytes; }
+};
@@ -3,7 +3,10 @@
 #include "lib/row.h"
 #include "lib/rower.h"
 #include <algorithm>
+#include <atomic>
 #include <limits.h>
+#include <memory>
+#include <thread>
 
 class CountDiv2 : public Rower {
 private:
@@ -58,3 +61,28 @@ public:
     output << "min: " << min_int << " max: " << max_int;
   }
 };
+
+/* counts rows, but only once its gate is opened, to hold a map open */
+class GatedCount : public Rower {
+private:
+  int count = 0;
+  shared_ptr<atomic<bool>> gate;
+
+public:
+  GatedCount(shared_ptr<atomic<bool>> gate) : gate(gate) {}
+  Type get_type() const { return (Type)34; }
+
+  bool accept(const Row &r) {
+    while (!*gate)
+      this_thread::yield();
+    count++;
+    return true;
+  }
+  int get_count() const { return count; }
+  void join(const Rower &o) {
+    count += dynamic_cast<const GatedCount &>(o).count;
+  }
+  void serialize_results(WriteCursor &c) const { pack(c, count); }
+  unique_ptr<Rower> clone() const { return make_unique<GatedCount>(gate); };
+  void out(ostream &output) const { output << count; }
+};
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include "test_bitmap.h"
+#include "test_bloom_filter.h"
 #include "test_cli_flags.h"
 #include "test_column.h"
 #include "test_command.h"
@@ -7,13 +9,20 @@
 #include "test_data.h"
 #include "test_dataframe.h"
 #include "test_dataframe_chunk.h"
+#include "test_decompressor.h"
 #include "test_kv_store.h"
 #include "test_network.h"
+#include "test_packed_ints.h"
 #include "test_packet.h"
+#include "test_parallel_parser.h"
 #include "test_parser.h"
 #include "test_partial_dataframe.h"
+#include "test_reduce.h"
 #include "test_row.h"
+#include "test_row_batch.h"
 #include "test_schema.h"
+#include "test_stream_parser.h"
+#include "test_thread_pool.h"
 
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
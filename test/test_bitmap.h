@@ -0,0 +1,48 @@
+#pragma once
+
+#include "lib/bitmap.h"
+
+TEST(TestBitmap, test_push_back_get_set) {
+  Bitmap bm;
+  for (int i = 0; i < 130; i++)
+    bm.push_back(i % 3 == 0);
+  EXPECT_EQ(bm.size(), 130);
+  EXPECT_EQ(bm.byte_size(), 17);
+  for (int i = 0; i < 130; i++)
+    EXPECT_EQ(bm[i], i % 3 == 0);
+
+  bm[1] = true;
+  bm[0] = false;
+  EXPECT_TRUE(bm[1]);
+  EXPECT_FALSE(bm[0]);
+  /* bit i is bit i % 8 of byte i / 8 */
+  EXPECT_EQ(bm.bytes()[0], 0b01001010);
+}
+
+TEST(TestBitmap, test_resize_clears_dropped_bits) {
+  Bitmap bm;
+  for (int i = 0; i < 70; i++)
+    bm.push_back(true);
+  bm.resize(65);
+  bm.resize(70);
+  for (int i = 0; i < 70; i++)
+    EXPECT_EQ(bm[i], i < 65);
+}
+
+TEST(TestBitmap, test_assign) {
+  Bitmap bm;
+  for (int i = 0; i < 100; i++)
+    bm.push_back(i % 7 == 0);
+
+  Bitmap copy;
+  copy.assign(bm.size(), bm.bytes());
+  EXPECT_TRUE(copy == bm);
+
+  /* bits past n in the last byte are ignored */
+  uint8_t bytes[] = {0xff, 0xff};
+  copy.assign(10, bytes);
+  Bitmap expected;
+  for (int i = 0; i < 10; i++)
+    expected.push_back(true);
+  EXPECT_TRUE(copy == expected);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "lib/bloom_filter.h"
+#include <random>
+
+TEST(TestBloomFilter, test_empty__may_contain_anything) {
+  BloomFilter bf;
+  EXPECT_TRUE(bf.empty());
+  EXPECT_TRUE(bf.may_contain(0));
+  EXPECT_TRUE(bf.may_contain(-12345));
+}
+
+TEST(TestBloomFilter, test_add__no_false_negatives) {
+  BloomFilter bf(10000, 8);
+  EXPECT_FALSE(bf.empty());
+  for (int i = 0; i < 10000; i++)
+    bf.add(i * 7 - 5000);
+  for (int i = 0; i < 10000; i++)
+    EXPECT_TRUE(bf.may_contain(i * 7 - 5000));
+}
+
+TEST(TestBloomFilter, test_false_positive_rate) {
+  double fpr = 0.01;
+  BloomFilter bf(10000, BloomFilter::bits_per_key_for(fpr));
+  mt19937 gen(4500);
+  for (int i = 0; i < 10000; i++)
+    bf.add(gen() & 0x7fffffff);
+  /* negative keys were never added */
+  int false_positives = 0;
+  for (int i = 1; i <= 100000; i++)
+    false_positives += bf.may_contain(-i);
+  /* blocking costs a little accuracy, allow twice the target rate */
+  EXPECT_LT(false_positives, 100000 * fpr * 2);
+}
+
+TEST(TestBloomFilter, test_byte_size) {
+  /* 1000 keys * 10 bits, rounded up to 512 bit blocks */
+  BloomFilter bf(1000, 10);
+  EXPECT_EQ(bf.byte_size(), 20 * 64);
+  EXPECT_EQ(BloomFilter(0, 10).byte_size(), 64);
+}
+
+TEST(TestBloomFilter, test_serialize_fill) {
+  BloomFilter bf(500, 10);
+  for (int i = 0; i < 500; i++)
+    bf.add(i * 3);
+  WriteCursor wc;
+  bf.serialize(wc);
+  EXPECT_EQ(wc.length(), 8 + bf.byte_size());
+
+  for (bool borrow : {false, true}) {
+    ReadCursor rc = wc;
+    BloomFilter bf2;
+    bf2.fill(rc, borrow);
+    EXPECT_EQ(rc.cursor, rc.bytes_end);
+    EXPECT_EQ(bf2.byte_size(), bf.byte_size());
+    for (int i = 0; i < 1500; i++)
+      EXPECT_EQ(bf2.may_contain(i), bf.may_contain(i));
+  }
+}
+
+TEST(TestBloomFilter, test_fill__rejects_bad_bytes) {
+  BloomFilter bf(500, 10);
+  WriteCursor wc;
+  bf.serialize(wc);
+
+  ReadCursor cut(wc.length() - 8, wc.begin());
+  BloomFilter bf2;
+  EXPECT_FALSE(bf2.fill(cut));
+  EXPECT_TRUE(bf2.empty());
+
+  reinterpret_cast<uint32_t *>(wc.begin())[1] = 17; // more hashes than any filter uses
+  ReadCursor too_many_k = wc;
+  EXPECT_FALSE(bf2.fill(too_many_k));
+  EXPECT_TRUE(bf2.empty());
+}
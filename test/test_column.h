@@ -15,12 +15,11 @@ public:
     ic->push(4);
     ic->push(5);
 
-    sc->push(new string("10"));
-    sc->push(new string("11"));
-    sc->push(new string("12"));
-    sc->push(new string("13"));
-    sc->push(new string("14"));
-    sc->push(new string("15"));
+    /* string columns copy what they are given */
+    for (int i = 10; i < 16; i++) {
+      string s = to_string(i);
+      sc->push(&s);
+    }
   }
 
   void Teardown() {
@@ -34,7 +33,8 @@ TEST_F(TestColumn, test_length) {
   EXPECT_EQ(sc->length(), 6);
   ic->push(22);
   EXPECT_EQ(ic->length(), 7);
-  sc->push(new string("22"));
+  string s("22");
+  sc->push(&s);
   EXPECT_EQ(sc->length(), 7);
 }
 
@@ -48,7 +48,8 @@ TEST_F(TestColumn, test_equals_push) {
   for (int i = 10; i < 16; i++) {
     char buf[3];
     sprintf(buf, "%d", i);
-    strc->push(new string(buf));
+    string s(buf);
+    strc->push(&s);
   }
   EXPECT_TRUE(strc->equals(*sc));
 }
@@ -62,16 +63,17 @@ TEST_F(TestColumn, test_get_set) {
   ic->set(2, 4);
   EXPECT_EQ(ic->get_int(2), 4);
 
-  EXPECT_STREQ(sc->get_string(0)->c_str(), "10");
+  EXPECT_STREQ(sc->get_string(0).c_str(), "10");
   char buf[3];
   for (int i = 0; i < 6; i++) {
     sprintf(buf, "1%d", i);
-    EXPECT_STREQ(sc->get_string(i)->c_str(), buf);
+    EXPECT_STREQ(sc->get_string(i).c_str(), buf);
   }
-  sc->push(new string("22"));
-  EXPECT_STREQ(sc->get_string(6)->c_str(), "22");
-  sc->set(2, new string("4"));
-  EXPECT_STREQ(sc->get_string(2)->c_str(), "4");
+  string s22("22"), s4("4");
+  sc->push(&s22);
+  EXPECT_STREQ(sc->get_string(6).c_str(), "22");
+  sc->set(2, &s4);
+  EXPECT_STREQ(sc->get_string(2).c_str(), "4");
 }
 
 TEST_F(TestColumn, test_serialize_fill_int) {
@@ -91,3 +93,376 @@ TEST_F(TestColumn, test_serialize_fill_string) {
   sc2->fill(sc->length(), rc);
   EXPECT_TRUE(sc->equals(*sc2));
 }
+
+TEST_F(TestColumn, test_string_views_compact) {
+  char buf[] = "applesoranges";
+  TypedColumn<string *> col;
+  col.append_view(buf, 6);
+  col.append_missing();
+  col.append_view(buf + 6, 7);
+  EXPECT_EQ(col.get_string(0), "apples");
+  EXPECT_EQ(col.byte_size(), 13);
+
+  /* borrowed cells serialize like copied ones */
+  TypedColumn<string *> copied;
+  copied.append(buf, 6);
+  copied.append_missing();
+  copied.append(buf + 6, 7);
+  WriteCursor view_wc, copy_wc;
+  col.serialize(view_wc);
+  copied.serialize(copy_wc);
+  ASSERT_EQ(view_wc.length(), copy_wc.length());
+  EXPECT_EQ(memcmp(view_wc.begin(), copy_wc.begin(), copy_wc.length()), 0);
+
+  /* views see changes to the buffer until compacted */
+  buf[0] = 'A';
+  col.compact();
+  buf[6] = 'O';
+  EXPECT_EQ(col.get_string(2), "oranges");
+  EXPECT_TRUE(col.is_missing(1));
+
+  /* pushed strings are copied, not owned */
+  string s("pears");
+  col.push(&s);
+  s[0] = 'P';
+  EXPECT_EQ(col.get_string(3), "pears");
+
+  /* truncating drops borrowed cells before the arena's */
+  col.append_view(buf, 3);
+  col.append_missing();
+  col.truncate(5);
+  EXPECT_EQ(col.byte_size(), 21);
+  col.truncate(4);
+  EXPECT_EQ(col.byte_size(), 18);
+
+  TypedColumn<string *> expected;
+  string vals[] = {"Apples", "oranges"};
+  expected.push(&vals[0]);
+  expected.push();
+  expected.push(&vals[1]);
+  expected.push(&s);
+  EXPECT_FALSE(col.equals(expected));
+  s = "pears";
+  expected.set(3, &s);
+  EXPECT_TRUE(col.equals(expected));
+}
+
+TEST_F(TestColumn, test_string_arena) {
+  char buf[] = "applesoranges";
+  TypedColumn<string *> col;
+  col.append(buf, 6);
+  col.append_missing();
+  col.append(buf + 6, 7);
+  EXPECT_EQ(col.get_string(0), "apples");
+
+  /* appended bytes are copied into the arena */
+  buf[0] = 'A';
+  EXPECT_EQ(col.get_string_view(0), "apples");
+  EXPECT_EQ(col.get_string_view(2), "oranges");
+  EXPECT_TRUE(col.is_missing(1));
+  EXPECT_EQ(col.byte_size(), 13);
+
+  /* every string is contiguous in the arena */
+  EXPECT_EQ(col.get_string_view(0).data() + 6, col.get_string_view(2).data());
+
+  /* pushed strings are copied, not owned */
+  string s("pears");
+  col.push(&s);
+  s[0] = 'P';
+  EXPECT_EQ(col.get_string(3), "pears");
+
+  /* setting a cell moves the cells after it */
+  string kiwi("kiwi");
+  col.set(0, &kiwi);
+  EXPECT_EQ(col.get_string(0), "kiwi");
+  EXPECT_EQ(col.get_string_view(2), "oranges");
+  EXPECT_EQ(col.get_string_view(3), "pears");
+  col.set(2);
+  EXPECT_TRUE(col.is_missing(2));
+  EXPECT_EQ(col.get_string_view(3), "pears");
+  EXPECT_EQ(col.byte_size(), 9);
+
+  col.truncate(1);
+  EXPECT_EQ(col.length(), 1);
+  EXPECT_EQ(col.byte_size(), 4);
+  col.append(string_view("fig"));
+  EXPECT_EQ(col.get_string(1), "fig");
+
+  TypedColumn<string *> expected;
+  expected.push(&kiwi);
+  string fig("figs");
+  expected.push(&fig);
+  EXPECT_FALSE(col.equals(expected));
+  fig = "fig";
+  expected.set(1, &fig);
+  EXPECT_TRUE(col.equals(expected));
+}
+
+TEST_F(TestColumn, test_serialize_fill_bool_missing) {
+  TypedColumn<bool> bc;
+  for (int i = 0; i < 100; i++) {
+    if (i % 3 == 0)
+      bc.push();
+    else
+      bc.push(i % 2 == 0);
+  }
+  WriteCursor wc;
+  bc.serialize(wc);
+  /* tag, zone map, empty Bloom filter, bitmaps of missings and values, each
+   * padded to 8 bytes */
+  EXPECT_EQ(wc.length(), 8 + 24 + 8 + 16 + 16);
+  ReadCursor rc = wc;
+  TypedColumn<bool> bc2;
+  bc2.fill(bc.length(), rc);
+  EXPECT_TRUE(bc.equals(bc2));
+  EXPECT_TRUE(bc2.is_missing(99));
+  EXPECT_TRUE(bc2.get_bool(98));
+  EXPECT_EQ(rc.cursor, rc.bytes_end);
+}
+
+TEST_F(TestColumn, test_serialize_fill_string_missing) {
+  TypedColumn<string *> col;
+  string vals[] = {"", "abc", "defgh"};
+  col.push(&vals[0]);
+  col.push();
+  col.push(&vals[1]);
+  col.push(&vals[2]);
+  WriteCursor wc;
+  col.serialize(wc);
+  EXPECT_EQ(wc.length() % CHUNK_ALIGN, 0);
+  ReadCursor rc = wc;
+  TypedColumn<string *> col2;
+  col2.fill(col.length(), rc);
+  EXPECT_TRUE(col.equals(col2));
+  EXPECT_TRUE(col2.is_missing(1));
+  EXPECT_EQ(col2.get_string(0), "");
+  EXPECT_EQ(col2.get_string(3), "defgh");
+  EXPECT_EQ(rc.cursor, rc.bytes_end);
+}
+
+TEST_F(TestColumn, test_string_dict_encode) {
+  TypedColumn<string *> col;
+  string words[] = {"apples", "oranges", "pears"};
+  for (int i = 0; i < 100; i++) {
+    if (i % 10 == 0)
+      col.append_missing();
+    else
+      col.push(&words[i % 3]);
+  }
+  TypedColumn<string *> plain;
+  for (int i = 0; i < 100; i++) {
+    if (col.is_missing(i))
+      plain.push();
+    else
+      plain.append(col.get_string_view(i));
+  }
+
+  EXPECT_TRUE(col.encode());
+  EXPECT_TRUE(col.is_encoded());
+  EXPECT_EQ(col.dict_size(), 3);
+  EXPECT_EQ(col.byte_size(), 18); // each distinct word once
+  EXPECT_EQ(col.dict_entry(col.dict_codes()[4]), "oranges");
+  EXPECT_EQ(col.get_string_view(5), "pears");
+  EXPECT_TRUE(col.is_missing(20));
+  EXPECT_TRUE(col.equals(plain));
+  EXPECT_TRUE(plain.equals(col));
+
+  /* serialized as DICT, filled as a copy or a view */
+  WriteCursor wc;
+  col.serialize(wc);
+  WriteCursor plain_wc;
+  plain.serialize(plain_wc);
+  EXPECT_LT(wc.length(), plain_wc.length());
+  ReadCursor rc = wc;
+  TypedColumn<string *> copy;
+  copy.fill(100, rc);
+  EXPECT_EQ(rc.cursor, rc.bytes_end);
+  EXPECT_TRUE(copy.is_encoded());
+  EXPECT_TRUE(copy.equals(plain));
+  ReadCursor view_rc = wc;
+  unique_ptr<Column> view(Column::create_view(Data::Type::STRING));
+  view->fill(100, view_rc);
+  EXPECT_EQ(view->dict_size(), 3);
+  EXPECT_TRUE(view->equals(plain));
+  WriteCursor view_wc;
+  view->serialize(view_wc);
+  ASSERT_EQ(view_wc.length(), wc.length());
+  EXPECT_EQ(memcmp(view_wc.begin(), wc.begin(), wc.length()), 0);
+
+  /* a code past the dictionary is rejected, the last row's is at the end */
+  vector<uint8_t> bad(wc.begin(), wc.begin() + wc.length());
+  uint32_t past = 3;
+  memcpy(bad.data() + bad.size() - sizeof(uint32_t), &past, sizeof(past));
+  ReadCursor bad_rc(bad.size(), bad.data());
+  TypedColumn<string *> bad_copy;
+  EXPECT_FALSE(bad_copy.fill(100, bad_rc));
+  ReadCursor bad_view_rc(bad.size(), bad.data());
+  unique_ptr<Column> bad_view(Column::create_view(Data::Type::STRING));
+  EXPECT_FALSE(bad_view->fill(100, bad_view_rc));
+
+  /* modifying the column decodes it */
+  string kiwi("kiwi");
+  col.set(1, &kiwi);
+  EXPECT_FALSE(col.is_encoded());
+  EXPECT_EQ(col.get_string_view(1), "kiwi");
+  EXPECT_EQ(col.get_string_view(2), "pears");
+  col.push(&kiwi);
+  EXPECT_EQ(col.length(), 101);
+  EXPECT_TRUE(col.is_missing(90));
+}
+
+TEST_F(TestColumn, test_string_dict_encode__high_cardinality) {
+  TypedColumn<string *> col;
+  for (int i = 0; i < 100; i++) {
+    string s = to_string(i % 60); // 60% distinct
+    col.push(&s);
+  }
+  EXPECT_FALSE(col.encode());
+  EXPECT_FALSE(col.is_encoded());
+  EXPECT_EQ(col.dict_codes(), nullptr);
+  EXPECT_EQ(col.get_string_view(61), "1");
+}
+
+TEST_F(TestColumn, test_string_dict_encode__borrowed) {
+  char buf[] = "applespears";
+  TypedColumn<string *> col;
+  for (int i = 0; i < 10; i++) {
+    if (i % 2)
+      col.append_view(buf, 6);
+    else
+      col.append_view(buf + 6, 5);
+  }
+  col.append_missing();
+
+  /* only the distinct strings are copied out of the buffer */
+  col.compact();
+  EXPECT_TRUE(col.is_encoded());
+  EXPECT_EQ(col.byte_size(), 11);
+  buf[0] = 'A';
+  EXPECT_EQ(col.get_string_view(1), "apples");
+  EXPECT_EQ(col.get_string_view(2), "pears");
+  EXPECT_TRUE(col.is_missing(10));
+}
+
+TEST_F(TestColumn, test_compact__packs_ints) {
+  TypedColumn<int> col;
+  for (int i = 0; i < 1000; i++) {
+    if (i % 9 == 0)
+      col.push();
+    else
+      col.push(20000 + i);
+  }
+  TypedColumn<int> plain;
+  for (int i = 0; i < 1000; i++) {
+    if (col.is_missing(i))
+      plain.push();
+    else
+      plain.push(col.get_int(i));
+  }
+
+  col.compact();
+  EXPECT_TRUE(col.is_compressed());
+  EXPECT_EQ(col.get_int(500), 20500);
+  EXPECT_TRUE(col.is_missing(99));
+  EXPECT_TRUE(col.equals(plain));
+  int vals[10];
+  col.get_ints(994, 5, vals);
+  EXPECT_EQ(vals[4], 20998);
+
+  WriteCursor wc, plain_wc;
+  col.serialize(wc);
+  plain.serialize(plain_wc);
+  EXPECT_LT(wc.length() * 3, plain_wc.length());
+
+  /* filled as a copy and as a view of the compressed bytes */
+  ReadCursor rc = wc;
+  TypedColumn<int> copy;
+  copy.fill(1000, rc);
+  EXPECT_EQ(rc.cursor, rc.bytes_end);
+  EXPECT_TRUE(copy.is_compressed());
+  EXPECT_TRUE(copy.equals(plain));
+  ReadCursor view_rc = wc;
+  unique_ptr<Column> view(Column::create_view(Data::Type::INT));
+  view->fill(1000, view_rc);
+  EXPECT_TRUE(view->equals(plain));
+  view->get_ints(0, 10, vals);
+  EXPECT_EQ(vals[3], 20003);
+
+  /* modifying decompresses */
+  col.set(500, 7);
+  EXPECT_FALSE(col.is_compressed());
+  EXPECT_EQ(col.get_int(500), 7);
+  EXPECT_EQ(col.get_int(501), 20501);
+  EXPECT_TRUE(col.is_missing(99));
+}
+
+TEST_F(TestColumn, test_compact__bool_runs) {
+  TypedColumn<bool> col;
+  for (int i = 0; i < 10000; i++)
+    col.push(i >= 5000);
+  col.compact();
+  EXPECT_TRUE(col.is_compressed());
+  EXPECT_FALSE(col.get_bool(4999));
+  EXPECT_TRUE(col.get_bool(5000));
+  WriteCursor wc;
+  col.serialize(wc);
+  EXPECT_LT(wc.length(), 10000 / 8 * 2); // missing bitmap and a tiny RLE
+
+  ReadCursor rc = wc;
+  unique_ptr<Column> view(Column::create_view(Data::Type::BOOL));
+  view->fill(10000, rc);
+  EXPECT_TRUE(view->equals(col));
+  EXPECT_TRUE(view->get_bool(9999));
+
+  /* alternating bools stay a bitmap */
+  TypedColumn<bool> alternating;
+  for (int i = 0; i < 10000; i++)
+    alternating.push(i % 2 == 0);
+  alternating.compact();
+  EXPECT_FALSE(alternating.is_compressed());
+}
+
+TEST_F(TestColumn, test_zone_map) {
+  TypedColumn<int> col;
+  for (int i = 0; i < 100; i++) {
+    if (i % 10 == 0)
+      col.push();
+    else
+      col.push(i - 50);
+  }
+  EXPECT_FALSE(col.zone_map().known);
+  col.compact();
+  EXPECT_TRUE(col.zone_map().known);
+  EXPECT_EQ(col.zone_map().null_count, 10);
+  EXPECT_EQ(col.zone_map().min, -49);
+  EXPECT_EQ(col.zone_map().max, 49);
+  EXPECT_TRUE(col.zone_map().may_contain(49, 100));
+  EXPECT_FALSE(col.zone_map().may_contain(50, 100));
+
+  /* read back with the serialized column, copied or in place */
+  WriteCursor wc;
+  col.serialize(wc);
+  ReadCursor rc = wc;
+  unique_ptr<Column> view(Column::create_view(Data::Type::INT));
+  view->fill(100, rc);
+  EXPECT_TRUE(view->zone_map().known);
+  EXPECT_EQ(view->zone_map().min, -49);
+  EXPECT_EQ(view->zone_map().null_count, 10);
+
+  /* modifying makes it unknown until computed again */
+  col.set(0, 1000);
+  EXPECT_FALSE(col.zone_map().known);
+  EXPECT_TRUE(col.zone_map().may_contain(1000, 1000));
+  col.compute_zone_map();
+  EXPECT_EQ(col.zone_map().max, 1000);
+  EXPECT_EQ(col.zone_map().null_count, 9);
+
+  /* strings only count missing values */
+  TypedColumn<string *> sc;
+  string s("a");
+  sc.push(&s);
+  sc.push();
+  sc.compute_zone_map();
+  EXPECT_EQ(sc.zone_map().null_count, 1);
+  EXPECT_GT(sc.zone_map().min, sc.zone_map().max);
+}
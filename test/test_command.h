@@ -1,6 +1,7 @@
 #pragma once
 
 #include "kv/command.h"
+#include "sample_rowers.h"
 #include <algorithm>
 #include <cstring>
 #include <iostream>
@@ -29,6 +30,23 @@ TEST(TestPutCommand, test_serialize_unpack) {
   EXPECT_TRUE(cmd == *cmd2);
 }
 
+TEST(TestPutCommand, test_serialize_chunk) {
+  auto s = "Hello world";
+  DataChunk dc(sized_ptr(strlen(s) + 1, (uint8_t *)s), true);
+  PutCommand cmd(ChunkKey("apples", 3), dc);
+  WriteCursor expected;
+  cmd.serialize(expected);
+
+  /* the chunk written in place gives the same bytes */
+  WriteCursor wc;
+  PutCommand::serialize_chunk(wc, ChunkKey("apples", 3), [&](WriteCursor &wc) {
+    wc.ensure_space(dc.len());
+    wc.write(dc.len(), dc.data().ptr);
+  });
+  ASSERT_EQ(wc.length(), expected.length());
+  EXPECT_TRUE(equal(wc.begin(), wc.end(), expected.begin()));
+}
+
 TEST(TestNewCommand, test_serialize_unpack) {
   NewCommand cmd(Key("apples"), Schema("IFSB"));
   WriteCursor wc;
@@ -50,6 +68,19 @@ TEST(TestStartMapCommand, test_serialize_unpack) {
   EXPECT_TRUE(cmd == *cmd2);
 }
 
+TEST(TestFetchMapResultCommand, test_serialize_unpack) {
+  for (bool wait : {true, false}) {
+    FetchMapResultCommand cmd(1234, wait);
+    WriteCursor wc;
+    cmd.serialize(wc);
+
+    ReadCursor rc = wc;
+    unique_ptr<Command> cmd2 = Command::unpack(rc);
+    EXPECT_TRUE(cmd == *cmd2);
+    EXPECT_FALSE(FetchMapResultCommand(1234, !wait) == *cmd2);
+  }
+}
+
 TEST(TestGetOwnedCommand, test_serialize_unpack) {
   GetDFInfoCommand cmd;
   WriteCursor wc;
@@ -74,7 +105,7 @@ public:
       sprintf(buf, "owned %d", i);
       Key key(buf);
       Schema scm("IFSB");
-      PartialDataFrame &pdf = kv->add_pdf(key, scm);
+      PartialDataFrame &pdf = *kv->add_pdf(key, scm);
 
       /* create chunk at 0 */
       DataFrameChunk dfc(scm);
@@ -82,7 +113,8 @@ public:
       for (int i = 0; i < 100; i++) {
         row.set(0, i);
         row.set(1, i * 0.5f);
-        row.set(2, new string("iii"));
+        string s("iii");
+        row.set(2, &s);
         row.set(3, i % 2 == 0);
         dfc.add_row(row);
       }
@@ -100,7 +132,7 @@ public:
       sprintf(buf, "not-owned %d", i);
       Key key(buf);
       Schema scm("IFSB");
-      PartialDataFrame &pdf = kv->add_pdf(key, scm);
+      PartialDataFrame &pdf = *kv->add_pdf(key, scm);
 
       /* create chunk at chunk_idx */
       DataFrameChunk dfc(scm);
@@ -108,7 +140,8 @@ public:
       for (int i = 0; i < 100; i++) {
         row.set(0, i);
         row.set(1, i * 0.5f);
-        row.set(2, new string("iii"));
+        string s("iii");
+        row.set(2, &s);
         row.set(3, i % 2 == 0);
         dfc.add_row(row);
       }
@@ -138,7 +171,7 @@ public:
 
 TEST_F(TestCommandRun, test_put) {
   Key key(string("not-owned 0"));
-  const PartialDataFrame &pdf = kv->get_pdf(key);
+  const PartialDataFrame &pdf = *kv->get_pdf(key);
   int chunk_idx = 2; // insert chunk to follow chunk_idx: 1
   /* expect chunk not in PDF yet */
   EXPECT_FALSE(pdf.has_chunk(chunk_idx));
@@ -150,7 +183,8 @@ TEST_F(TestCommandRun, test_put) {
   for (int i = 0; i < 100; i++) {
     row.set(0, i);
     row.set(1, i * 0.5f);
-    row.set(2, new string("iii"));
+    string s("iii");
+    row.set(2, &s);
     row.set(3, i % 2 == 0);
     dfc.add_row(row);
   }
@@ -167,6 +201,69 @@ TEST_F(TestCommandRun, test_put) {
   EXPECT_TRUE(pdf.has_chunk(chunk_idx));
   /* expect chunk to be the one we added */
   EXPECT_TRUE(pdf.get_chunk(chunk_idx) == dfc);
+  /* read in place from the command's data */
+  EXPECT_TRUE(pdf.get_chunk(chunk_idx).is_view());
+}
+
+TEST_F(TestCommandRun, test_put__bad_chunk) {
+  Key key(string("not-owned 0"));
+  const PartialDataFrame &pdf = *kv->get_pdf(key);
+  const Schema &scm = pdf.get_schema();
+  WriteCursor wc;
+  pdf.get_chunk(1).serialize(wc);
+  DataChunk good(move(wc));
+
+  /* cut short, nothing is added */
+  PutCommand short_cmd(ChunkKey(key, 2),
+                       DataChunk(good.len() / 2, good.ptr()));
+  short_cmd.run(*kv, 0, get_respond());
+  EXPECT_FALSE(result);
+  EXPECT_FALSE(pdf.has_chunk(2));
+
+  /* from another version, the chunk it would replace is kept */
+  WriteCursor stale;
+  stale.ensure_space(good.len());
+  stale.write(good.len(), good.data().ptr);
+  uint32_t version = DF_CHUNK_FORMAT_VERSION + 1;
+  memcpy(stale.begin(), &version, sizeof(version));
+  PutCommand stale_cmd(ChunkKey(key, 1), move(stale));
+  stale_cmd.run(*kv, 0, get_respond());
+  EXPECT_FALSE(result);
+  EXPECT_TRUE(pdf.has_chunk(1));
+  ReadCursor rc(good.data());
+  EXPECT_TRUE(pdf.get_chunk(1) == DataFrameChunk(scm, rc));
+}
+
+TEST_F(TestCommandRun, test_put__packet_cut_short) {
+  Key key(string("not-owned 0"));
+  const PartialDataFrame &pdf = *kv->get_pdf(key);
+  WriteCursor chunk_wc;
+  pdf.get_chunk(1).serialize(chunk_wc);
+  int chunk_len = chunk_wc.length();
+  WriteCursor wc;
+  PutCommand(ChunkKey(key, 2), move(chunk_wc)).serialize(wc);
+  int chunk_start = wc.length() - chunk_len;
+
+  /* the packet ends before the chunk it says it holds */
+  for (int cut = chunk_start; cut < wc.length(); cut += 97) {
+    ReadCursor rc(cut, wc.begin());
+    unique_ptr<Command> cmd = Command::unpack(rc);
+    cmd->run(*kv, 0, get_respond());
+    EXPECT_FALSE(result) << "at " << cut;
+  }
+  EXPECT_FALSE(pdf.has_chunk(2));
+
+  /* a negative length, the last one before the chunk */
+  int len_at = chunk_start - sizeof(int);
+  while (memcmp(wc.begin() + len_at, &chunk_len, sizeof(int)) != 0)
+    len_at--;
+  int bad_len = -chunk_len;
+  memcpy(wc.begin() + len_at, &bad_len, sizeof(int));
+  ReadCursor rc = wc;
+  unique_ptr<Command> cmd = Command::unpack(rc);
+  cmd->run(*kv, 0, get_respond());
+  EXPECT_FALSE(result);
+  EXPECT_FALSE(pdf.has_chunk(2));
 }
 
 TEST_F(TestCommandRun, test_get) {
@@ -177,8 +274,8 @@ TEST_F(TestCommandRun, test_get) {
   EXPECT_TRUE(result);
 
   ReadCursor rc(output->data());
-  DataFrameChunk dfc(kv->get_pdf(key).get_schema(), rc);
-  EXPECT_TRUE(dfc == kv->get_pdf(key).get_chunk(1));
+  DataFrameChunk dfc(kv->get_pdf(key)->get_schema(), rc);
+  EXPECT_TRUE(dfc == kv->get_pdf(key)->get_chunk(1));
 
   GetCommand err_cmd(key, 0);
   err_cmd.run(*kv, 0, get_respond());
@@ -188,6 +285,32 @@ TEST_F(TestCommandRun, test_get) {
   EXPECT_EQ(output->len(), 0);
 }
 
+TEST_F(TestCommandRun, test_get__projection) {
+  Key key(string("not-owned 0"));
+  const PartialDataFrame &pdf = *kv->get_pdf(key);
+  GetCommand full_cmd(key, 1);
+  full_cmd.run(*kv, 0, get_respond());
+  int full_len = output->len();
+
+  /* only the float column is sent */
+  GetCommand cmd(key, 1, {1});
+  cmd.run(*kv, 0, get_respond());
+  EXPECT_TRUE(result);
+  EXPECT_LT(output->len(), full_len / 2);
+
+  ReadCursor rc(output->data());
+  DataFrameChunk dfc(pdf.get_schema(), rc);
+  const DataFrameChunk &expected = pdf.get_chunk(1);
+  EXPECT_EQ(dfc.nrows(), expected.nrows());
+  for (int y = 0; y < dfc.nrows(); y++) {
+    EXPECT_EQ(dfc.get_float(y, 1), expected.get_float(y, 1));
+    EXPECT_TRUE(dfc.is_missing(y, 0));
+    EXPECT_TRUE(dfc.is_missing(y, 2));
+    EXPECT_TRUE(dfc.is_missing(y, 3));
+  }
+  EXPECT_EQ(dfc.zone_map(0).null_count, dfc.nrows());
+}
+
 TEST_F(TestCommandRun, test_new) {
   Key new_key(string("new df"));
   Schema scm("IIII");
@@ -201,7 +324,7 @@ TEST_F(TestCommandRun, test_new) {
   /* expect PDF was added to KVStore */
   EXPECT_TRUE(kv->has_pdf(new_key));
   /* expect has correct Schema */
-  EXPECT_TRUE(kv->get_pdf(new_key).get_schema() == scm);
+  EXPECT_TRUE(kv->get_pdf(new_key)->get_schema() == scm);
 }
 
 TEST_F(TestCommandRun, test_start_map__fetch_map) {
@@ -219,8 +342,103 @@ TEST_F(TestCommandRun, test_start_map__fetch_map) {
   EXPECT_TRUE(result);
 
   ReadCursor rc2(output->data());
+  pair<int, int> progress;
+  EXPECT_TRUE(FetchMapResultCommand::unpack_progress(rc2, progress));
   EXPECT_EQ(rower->get_sum_result(), yield<uint64_t>(rc2));
   EXPECT_TRUE(empty(rc));
+
+  /* result is removed once fetched */
+  fetch_cmd.run(*kv, 0, get_respond());
+  EXPECT_FALSE(result);
+}
+
+TEST_F(TestCommandRun, test_start_map__runs_in_background) {
+  Key key(string("owned 0"));
+  auto gate = make_shared<atomic<bool>>(false);
+  auto rower = make_shared<GatedCount>(gate);
+  StartMapCommand start_cmd(key, rower);
+  start_cmd.run(*kv, 0, get_respond());
+  EXPECT_TRUE(result);
+  ReadCursor rc(output->data());
+  int result_id = yield<int>(rc);
+
+  /* the map is held at the gate, but the Node still serves GETs */
+  GetCommand get_cmd(key, 0);
+  get_cmd.run(*kv, 0, get_respond());
+  EXPECT_TRUE(result);
+
+  FetchMapResultCommand poll_cmd(result_id, false);
+  poll_cmd.run(*kv, 0, get_respond());
+  EXPECT_TRUE(result);
+  ReadCursor rc2(output->data());
+  pair<int, int> progress;
+  EXPECT_FALSE(FetchMapResultCommand::unpack_progress(rc2, progress));
+  EXPECT_EQ(progress.first, 0);
+  EXPECT_EQ(progress.second, 1);
+
+  *gate = true;
+  FetchMapResultCommand fetch_cmd(result_id);
+  fetch_cmd.run(*kv, 0, get_respond());
+  EXPECT_TRUE(result);
+  ReadCursor rc3(output->data());
+  EXPECT_TRUE(FetchMapResultCommand::unpack_progress(rc3, progress));
+  EXPECT_EQ(yield<int>(rc3), 100);
+}
+
+TEST_F(TestCommandRun, test_start_map__delete_while_running) {
+  Key key(string("owned 0"));
+  auto gate = make_shared<atomic<bool>>(false);
+  StartMapCommand start_cmd(key, make_shared<GatedCount>(gate));
+  start_cmd.run(*kv, 0, get_respond());
+  EXPECT_TRUE(result);
+  ReadCursor rc(output->data());
+  int result_id = yield<int>(rc);
+
+  /* the DELETE doesn't wait for the map, which keeps its chunks */
+  DeleteCommand delete_cmd(key);
+  delete_cmd.run(*kv, 0, get_respond());
+  EXPECT_TRUE(result);
+  EXPECT_FALSE(kv->has_pdf(key));
+
+  *gate = true;
+  FetchMapResultCommand fetch_cmd(result_id);
+  fetch_cmd.run(*kv, 0, get_respond());
+  EXPECT_TRUE(result);
+  ReadCursor rc2(output->data());
+  pair<int, int> progress;
+  EXPECT_TRUE(FetchMapResultCommand::unpack_progress(rc2, progress));
+  EXPECT_EQ(yield<int>(rc2), 100);
+}
+
+TEST_F(TestCommandRun, test_start_map__while_another_runs) {
+  Key key(string("owned 0"));
+  auto gate = make_shared<atomic<bool>>(false);
+  vector<int> result_ids;
+  /* the second map starts while the first is held at the gate */
+  for (int i = 0; i < 2; i++) {
+    StartMapCommand start_cmd(key, make_shared<GatedCount>(gate));
+    start_cmd.run(*kv, 0, get_respond());
+    EXPECT_TRUE(result);
+    ReadCursor rc(output->data());
+    result_ids.push_back(yield<int>(rc));
+  }
+
+  *gate = true;
+  for (int result_id : result_ids) {
+    FetchMapResultCommand fetch_cmd(result_id);
+    fetch_cmd.run(*kv, 0, get_respond());
+    EXPECT_TRUE(result);
+    ReadCursor rc(output->data());
+    pair<int, int> progress;
+    EXPECT_TRUE(FetchMapResultCommand::unpack_progress(rc, progress));
+    EXPECT_EQ(yield<int>(rc), 100);
+  }
+}
+
+TEST_F(TestCommandRun, test_fetch_map__unknown_id) {
+  FetchMapResultCommand fetch_cmd(12345);
+  fetch_cmd.run(*kv, 0, get_respond());
+  EXPECT_FALSE(result);
 }
 
 TEST_F(TestCommandRun, test_get_df_info) {
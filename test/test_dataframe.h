@@ -29,13 +29,14 @@ TEST_F(TestDataFrame, test__add_row__get__nrows) {
   /* add row */
   Row r(df->get_schema());
   r.set(0, 0);
-  r.set(1, new string("apples"));
+  string s("apples");
+  r.set(1, &s);
   r.set(2, 66.2f);
   r.set(3, false);
   df->add_row(r);
   EXPECT_EQ(df->nrows(), 1);
   EXPECT_EQ(df->get_int(0, 0), 0);
-  EXPECT_STREQ(df->get_string(0, 1)->c_str(), "apples");
+  EXPECT_STREQ(df->get_string(0, 1).c_str(), "apples");
   EXPECT_EQ(df->get_float(0, 2), 66.2f);
   EXPECT_EQ(df->get_bool(0, 3), false);
 
@@ -45,14 +46,14 @@ TEST_F(TestDataFrame, test__add_row__get__nrows) {
   /* add lots of rows */
   for (int i = 1; i < 1000; i++) {
     r.set(0, i);
-    r.set(1, new string("apples"));
+    r.set(1, &s);
     r.set(2, i * 3.3f);
     r.set(3, i % 3 == 0);
     df->add_row(r);
   }
   for (int i = 1; i < 1000; i++) {
     EXPECT_EQ(df->get_int(i, 0), i);
-    EXPECT_STREQ(df->get_string(i, 1)->c_str(), "apples");
+    EXPECT_STREQ(df->get_string(i, 1).c_str(), "apples");
     EXPECT_EQ(df->get_float(i, 2), i * 3.3f);
     EXPECT_EQ(df->get_bool(i, 3), i % 3 == 0);
   }
@@ -68,7 +69,8 @@ TEST_F(TestDataFrame, test_set) {
   for (int i = 0; i < 100; i++) {
     r.set(0, i);
     sprintf(buf, "hello %d", i);
-    r.set(1, new string(buf));
+    string s(buf);
+    r.set(1, &s);
     r.set(2, i * 3.3f);
     r.set(3, i % 3 == 0);
     df->add_row(r);
@@ -89,7 +91,8 @@ TEST_F(TestDataFrame, test_map) {
   for (int i = 0; i < 100; i++) {
     r.set(0, i);
     sprintf(buf, "hello %d", i);
-    r.set(1, new string(buf));
+    string s(buf);
+    r.set(1, &s);
     r.set(2, i * 3.3f);
     r.set(3, i % 3 == 0);
     df->add_row(r);
@@ -107,7 +110,8 @@ TEST_F(TestDataFrame, test_filter) {
   for (int i = 0; i < 100; i++) {
     r.set(0, i);
     sprintf(buf, "hello %d", i);
-    r.set(1, new string(buf));
+    string s(buf);
+    r.set(1, &s);
     r.set(2, i * 3.3f);
     r.set(3, i % 3 == 0);
     df->add_row(r);
@@ -135,7 +139,8 @@ TEST_F(TestDataFrame, test_equals) {
   for (int i = 0; i < 5; i++) {
     r.set(0, i);
     sprintf(buf, "hello %d", i);
-    r.set(1, new string(buf));
+    string s(buf);
+    r.set(1, &s);
     r.set(2, i * 3.3f);
     r.set(3, i % 3 == 0);
     df->add_row(r);
@@ -145,15 +150,17 @@ TEST_F(TestDataFrame, test_equals) {
   for (int i = 0; i < 5; i++) {
     r.set(0, i);
     sprintf(buf, "hello %d", i);
-    r.set(1, new string(buf));
+    string s(buf);
+    r.set(1, &s);
     r.set(2, i * 3.3f);
     r.set(3, i % 3 == 0);
     df2->add_row(r);
   }
 
   EXPECT_TRUE(df->equals(*df2));
-  df->set(4, 1, new string("333"));
+  string s("333");
+  df->set(4, 1, &s);
   EXPECT_FALSE(df->equals(*df2));
-  df2->set(4, 1, new string("333"));
+  df2->set(4, 1, &s);
   EXPECT_TRUE(df2->equals(*df));
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "kv/data_chunk.h"
 #include "lib/dataframe_chunk.h"
+#include "lib/rowers.h"
 
 class TestDataFrameChunk : public ::testing::Test {
 public:
@@ -28,13 +30,14 @@ TEST_F(TestDataFrameChunk, test__add_row__get__nrows) {
   /* add row */
   Row r(df->get_schema());
   r.set(0, 0);
-  r.set(1, new string("apples"));
+  string s("apples");
+  r.set(1, &s);
   r.set(2, 66.2f);
   r.set(3, false);
   df->add_row(r);
   EXPECT_EQ(df->nrows(), 1);
   EXPECT_EQ(df->get_int(0, 0), 0);
-  EXPECT_STREQ(df->get_string(0, 1)->c_str(), "apples");
+  EXPECT_STREQ(df->get_string(0, 1).c_str(), "apples");
   EXPECT_EQ(df->get_float(0, 2), 66.2f);
   EXPECT_EQ(df->get_bool(0, 3), false);
 
@@ -44,14 +47,14 @@ TEST_F(TestDataFrameChunk, test__add_row__get__nrows) {
   /* add lots of rows */
   for (int i = 1; i < 1000; i++) {
     r.set(0, i);
-    r.set(1, new string("apples"));
+    r.set(1, &s);
     r.set(2, i * 3.3f);
     r.set(3, i % 3 == 0);
     df->add_row(r);
   }
   for (int i = 1; i < 1000; i++) {
     EXPECT_EQ(df->get_int(i, 0), i);
-    EXPECT_STREQ(df->get_string(i, 1)->c_str(), "apples");
+    EXPECT_STREQ(df->get_string(i, 1).c_str(), "apples");
     EXPECT_EQ(df->get_float(i, 2), i * 3.3f);
     EXPECT_EQ(df->get_bool(i, 3), i % 3 == 0);
   }
@@ -67,7 +70,8 @@ TEST_F(TestDataFrameChunk, test_equals) {
   for (int i = 0; i < 5; i++) {
     r.set(0, i);
     sprintf(buf, "hello %d", i);
-    r.set(1, new string(buf));
+    string s(buf);
+    r.set(1, &s);
     r.set(2, i * 3.3f);
     r.set(3, i % 3 == 0);
     df->add_row(r);
@@ -77,7 +81,8 @@ TEST_F(TestDataFrameChunk, test_equals) {
   for (int i = 0; i < 5; i++) {
     r.set(0, i);
     sprintf(buf, "hello %d", i);
-    r.set(1, new string(buf));
+    string s(buf);
+    r.set(1, &s);
     r.set(2, i * 3.3f);
     r.set(3, i % 3 == 0);
     df2->add_row(r);
@@ -85,3 +90,239 @@ TEST_F(TestDataFrameChunk, test_equals) {
 
   EXPECT_TRUE(df->equals(*df2));
 }
+
+TEST_F(TestDataFrameChunk, test_fill__view_of_owned_bytes) {
+  DataFrameChunk dfc(*scm);
+  Row r(*scm);
+  string s;
+  for (int i = 0; i < 1000; i++) {
+    r.set(0, i);
+    s = "s" + to_string(i % 13);
+    r.set(1, &s);
+    r.set(2, i * 0.5f);
+    r.set(3, i % 3 == 0);
+    if (i % 7 == 0)
+      r.set_missing(i % 4);
+    dfc.add_row(r);
+  }
+
+  optional<DataFrameChunk> view;
+  {
+    WriteCursor wc;
+    dfc.serialize(wc);
+    DataChunk data(move(wc));
+    ReadCursor rc = data.cursor();
+    view.emplace(*scm, rc);
+    EXPECT_EQ(rc.cursor, rc.bytes_end);
+  }
+  /* the view keeps the bytes alive after the DataChunk is gone */
+  EXPECT_TRUE(view->is_view());
+  EXPECT_EQ(view->nrows(), 1000);
+  EXPECT_TRUE(*view == dfc);
+  EXPECT_TRUE(dfc == *view);
+  EXPECT_EQ(view->get_string(27, 1), "s1");
+  EXPECT_TRUE(view->is_missing(14, 2));
+
+  /* serializing the view gives back the same bytes */
+  WriteCursor wc1, wc2;
+  dfc.serialize(wc1);
+  view->serialize(wc2);
+  ASSERT_EQ(wc1.length(), wc2.length());
+  EXPECT_EQ(memcmp(wc1.begin(), wc2.begin(), wc1.length()), 0);
+
+  /* without an owner the bytes are copied */
+  ReadCursor rc = wc2;
+  DataFrameChunk copy(*scm, rc);
+  EXPECT_FALSE(copy.is_view());
+  EXPECT_TRUE(copy == dfc);
+}
+
+TEST_F(TestDataFrameChunk, test_fill__rejects_bad_bytes) {
+  DataFrameChunk dfc(*scm);
+  Row r(*scm);
+  string s;
+  for (int i = 0; i < 1000; i++) {
+    r.set(0, i);
+    s = "s" + to_string(i % 13);
+    r.set(1, &s);
+    r.set(2, i * 0.5f);
+    r.set(3, i % 3 == 0);
+    dfc.add_row(r);
+  }
+
+  /* plain, then packed and dictionary-encoded */
+  for (int finalized = 0; finalized < 2; finalized++) {
+    if (finalized)
+      dfc.finalize();
+    WriteCursor wc;
+    dfc.serialize(wc);
+    DataChunk data(move(wc));
+    ReadCursor full = data.cursor();
+    long len = full.length();
+
+    /* a chunk cut short anywhere before its last padding, read in place or
+     * copied */
+    for (long cut = 0; cut <= len - CHUNK_ALIGN; cut++) {
+      ReadCursor view_rc(cut, full.cursor, full.owner);
+      EXPECT_FALSE(DataFrameChunk(*scm).fill(view_rc)) << "at " << cut;
+      ReadCursor copy_rc(cut, full.cursor);
+      EXPECT_FALSE(DataFrameChunk(*scm).fill(copy_rc)) << "at " << cut;
+    }
+
+    /* a chunk from another version of the format */
+    uint32_t version = DF_CHUNK_FORMAT_VERSION + 1;
+    memcpy(full.cursor, &version, sizeof(version));
+    EXPECT_FALSE(DataFrameChunk(*scm).fill(full));
+  }
+}
+
+TEST_F(TestDataFrameChunk, test_fill_row__string_views) {
+  DataFrameChunk dfc(*scm);
+  Row r(*scm);
+  string s;
+  for (int i = 0; i < 10; i++) {
+    r.set(0, i);
+    s = "word" + to_string(i % 3);
+    r.set(1, &s);
+    r.set(2, i * 0.5f);
+    r.set(3, false);
+    dfc.add_row(r);
+  }
+
+  /* rows read strings in place from the chunk's arena */
+  Row out(*scm);
+  dfc.fill_row(4, out);
+  EXPECT_EQ(out.get<string_view>(1), "word1");
+  EXPECT_EQ(out.get<string_view>(1).data(), dfc.get_string_view(4, 1).data());
+
+  /* and from a view of the serialized chunk */
+  WriteCursor wc;
+  dfc.serialize(wc);
+  DataChunk data(move(wc));
+  ReadCursor rc = data.cursor();
+  DataFrameChunk view(*scm, rc);
+  view.fill_row(8, out);
+  EXPECT_EQ(out.get<string_view>(1), "word2");
+
+  WordCountRower wcr(1);
+  view.map(wcr);
+  EXPECT_EQ(wcr.get_results().size(), 3);
+  EXPECT_EQ(wcr.get_results().at("word0"), 4);
+  EXPECT_EQ(wcr.get_results().at("word2"), 3);
+}
+
+TEST_F(TestDataFrameChunk, test_finalize__dict_encodes_strings) {
+  DataFrameChunk dfc(*scm);
+  Row r(*scm);
+  string s;
+  for (int i = 0; i < 1000; i++) {
+    r.set(0, i);
+    s = "word" + to_string(i % 7);
+    r.set(1, &s);
+    r.set(2, i * 0.5f);
+    r.set(3, false);
+    if (i % 11 == 0)
+      r.set_missing(1);
+    dfc.add_row(r);
+  }
+  WriteCursor plain_wc;
+  dfc.serialize(plain_wc);
+
+  WordCountRower by_row(1);
+  dfc.map(by_row);
+
+  dfc.finalize();
+  EXPECT_EQ(dfc.get_column(1).dict_size(), 7);
+  EXPECT_EQ(dfc.get_string_view(15, 1), "word1");
+  EXPECT_TRUE(dfc.is_missing(22, 1));
+
+  /* smaller on the wire and read as a view */
+  WriteCursor wc;
+  dfc.serialize(wc);
+  EXPECT_LT(wc.length(), plain_wc.length());
+  DataChunk data(move(wc));
+  ReadCursor rc = data.cursor();
+  DataFrameChunk view(*scm, rc);
+  EXPECT_TRUE(view == dfc);
+
+  /* counting on codes gives the same results as counting rows */
+  WordCountRower by_code(1);
+  EXPECT_TRUE(by_code.accept_chunk(view));
+  EXPECT_EQ(by_code.get_results(), by_row.get_results());
+  EXPECT_EQ(by_code.get_results().at("word3"), 130);
+}
+
+TEST_F(TestDataFrameChunk, test_finalize__packs_ints) {
+  DataFrameChunk dfc(*scm);
+  Row r(*scm);
+  string s("word");
+  uint64_t sum = 0;
+  for (int i = 0; i < 1000; i++) {
+    r.set(0, 1000 + i);
+    r.set(1, &s);
+    r.set(2, i * 0.5f);
+    r.set(3, i < 500);
+    dfc.add_row(r);
+    sum += 1000 + i;
+  }
+  WriteCursor plain_wc;
+  dfc.serialize(plain_wc);
+
+  dfc.finalize();
+  WriteCursor wc;
+  dfc.serialize(wc);
+  EXPECT_LT(wc.length(), plain_wc.length() * 2 / 3); // floats stay plain
+  WriteCursor int_wc;
+  dfc.get_column(0).serialize(int_wc);
+  EXPECT_LT(int_wc.length(), 400); // 1000 ints in a few hundred bytes
+  EXPECT_EQ(dfc.get_int(600, 0), 1600);
+  EXPECT_FALSE(dfc.get_bool(600, 3));
+
+  DataChunk data(move(wc));
+  ReadCursor rc = data.cursor();
+  DataFrameChunk view(*scm, rc);
+  EXPECT_TRUE(view == dfc);
+
+  SumRower by_row(0), by_batch(0);
+  view.DataFrame::map(by_row);
+  view.map(by_batch);
+  EXPECT_EQ(by_row.get_sum_result(), sum);
+  EXPECT_EQ(by_batch.get_sum_result(), sum);
+}
+
+TEST_F(TestDataFrameChunk, test_serialize__projection) {
+  DataFrameChunk dfc(*scm);
+  Row r(*scm);
+  string s("word");
+  for (int i = 0; i < 1000; i++) {
+    r.set(0, i * 7);
+    r.set(1, &s);
+    r.set(2, i * 0.5f);
+    r.set(3, i % 2 == 0);
+    dfc.add_row(r);
+  }
+  WriteCursor full_wc;
+  dfc.serialize(full_wc);
+  WriteCursor wc;
+  dfc.serialize(wc, {0, 3});
+  EXPECT_LT(wc.length(), full_wc.length());
+
+  /* a view reads the projected columns in place, omitted columns are missing */
+  DataChunk data(move(wc));
+  ReadCursor rc = data.cursor();
+  DataFrameChunk view(*scm, rc);
+  EXPECT_EQ(view.nrows(), 1000);
+  for (int y = 0; y < 1000; y++) {
+    EXPECT_EQ(view.get_int(y, 0), y * 7);
+    EXPECT_EQ(view.get_bool(y, 3), y % 2 == 0);
+    EXPECT_TRUE(view.is_missing(y, 1));
+    EXPECT_TRUE(view.is_missing(y, 2));
+  }
+
+  /* a view of a projection serializes as the same projection */
+  WriteCursor wc2;
+  view.serialize(wc2);
+  ReadCursor rc2 = wc2;
+  DataFrameChunk copy(*scm, rc2);
+  EXPECT_TRUE(copy == view);
+}
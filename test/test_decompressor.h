@@ -0,0 +1,128 @@
+#pragma once
+
+#include "sdk/stream_parser.h"
+#include "utils/decompressor.h"
+#include <cstdio>
+#include <string>
+
+class TestDecompressor : public ::testing::Test {
+public:
+  FILE *tmp = nullptr;
+
+  void TearDown() {
+    if (tmp)
+      fclose(tmp);
+  }
+
+  /* gzip compress src, as the gzip tool would */
+  static string gzip(const string &src) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    /* 16 writes a gzip header instead of a zlib one */
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                 Z_DEFAULT_STRATEGY);
+    string dest(deflateBound(&zs, src.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(src.data()));
+    zs.avail_in = src.size();
+    zs.next_out = reinterpret_cast<Bytef *>(&dest[0]);
+    zs.avail_out = dest.size();
+    deflate(&zs, Z_FINISH);
+    dest.resize(zs.total_out);
+    deflateEnd(&zs);
+    return dest;
+  }
+
+  /* fd of a temp file holding bytes, positioned at the start */
+  int temp_fd(const string &bytes) {
+    tmp = tmpfile();
+    fwrite(bytes.data(), 1, bytes.size(), tmp);
+    fflush(tmp);
+    int fd = fileno(tmp);
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+  }
+
+  static string build_sor(int n_rows) {
+    string sor;
+    for (int i = 0; i < n_rows; i++) {
+      sor += "<" + to_string(i) + "><" + to_string(i % 2) + "><\"s" +
+             to_string(i % 7) + "\">\n";
+    }
+    return sor;
+  }
+
+  /* read everything from dec, n bytes at a time */
+  static long read_all(Decompressor &dec, string &dest, long n) {
+    char buf[n];
+    long res;
+    while ((res = dec.read(buf, n)) > 0)
+      dest.append(buf, res);
+    return res;
+  }
+};
+
+TEST_F(TestDecompressor, test_codec_for) {
+  EXPECT_EQ(Decompressor::codec_for("data.sor.gz"), Decompressor::Codec::GZIP);
+  EXPECT_EQ(Decompressor::codec_for("data.sor.zst"),
+            Decompressor::Codec::ZSTD);
+  EXPECT_EQ(Decompressor::codec_for("data.sor"), Decompressor::Codec::NONE);
+  EXPECT_EQ(Decompressor::codec_for("gz"), Decompressor::Codec::NONE);
+  EXPECT_TRUE(Decompressor::supported(Decompressor::Codec::GZIP));
+  EXPECT_FALSE(Decompressor::supported(Decompressor::Codec::NONE));
+}
+
+TEST_F(TestDecompressor, test_read__gzip) {
+  /* several decompressed blocks worth so the queue fills up */
+  string sor = build_sor(DECOMPRESS_BLOCK_SIZE / 2);
+  ASSERT_GT(sor.size(), DECOMPRESS_BLOCK_SIZE * (DECOMPRESS_QUEUE_LEN + 1));
+  Decompressor dec(temp_fd(gzip(sor)), Decompressor::Codec::GZIP);
+  string actual;
+  EXPECT_EQ(read_all(dec, actual, 4099), 0);
+  EXPECT_EQ(actual, sor);
+}
+
+TEST_F(TestDecompressor, test_read__concatenated_members) {
+  Decompressor dec(temp_fd(gzip("<1>\n<2>\n") + gzip("<3>\n")),
+                   Decompressor::Codec::GZIP);
+  string actual;
+  EXPECT_EQ(read_all(dec, actual, 3), 0);
+  EXPECT_EQ(actual, "<1>\n<2>\n<3>\n");
+}
+
+TEST_F(TestDecompressor, test_read__corrupt) {
+  string gz = gzip(build_sor(1000));
+  /* truncated input is an error, not a short file */
+  Decompressor dec(temp_fd(gz.substr(0, gz.size() / 2)),
+                   Decompressor::Codec::GZIP);
+  string actual;
+  EXPECT_EQ(read_all(dec, actual, 1024), -1);
+}
+
+TEST_F(TestDecompressor, test_destroy_before_end) {
+  /* the decompression thread is blocked on a full queue */
+  Decompressor dec(temp_fd(gzip(build_sor(DECOMPRESS_BLOCK_SIZE / 2))),
+                   Decompressor::Codec::GZIP);
+  char buf[16];
+  EXPECT_EQ(dec.read(buf, sizeof(buf)), sizeof(buf));
+}
+
+TEST_F(TestDecompressor, test_stream_parser) {
+  string sor = build_sor(DF_CHUNK_SIZE * 2.5);
+  Schema scm("IBS");
+  Decompressor dec(temp_fd(gzip(sor)), Decompressor::Codec::GZIP);
+  StreamParser sparser([&dec](char *buf, long n) { return dec.read(buf, n); });
+  Schema inferred;
+  EXPECT_TRUE(sparser.infer_schema(inferred));
+  EXPECT_EQ(inferred, scm);
+
+  Parser parser(sor.size(), const_cast<char *>(sor.c_str()));
+  for (int i = 0; i < 3; i++) {
+    DataFrameChunk expected(scm), actual(scm);
+    EXPECT_TRUE(parser.parse_n_lines(DF_CHUNK_SIZE, expected));
+    EXPECT_TRUE(sparser.next_chunk(actual));
+    EXPECT_TRUE(actual == expected);
+  }
+  DataFrameChunk empty(scm);
+  EXPECT_FALSE(sparser.next_chunk(empty));
+  EXPECT_FALSE(sparser.read_error());
+}
@@ -11,7 +11,7 @@ TEST(TestKVStore, test__add_pdf__get_pdf) {
   KVStore kv_store;
   kv_store.add_pdf("apples", "IIII");
   EXPECT_TRUE(kv_store.has_pdf("apples"));
-  EXPECT_TRUE(kv_store.get_pdf("apples").get_schema() == Schema("IIII"));
+  EXPECT_TRUE(kv_store.get_pdf("apples")->get_schema() == Schema("IIII"));
 }
 
 TEST(TestKVStore, test__add_pdf__remove_pdf) {
@@ -44,8 +44,28 @@ TEST(TestKVStore, test_map_results) {
   kv_store.insert_map_result(
       id2, DataChunk(sized_ptr(strlen(s2), (uint8_t *)s2), true));
 
-  EXPECT_TRUE(kv_store.get_map_result(id) ==
+  EXPECT_TRUE(kv_store.find_map_job(id)->result ==
               DataChunk(sized_ptr(strlen(s), (uint8_t *)s), true));
-  EXPECT_TRUE(kv_store.get_map_result(id2) ==
+  EXPECT_TRUE(kv_store.find_map_job(id2)->result ==
               DataChunk(sized_ptr(strlen(s2), (uint8_t *)s2), true));
 }
+
+TEST(TestKVStore, test__find_map_job__outlives_remove) {
+  auto s = "Hello world";
+  KVStore kv_store;
+  EXPECT_FALSE(kv_store.find_map_job(rand()));
+
+  int id = kv_store.get_result_id();
+  shared_ptr<MapJob> job = kv_store.find_map_job(id);
+  EXPECT_TRUE(job);
+  EXPECT_FALSE(job->is_done());
+
+  kv_store.insert_map_result(
+      id, DataChunk(sized_ptr(strlen(s), (uint8_t *)s), true));
+  kv_store.remove_map_result(id);
+  EXPECT_FALSE(kv_store.find_map_job(id));
+  /* the job found before still holds the result */
+  EXPECT_TRUE(job->is_done());
+  EXPECT_TRUE(job->result ==
+              DataChunk(sized_ptr(strlen(s), (uint8_t *)s), true));
+}
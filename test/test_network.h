@@ -1,10 +1,155 @@
 #include "kv/kv.h"
+#include "network/channel.h"
 #include "network/node.h"
 #include "network/packet.h"
 #include "network/sock.h"
 #include "sdk/cluster.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 TEST(TestNetwork, compiles) {
   IpV4Addr ip_1("127.0.0.1");
   Node n_1(ip_1);
 }
+
+TEST(TestNetwork, test_node__serves_clients_in_parallel) {
+  IpV4Addr ip("127.0.0.1");
+  Node node(ip);
+  atomic<int> in_handler(0), max_in_handler(0);
+  node.set_data_handler([&](const IpV4Addr &src, ReadCursor &req,
+                            const Node::respond_fn_t &respond) {
+    int now = ++in_handler;
+    int seen = max_in_handler;
+    while (now > seen && !max_in_handler.compare_exchange_weak(seen, now))
+      ;
+    /* hold the handler a little, so requests overlap */
+    this_thread::sleep_for(chrono::milliseconds(5));
+    in_handler--;
+    /* echo the request */
+    respond(true, DataChunk(sized_ptr((int)req.length(), req.cursor), true));
+  });
+  thread server([&]() { node.start(); });
+
+  vector<thread> clients;
+  atomic<int> ok(0);
+  for (int c = 0; c < 4; c++)
+    clients.emplace_back([&, c]() {
+      for (int i = 0; i < 10; i++) {
+        WriteCursor wc;
+        pack(wc, c * 100 + i);
+        Packet resp = DataSock::fetch(
+            Packet(ip, ip, PacketType::DATA, DataChunk(move(wc))));
+        ReadCursor rc(resp.data.data());
+        ok += resp.ok() && yield<int>(rc) == c * 100 + i;
+      }
+    });
+  for (thread &t : clients)
+    t.join();
+  EXPECT_EQ(ok, 40);
+  EXPECT_GT(max_in_handler, 1);
+
+  Packet resp = DataSock::fetch(Packet(ip, ip, PacketType::SHUTDOWN));
+  EXPECT_TRUE(resp.ok());
+  server.join();
+}
+
+TEST(TestNetwork, test_channel_pool__pipelines_requests) {
+  IpV4Addr ip("127.0.0.1");
+  Node node(ip);
+  atomic<int> in_handler(0), max_in_handler(0);
+  node.set_data_handler([&](const IpV4Addr &src, ReadCursor &req,
+                            const Node::respond_fn_t &respond) {
+    int now = ++in_handler;
+    int seen = max_in_handler;
+    while (now > seen && !max_in_handler.compare_exchange_weak(seen, now))
+      ;
+    /* hold later requests longer, so responses come back out of order */
+    ReadCursor rc(req.length(), req.cursor);
+    this_thread::sleep_for(chrono::milliseconds(yield<int>(rc) % 7));
+    in_handler--;
+    respond(true, DataChunk(sized_ptr((int)req.length(), req.cursor), true));
+  });
+  thread server([&]() { node.start(); });
+
+  /* every request shares the pool's one connection to the node */
+  vector<thread> clients;
+  atomic<int> ok(0);
+  for (int c = 0; c < 4; c++)
+    clients.emplace_back([&, c]() {
+      for (int i = 0; i < 10; i++) {
+        WriteCursor wc;
+        pack(wc, c * 100 + i);
+        Packet resp = ChannelPool::shared().fetch(
+            Packet(ip, ip, PacketType::DATA, DataChunk(move(wc))));
+        ReadCursor rc(resp.data.data());
+        ok += resp.ok() && yield<int>(rc) == c * 100 + i;
+      }
+    });
+  for (thread &t : clients)
+    t.join();
+  EXPECT_EQ(ok, 40);
+  EXPECT_GT(max_in_handler, 1);
+
+  Packet resp =
+      ChannelPool::shared().fetch(Packet(ip, ip, PacketType::SHUTDOWN));
+  EXPECT_TRUE(resp.ok());
+  server.join();
+}
+
+TEST(TestNetwork, test_channel_pool__reconnects_to_restarted_node) {
+  IpV4Addr ip("127.0.0.1");
+  for (int run = 0; run < 2; run++) {
+    Node node(ip);
+    thread server([&]() { node.start(); });
+
+    Packet resp = ChannelPool::shared().fetch(Packet(ip, ip, PacketType::DATA));
+    EXPECT_TRUE(resp.ok());
+
+    Packet shutdown_resp =
+        ChannelPool::shared().fetch(Packet(ip, ip, PacketType::SHUTDOWN));
+    EXPECT_TRUE(shutdown_resp.ok());
+    server.join();
+  }
+}
+
+TEST(TestNetwork, test_data_sock__large_packets) {
+  IpV4Addr ip("127.0.0.1");
+  Node node(ip);
+  node.set_data_handler([&](const IpV4Addr &src, ReadCursor &req,
+                            const Node::respond_fn_t &respond) {
+    respond(true, DataChunk(sized_ptr((int)req.length(), req.cursor), true));
+  });
+  thread server([&]() { node.start(); });
+
+  int len = 8 * 1024 * 1024;
+  shared_ptr<uint8_t> bytes(new uint8_t[len], [](uint8_t *p) { delete[] p; });
+  for (int i = 0; i < len; i++)
+    bytes.get()[i] = i * 7 % 251;
+  DataChunk dc(len, bytes);
+
+  /* through the pool, one sendmsg and one recv each way */
+  Packet resp =
+      ChannelPool::shared().fetch(Packet(ip, ip, PacketType::DATA, dc));
+  ASSERT_TRUE(resp.ok());
+  EXPECT_TRUE(resp.data == dc);
+
+  /* on a socket of its own, straight from the caller's buffers */
+  DataSock sock(ip);
+  ASSERT_EQ(sock.connect(), 0);
+  Packet req(ip, ip, PacketType::DATA, dc);
+  uint8_t hdr[sizeof(PacketHeader)];
+  req.hdr.pack(hdr);
+  struct iovec iov[2] = {{hdr, sizeof(PacketHeader)},
+                         {bytes.get(), (size_t)len}};
+  EXPECT_EQ(sock.send_iov(iov, 2), sizeof(PacketHeader) + len);
+  Packet iov_resp = sock.get_pkt();
+  ASSERT_TRUE(iov_resp.ok());
+  EXPECT_TRUE(iov_resp.data == dc);
+
+  Packet shutdown_resp =
+      ChannelPool::shared().fetch(Packet(ip, ip, PacketType::SHUTDOWN));
+  EXPECT_TRUE(shutdown_resp.ok());
+  server.join();
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "lib/packed_ints.h"
+#include <random>
+
+/**
+ * encode the values, check the chosen encoding, and that every value reads
+ * back through get and through decode from a few offsets
+ */
+static void expect_round_trip(const vector<int32_t> &vals,
+                              PackedInts::Encoding expected) {
+  WriteCursor wc;
+  EXPECT_EQ(PackedInts::encode(vals.data(), vals.size(), wc), expected);
+  EXPECT_EQ(wc.length() % 8, 0);
+
+  ReadCursor rc = wc;
+  PackedInts packed;
+  packed.open(expected, vals.size(), rc);
+  EXPECT_EQ(rc.cursor, rc.bytes_end);
+  EXPECT_EQ(packed.byte_size(), wc.length());
+
+  for (int i = 0; i < vals.size(); i++)
+    ASSERT_EQ(packed.get(i), vals[i]) << "at " << i;
+  for (int start : {0, 1, 127, 128, 300}) {
+    if (start >= vals.size())
+      continue;
+    int n = vals.size() - start;
+    vector<int32_t> out(n);
+    packed.decode(start, n, out.data());
+    for (int i = 0; i < n; i++)
+      ASSERT_EQ(out[i], vals[start + i]) << "at " << start + i;
+  }
+}
+
+TEST(TestPackedInts, test_for) {
+  vector<int32_t> vals;
+  for (int i = 0; i < 1000; i++)
+    vals.push_back(1000000 + (i * 7919) % 1000); // 10 bits above the min
+  expect_round_trip(vals, PackedInts::Encoding::FOR);
+
+  WriteCursor wc;
+  PackedInts::encode(vals.data(), vals.size(), wc);
+  EXPECT_LT(wc.length(), vals.size() * 4 / 3);
+
+  for (int &v : vals)
+    v = -v; // negative values
+  expect_round_trip(vals, PackedInts::Encoding::FOR);
+}
+
+TEST(TestPackedInts, test_delta) {
+  vector<int32_t> vals;
+  for (int i = 0; i < 1000; i++)
+    vals.push_back(50000000 + i * 3 + i % 2); // sorted, wide range
+  expect_round_trip(vals, PackedInts::Encoding::DELTA);
+
+  for (int &v : vals)
+    v = -v; // descending
+  expect_round_trip(vals, PackedInts::Encoding::DELTA);
+}
+
+TEST(TestPackedInts, test_rle) {
+  vector<int32_t> vals;
+  for (int i = 0; i < 1000; i++)
+    vals.push_back(i / 250 * 1000003); // 4 long runs of wide values
+  expect_round_trip(vals, PackedInts::Encoding::RLE);
+}
+
+TEST(TestPackedInts, test_open__rejects_bad_bytes) {
+  vector<int32_t> vals;
+  for (int i = 0; i < 1000; i++)
+    vals.push_back(i / 250 * 1000003);
+  WriteCursor wc;
+  PackedInts::encode(vals.data(), vals.size(), wc);
+  vector<uint8_t> bytes(wc.begin(), wc.begin() + wc.length());
+
+  /* cut short */
+  ReadCursor cut(bytes.size() - 8, bytes.data());
+  PackedInts packed;
+  EXPECT_FALSE(packed.open(PackedInts::Encoding::RLE, 1000, cut));
+
+  /* run ends out of order, the first of 4 after the second */
+  uint32_t *run_ends = reinterpret_cast<uint32_t *>(bytes.data() + 8);
+  run_ends[0] = 600;
+  ReadCursor unordered(bytes.size(), bytes.data());
+  EXPECT_FALSE(packed.open(PackedInts::Encoding::RLE, 1000, unordered));
+  run_ends[0] = 250;
+  ReadCursor good(bytes.size(), bytes.data());
+  EXPECT_TRUE(packed.open(PackedInts::Encoding::RLE, 1000, good));
+  ReadCursor too_long(bytes.size(), bytes.data());
+  EXPECT_FALSE(packed.open(PackedInts::Encoding::RLE, 999, too_long));
+
+  /* wider than an int */
+  for (int i = 0; i < 1000; i++)
+    vals[i] = (i * 7919) % 1000;
+  WriteCursor for_wc;
+  EXPECT_EQ(PackedInts::encode(vals.data(), vals.size(), for_wc),
+            PackedInts::Encoding::FOR);
+  for_wc.begin()[4] = 33; // the width, after the int32 min
+  ReadCursor wide = for_wc;
+  EXPECT_FALSE(packed.open(PackedInts::Encoding::FOR, 1000, wide));
+}
+
+TEST(TestPackedInts, test_plain) {
+  vector<int32_t> vals;
+  for (int i = 0; i < 100; i++)
+    vals.push_back(i % 2 ? INT32_MAX - i : INT32_MIN + i * 104729);
+  expect_round_trip(vals, PackedInts::Encoding::PLAIN);
+  expect_round_trip({}, PackedInts::Encoding::PLAIN);
+}
+
+TEST(TestPackedInts, test_constant) {
+  vector<int32_t> vals(5000, 42);
+  WriteCursor wc;
+  PackedInts::Encoding enc = PackedInts::encode(vals.data(), vals.size(), wc);
+  EXPECT_TRUE(enc == PackedInts::Encoding::FOR || enc == PackedInts::Encoding::RLE);
+  EXPECT_LE(wc.length(), 32);
+  expect_round_trip(vals, enc);
+}
+
+TEST(TestPackedInts, test_random_round_trips) {
+  mt19937 rng(4500);
+  for (int t = 0; t < 200; t++) {
+    int n = rng() % 700;
+    int shape = t % 4;
+    vector<int32_t> vals(n);
+    int32_t v = rng();
+    for (int i = 0; i < n; i++) {
+      if (shape == 0)
+        v = rng(); // anything
+      else if (shape == 1)
+        v += rng() % 50; // sorted
+      else if (shape == 2 && rng() % 40 == 0)
+        v = rng(); // runs
+      else if (shape == 3)
+        v = rng() % (1 << (t % 31)); // narrow
+      vals[i] = v;
+    }
+    WriteCursor wc;
+    PackedInts::Encoding enc = PackedInts::encode(vals.data(), n, wc);
+    EXPECT_LE(wc.length(), (n * 4 + 7) / 8 * 8); // never bigger than plain
+    expect_round_trip(vals, enc);
+  }
+}
+
+TEST(TestPackedInts, test_kernels_match_scalar) {
+  mt19937 gen(4500);
+  vector<PackedInts::unpack_fn_t> unpacks = {PackedInts::unpack_scalar};
+  vector<PackedInts::running_sum_fn_t> sums = {PackedInts::running_sum_scalar};
+#ifdef PACKED_INTS_X86
+  if (__builtin_cpu_supports("avx2")) {
+    unpacks.push_back(PackedInts::unpack_avx2);
+    sums.push_back(PackedInts::running_sum_avx2);
+  }
+#endif
+  const int N = 1001; // not a multiple of the vector width
+  for (uint8_t width = 0; width <= 32; width++) {
+    /* padded like PackedInts::n_words, a word after at least one word */
+    vector<uint64_t> words(max(((uint64_t)N * width + 63) / 64, 1UL) + 1, 0);
+    vector<uint32_t> vals(N);
+    for (int i = 0; i < N; i++) {
+      vals[i] = width ? gen() & (uint32_t)((1ULL << width) - 1) : 0;
+      uint64_t bit = (uint64_t)i * width, k = bit >> 6, s = bit & 63;
+      words[k] |= (uint64_t)vals[i] << s;
+      if (s + width > 64)
+        words[k + 1] |= (uint64_t)vals[i] >> (64 - s);
+    }
+    for (PackedInts::unpack_fn_t unpack : unpacks) {
+      for (int start : {0, 1, 13}) {
+        vector<int32_t> out(N - start);
+        unpack(words.data(), (uint64_t)start * width, width, 7, N - start,
+               out.data());
+        for (int i = start; i < N; i++)
+          ASSERT_EQ((uint32_t)out[i - start], vals[i] + 7)
+              << "width " << (int)width << " at " << i;
+      }
+    }
+  }
+
+  vector<int32_t> deltas(N);
+  for (int32_t &d : deltas)
+    d = gen();
+  for (PackedInts::running_sum_fn_t sum : sums) {
+    vector<int32_t> out = deltas;
+    uint32_t total = sum(out.data(), N, 5);
+    uint32_t v = 5;
+    for (int i = 0; i < N; i++) {
+      v += (uint32_t)deltas[i];
+      ASSERT_EQ((uint32_t)out[i], v) << "at " << i;
+    }
+    EXPECT_EQ(total, v);
+  }
+}
@@ -24,3 +24,19 @@ TEST(TestIpV4Addr, test_c_str) {
   /* expect (str) conversion to be equiv to construction from str */
   EXPECT_STREQ(ip_str, s.str().c_str());
 }
+
+TEST(TestPacketHeader, test_parse__req_id) {
+  PacketHeader hdr(IpV4Addr("10.0.0.1"), IpV4Addr("10.0.0.2"),
+                   sizeof(PacketHeader), PacketType::DATA, 42);
+  alignas(PacketHeader) uint8_t buf[sizeof(PacketHeader)];
+  hdr.pack(buf);
+
+  PacketHeader *parsed = PacketHeader::parse(buf);
+  ASSERT_TRUE(parsed);
+  EXPECT_EQ(parsed->req_id, 42);
+
+  /* the checksum covers the id */
+  uint32_t other_id = 43;
+  memcpy(buf + offsetof(PacketHeader, req_id), &other_id, sizeof(other_id));
+  EXPECT_FALSE(PacketHeader::parse(buf));
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "sdk/parallel_parser.h"
+#include <string>
+
+class TestParallelParser : public ::testing::Test {
+public:
+  Schema scm;
+  string file;
+
+  void SetUp() { scm = Schema("IBS"); }
+
+  /* build a little over two and a half chunks worth of rows, the string in
+   * row split_row contains a new-line */
+  void build_file(int split_row = -1) {
+    for (int i = 0; i < DF_CHUNK_SIZE * 2.5; i++) {
+      file += "<" + to_string(i) + "><" + to_string(i % 2) + ">";
+      if (i == split_row)
+        file += "<a\nb>\n";
+      else
+        file += "<\"s" + to_string(i % 7) + "\">\n";
+    }
+  }
+
+  /* parse the file sequentially like Cluster::load_file used to */
+  void parse_sequential(const string &input, vector<DataFrameChunk> &dest) {
+    Parser parser(input.size(), const_cast<char *>(input.c_str()));
+    bool more_to_parse = true;
+    while (more_to_parse) {
+      dest.emplace_back(scm);
+      if (!parser.parse_n_lines(DF_CHUNK_SIZE, dest.back())) {
+        dest.pop_back();
+        break;
+      }
+      more_to_parse = dest.back().is_full();
+    }
+  }
+
+  void parse_parallel(const string &input, vector<DataFrameChunk> &dest) {
+    Parser parser(input.size(), const_cast<char *>(input.c_str()));
+    ThreadPool pool(4);
+    ParallelParser pparser(scm, parser, pool);
+    vector<DataFrameChunk> batch;
+    /* batches of 2 so the chunks are parsed over multiple calls */
+    while (pparser.parse_chunks(2, batch) > 0) {
+      for (DataFrameChunk &dfc : batch)
+        dest.push_back(move(dfc));
+    }
+  }
+};
+
+TEST_F(TestParallelParser, test_split_lines) {
+  Parser parser("<1>\n<2>\n<3>\n<4>\n<5>");
+  vector<sized_ptr<char>> ranges;
+  parser.split_lines(2, ranges);
+  EXPECT_EQ(ranges.size(), 3);
+  EXPECT_EQ(string(ranges[0].ptr, ranges[0].len), "<1>\n<2>\n");
+  EXPECT_EQ(string(ranges[1].ptr, ranges[1].len), "<3>\n<4>\n");
+  EXPECT_EQ(string(ranges[2].ptr, ranges[2].len), "<5>");
+}
+
+TEST_F(TestParallelParser, test_parse_chunks__matches_sequential) {
+  build_file();
+  vector<DataFrameChunk> expected;
+  parse_sequential(file, expected);
+  vector<DataFrameChunk> actual;
+  parse_parallel(file, actual);
+
+  EXPECT_EQ(expected.size(), 3);
+  ASSERT_EQ(actual.size(), expected.size());
+  for (int i = 0; i < expected.size(); i++)
+    EXPECT_TRUE(actual[i] == expected[i]);
+}
+
+TEST_F(TestParallelParser, test_parse_chunks__multi_line_value) {
+  /* an unquoted string containing a new-line shifts the chunk boundaries, the
+   * parallel parse should fall back to produce the same chunks */
+  build_file(100);
+  vector<DataFrameChunk> expected;
+  parse_sequential(file, expected);
+  vector<DataFrameChunk> actual;
+  parse_parallel(file, actual);
+
+  ASSERT_EQ(actual.size(), expected.size());
+  for (int i = 0; i < expected.size(); i++)
+    EXPECT_TRUE(actual[i] == expected[i]);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "lib/data.h"
+#include "lib/dataframe_chunk.h"
 #include "lib/schema.h"
 #include "lib/simple_dataframe.h"
 #include "sdk/parser.h"
@@ -19,19 +20,22 @@ public:
     Row r(*scm);
     r.set(0, true);
     r.set(1, (float)0);
-    r.set(2, new string("33"));
+    string s("33");
+    r.set(2, &s);
     r.set_missing(3);
     r.set_missing(4);
     df->add_row(r);
     r.set(0, false);
     r.set(1, 44.5f);
-    r.set(2, new string("apples"));
+    s = "apples";
+    r.set(2, &s);
     r.set(3, true);
     r.set_missing(4);
     df->add_row(r);
     r.set(0, true);
     r.set_missing(1);
-    r.set(2, new string("oranges"));
+    s = "oranges";
+    r.set(2, &s);
     r.set(3, false);
     r.set_missing(4);
     df->add_row(r);
@@ -60,3 +64,140 @@ TEST_F(TestParser, test__parse_file) {
   p.parse_file(n_df);
   EXPECT_TRUE(n_df.equals(*df));
 }
+
+TEST_F(TestParser, test__parse_file__scanner_matches_byte_wise) {
+  /* rows the scanner handles and rows it leaves to parse_row: '>' inside
+   * quotes, short rows, a mistyped value, and a value spanning lines */
+  const char *input = "<1><+2><\"a>b\"><-1.5>\n"
+                      "<0><><c\"d><>\n"
+                      "<1>\n"
+                      "<0><3><\"\"><2>\n"
+                      "<0><x>\n"
+                      "<0><4><f\ng><1>\n"
+                      "<1><-5><h><+3.0>";
+  Schema i_scm("BISF");
+  SimpleDataFrame byte_wise(i_scm);
+  Parser p1(input);
+  p1.use_scanner = false;
+  EXPECT_TRUE(p1.parse_file(byte_wise));
+
+  SimpleDataFrame scanned(i_scm);
+  Parser p2(input);
+  EXPECT_TRUE(p2.parse_file(scanned));
+
+  EXPECT_EQ(scanned.nrows(), 7);
+  EXPECT_EQ(scanned.get_int(0, 1), 2);
+  EXPECT_EQ(scanned.get_string(0, 2), "a>b");
+  EXPECT_EQ(scanned.get_string(1, 2), "c\"d");
+  EXPECT_EQ(scanned.get_string(4, 2), "x");
+  EXPECT_EQ(scanned.get_string(5, 2), "f\ng");
+  EXPECT_TRUE(scanned.equals(byte_wise));
+}
+
+TEST_F(TestParser, test__scan_row__leaves_cursor_on_failure) {
+  Schema i_scm("IS");
+  Row row(i_scm);
+  Parser p("<1.5><a>\n");
+  EXPECT_FALSE(p.scan_row(i_scm, row));
+  EXPECT_EQ(p.parse_pos(), 0);
+  Parser p2("<1><a>\n<2>");
+  EXPECT_TRUE(p2.scan_row(i_scm, row));
+  EXPECT_EQ(p2.parse_pos(), 7);
+  delete row.get<string *>(1);
+}
+
+TEST_F(TestParser, test__parse_n_lines__chunk_matches_row_path) {
+  /* rows written straight into the chunk's columns and rows which fall back
+   * to parse_row, including a row which is rejected after partially scanning */
+  const char *input = "<1><+2><\"a>b\"><-1.5>\n"
+                      "<0><x>\n"
+                      "<1><4><f\ng><1>\n"
+                      "<1><-5><h><+3.0>\n"
+                      "<0><6><i><7><8>\n";
+  Schema i_scm("BISF");
+  SimpleDataFrame expected(i_scm);
+  Parser p1(input);
+  p1.use_scanner = false;
+  EXPECT_FALSE(p1.parse_n_lines(10, expected));
+
+  DataFrameChunk dfc(i_scm);
+  Parser p2(input);
+  EXPECT_FALSE(p2.parse_n_lines(10, dfc));
+  EXPECT_EQ(p2.parse_pos(), 0);
+  EXPECT_EQ(dfc.nrows(), 4);
+  EXPECT_TRUE(dfc.equals(expected));
+
+  DataFrameChunk dfc2(i_scm);
+  Parser p3(input);
+  EXPECT_TRUE(p3.parse_n_lines(2, dfc2));
+  EXPECT_EQ(dfc2.nrows(), 2);
+  EXPECT_EQ(dfc2.get_string(0, 2), "a>b");
+  EXPECT_TRUE(dfc2.is_missing(1, 1));
+}
+
+TEST_F(TestParser, test__parse_float__matches_strtof) {
+  /* fast path, slow path, values which overflow from_chars, and values
+   * whose digits overflow a uint64_t */
+  string big = "1" + string(50, '0');
+  string tiny = "0." + string(50, '0') + "1";
+  string vals[] = {"0",
+                   "-0",
+                   "1.5",
+                   "-1.516158",
+                   "+3.0",
+                   "16777216",
+                   "16777217",
+                   "0.1",
+                   "3.14159265",
+                   "123456789012345678901234",
+                   big,
+                   tiny,
+                   "9999999999999999999",
+                   "18446744073709551616",
+                   "1844674407370955161.6",
+                   "36893488147419103232"};
+  for (const string &val : vals) {
+    string input = "<" + val + ">";
+    Parser p(input.c_str());
+    Data d;
+    EXPECT_TRUE(p.parse_val(Data::Type::FLOAT, d));
+    float expected = strtof(val.c_str(), nullptr);
+    float actual = d.get<float>();
+    EXPECT_EQ(memcmp(&expected, &actual, sizeof(float)), 0) << val;
+  }
+}
+
+TEST_F(TestParser, test__parse_val_type) {
+  Parser p("<><1><-12><+1.25><1.><\"1\"><a\"b><\"a>b\">");
+  Data::Type expected[] = {Data::Type::MISSING, Data::Type::BOOL,
+                           Data::Type::INT,     Data::Type::FLOAT,
+                           Data::Type::STRING,  Data::Type::STRING,
+                           Data::Type::STRING,  Data::Type::STRING};
+  for (Data::Type t : expected) {
+    Data::Type actual;
+    EXPECT_TRUE(p.parse_val_type(actual));
+    EXPECT_EQ(actual, t);
+  }
+}
+
+TEST_F(TestParser, test__infer_schema_sampled) {
+  /* the second column only becomes a float and the third a string far past
+   * the lines infer_schema reads, the last rows are wider */
+  string input;
+  for (int i = 0; i < 5000; i++) {
+    input += "<" + to_string(i) + ">";
+    input += i == 4000 ? "<1.5>" : "<" + to_string(i % 2) + ">";
+    input += i == 2500 ? "<abc>" : "<" + to_string(i) + ">";
+    input += i > 4990 ? "<1>\n" : "\n";
+  }
+  Parser head(input.size(), const_cast<char *>(input.c_str()));
+  Schema head_scm;
+  head.infer_schema(head_scm);
+  EXPECT_TRUE(head_scm == Schema("IBI"));
+
+  Parser p(input.size(), const_cast<char *>(input.c_str()));
+  Schema sampled;
+  EXPECT_TRUE(p.infer_schema_sampled(sampled, 20));
+  EXPECT_TRUE(sampled == Schema("IFSB"));
+  EXPECT_EQ(p.parse_pos(), 0);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "kv/partial_dataframe.h"
+#include "lib/rowers.h"
 #include "sample_rowers.h"
 
 TEST(TestPartialDataFrame, test_add_df_chunk__get) {
@@ -116,3 +117,108 @@ TEST(TestPartialDataFrame, test_map_non_contiguous) {
   EXPECT_EQ(rower.get_min(), 0);
   EXPECT_EQ(rower.get_max(), DF_CHUNK_SIZE * 5 - 1);
 }
+
+TEST(TestPartialDataFrame, test_map__skips_chunks_by_zone_map) {
+  Schema schema("II");
+  PartialDataFrame pdf(schema);
+
+  /* sorted ids, so each chunk holds a disjoint range */
+  Row row(schema);
+  for (int ci = 0; ci < 4; ci++) {
+    DataFrameChunk dfc(schema);
+    for (int i = ci * 1000; i < (ci + 1) * 1000; i++) {
+      row.set(0, i);
+      row.set(1, i * 2);
+      dfc.add_row(row);
+    }
+    WriteCursor wc;
+    dfc.serialize(wc);
+    ReadCursor rc = wc;
+    pdf.add_df_chunk(ci, rc);
+  }
+
+  const ZoneMap &zone = pdf.get_chunk(2).zone_map(0);
+  EXPECT_TRUE(zone.known);
+  EXPECT_EQ(zone.min, 2000);
+  EXPECT_EQ(zone.max, 2999);
+  EXPECT_EQ(zone.null_count, 0);
+
+  SearchIntIntRower rower(1, 0, {2500, 2501, 99999});
+  EXPECT_TRUE(rower.can_skip(pdf.get_chunk(0)));
+  EXPECT_TRUE(rower.can_skip(pdf.get_chunk(1)));
+  EXPECT_FALSE(rower.can_skip(pdf.get_chunk(2)));
+  EXPECT_TRUE(rower.can_skip(pdf.get_chunk(3)));
+
+  pdf.map(rower);
+  EXPECT_EQ(rower.get_results(), set<int>({5000, 5002}));
+}
+
+TEST(TestPartialDataFrame, test_map__skips_chunks_by_bloom_filter) {
+  Schema schema("II");
+  PartialDataFrame pdf(schema);
+
+  /* every chunk spans the same range, only even ids in even chunks, so the
+   * zone maps can't tell them apart but the Bloom filters can */
+  Row row(schema);
+  for (int ci = 0; ci < 4; ci++) {
+    DataFrameChunk dfc(schema);
+    for (int i = 0; i < 1000; i++) {
+      int id = ci % 2 == 0 ? i * 2 : i * 2 + 1;
+      row.set(0, id);
+      row.set(1, ci);
+      dfc.add_row(row);
+    }
+    dfc.build_bloom_filters(10);
+    WriteCursor wc;
+    dfc.serialize(wc);
+    ReadCursor rc = wc;
+    pdf.add_df_chunk(ci, rc);
+  }
+
+  EXPECT_FALSE(pdf.get_chunk(1).bloom_filter(0).empty());
+  EXPECT_TRUE(pdf.get_chunk(1).bloom_filter(0).may_contain(1001));
+
+  /* no false negatives, and at 10 bits a key no false positives for 3 terms
+   * in 2 chunks with this hash */
+  SearchIntIntRower rower(1, 0, {100, 102, 104});
+  EXPECT_FALSE(rower.can_skip(pdf.get_chunk(0)));
+  EXPECT_TRUE(rower.can_skip(pdf.get_chunk(1)));
+  EXPECT_FALSE(rower.can_skip(pdf.get_chunk(2)));
+  EXPECT_TRUE(rower.can_skip(pdf.get_chunk(3)));
+
+  pdf.map(rower);
+  EXPECT_EQ(rower.get_results(), set<int>({0, 2}));
+}
+
+TEST(TestPartialDataFrame, test_map__on_pool) {
+  Schema schema("I");
+  PartialDataFrame pdf(schema);
+
+  /* more chunks than slots, with chunk 7 missing */
+  Row row(schema);
+  uint64_t expected = 0;
+  for (int ci = 0; ci < 20; ci++) {
+    if (ci == 7)
+      continue;
+    DataFrameChunk dfc(schema);
+    for (int i = 0; i < 100; i++) {
+      row.set(0, ci * 100 + i);
+      expected += ci * 100 + i;
+      dfc.add_row(row);
+    }
+    WriteCursor wc;
+    dfc.serialize(wc);
+    ReadCursor rc = wc;
+    pdf.add_df_chunk(ci, rc);
+  }
+
+  for (int n_threads : {1, 3, 8}) {
+    ThreadPool pool(n_threads);
+    SumRower rower(0);
+    pdf.map(rower, pool);
+    EXPECT_EQ(rower.get_sum_result(), expected);
+  }
+  SumRower rower(0);
+  pdf.map(rower);
+  EXPECT_EQ(rower.get_sum_result(), expected);
+}
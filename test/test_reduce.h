@@ -0,0 +1,140 @@
+#pragma once
+
+#include "lib/reduce.h"
+#include "lib/rowers.h"
+#include <random>
+#include <vector>
+
+/**
+ * random values and a missing bitmap with about one in five values missing
+ */
+class TestReduce : public ::testing::Test {
+public:
+  static const int N = 1001; // not a multiple of any vector width
+  vector<int32_t> ints;
+  vector<float> floats;
+  vector<uint8_t> missing;
+
+  void SetUp() {
+    mt19937 gen(4500);
+    uniform_int_distribution<int32_t> int_dist(INT32_MIN, INT32_MAX);
+    uniform_real_distribution<float> float_dist(-1e6, 1e6);
+    missing.assign((N + 7) / 8, 0);
+    for (int i = 0; i < N; i++) {
+      ints.push_back(int_dist(gen));
+      floats.push_back(float_dist(gen));
+      if (gen() % 5 == 0)
+        missing[i / 8] |= 1 << (i % 8);
+    }
+  }
+
+  IntReduction expected_ints(const uint8_t *m) const {
+    IntReduction r;
+    for (int i = 0; i < N; i++) {
+      if (m && m[i / 8] >> (i % 8) & 1)
+        continue;
+      r.sum += ints[i];
+      r.count++;
+      r.min = min(r.min, ints[i]);
+      r.max = max(r.max, ints[i]);
+    }
+    return r;
+  }
+
+  vector<Reduce::int_fn_t> int_kernels() const {
+    vector<Reduce::int_fn_t> fns = {Reduce::ints_scalar_fn};
+#ifdef REDUCE_X86
+    fns.push_back(Reduce::ints_sse2);
+    if (__builtin_cpu_supports("avx2"))
+      fns.push_back(Reduce::ints_avx2);
+#endif
+    return fns;
+  }
+
+  vector<Reduce::float_fn_t> float_kernels() const {
+    vector<Reduce::float_fn_t> fns = {Reduce::floats_scalar_fn};
+#ifdef REDUCE_X86
+    fns.push_back(Reduce::floats_sse2);
+    if (__builtin_cpu_supports("avx2"))
+      fns.push_back(Reduce::floats_avx2);
+#endif
+    return fns;
+  }
+};
+
+TEST_F(TestReduce, test_ints__every_kernel) {
+  const uint8_t *none = nullptr, *some = missing.data();
+  for (const uint8_t *m : {none, some}) {
+    IntReduction expected = expected_ints(m);
+    for (Reduce::int_fn_t fn : int_kernels()) {
+      IntReduction r;
+      fn(ints.data(), m, N, r);
+      EXPECT_EQ(r.sum, expected.sum);
+      EXPECT_EQ(r.count, expected.count);
+      EXPECT_EQ(r.min, expected.min);
+      EXPECT_EQ(r.max, expected.max);
+    }
+  }
+}
+
+TEST_F(TestReduce, test_floats__every_kernel) {
+  const uint8_t *none = nullptr, *some = missing.data();
+  for (const uint8_t *m : {none, some}) {
+    FloatReduction expected;
+    Reduce::floats_scalar(floats.data(), m, N, expected);
+    for (Reduce::float_fn_t fn : float_kernels()) {
+      FloatReduction r;
+      fn(floats.data(), m, N, r);
+      /* summed in a different order, so only nearly equal */
+      EXPECT_NEAR(r.sum, expected.sum, 1e-3);
+      EXPECT_EQ(r.count, expected.count);
+      EXPECT_EQ(r.min, expected.min);
+      EXPECT_EQ(r.max, expected.max);
+    }
+  }
+}
+
+TEST_F(TestReduce, test_empty) {
+  IntReduction r;
+  Reduce::ints(ints.data(), nullptr, 0, r);
+  EXPECT_EQ(r.count, 0);
+  EXPECT_EQ(r.sum, 0);
+  vector<uint8_t> all_missing(8, 0xff);
+  Reduce::ints(ints.data(), all_missing.data(), 64, r);
+  EXPECT_EQ(r.count, 0);
+  EXPECT_EQ(r.min, INT32_MAX);
+}
+
+TEST_F(TestReduce, test_float_stats_rower) {
+  Schema scm("IF");
+  DataFrameChunk dfc(scm);
+  Row row(scm);
+  for (int i = 0; i < N; i++) {
+    row.set(0, i);
+    if (missing[i / 8] >> (i % 8) & 1)
+      row.set_missing(1);
+    else
+      row.set(1, floats[i]);
+    dfc.add_row(row);
+  }
+  FloatReduction expected;
+  Reduce::floats_scalar(floats.data(), missing.data(), N, expected);
+
+  FloatStatsRower by_batch(1), by_row(1);
+  dfc.map(by_batch);
+  dfc.DataFrame::map(by_row);
+  for (FloatStatsRower *rower : {&by_batch, &by_row}) {
+    EXPECT_NEAR(rower->get_results().sum, expected.sum, 1e-3);
+    EXPECT_EQ(rower->get_results().count, expected.count);
+    EXPECT_EQ(rower->get_results().min, expected.min);
+    EXPECT_EQ(rower->get_results().max, expected.max);
+  }
+
+  /* results join through serialization, like from each node in a map */
+  WriteCursor wc;
+  by_row.serialize_results(wc);
+  ReadCursor rc = wc;
+  by_batch.join_serialized(rc);
+  EXPECT_EQ(by_batch.get_results().count, expected.count * 2);
+  EXPECT_EQ(by_batch.get_results().min, expected.min);
+}
@@ -44,3 +44,22 @@ TEST_F(TestRow, test_pack_idx_data) {
   EXPECT_STREQ(row->get<string *>(2)->c_str(), r2.get<string *>(2)->c_str());
   EXPECT_EQ(row->get<bool>(3), r2.get<bool>(3));
 }
+
+TEST_F(TestRow, test_string_view) {
+  EXPECT_EQ(row->get<string_view>(2), "apples");
+
+  Row r2(*scm);
+  r2.set(0, 22);
+  r2.set(1, 44.5f);
+  string s("apples");
+  r2.set(2, string_view(s));
+  r2.set(3, true);
+  EXPECT_EQ(r2.get<string_view>(2).data(), s.data()); // not copied
+  EXPECT_TRUE(row->equals(r2));
+
+  WriteCursor wc;
+  r2.pack_idx_data(wc);
+  ReadCursor rc = wc;
+  Row r3(*scm, rc);
+  EXPECT_EQ(*r3.get<string *>(2), "apples");
+}
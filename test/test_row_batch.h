@@ -0,0 +1,167 @@
+#pragma once
+
+#include "kv/data_chunk.h"
+#include "lib/dataframe_chunk.h"
+#include "lib/rowers.h"
+#include <vector>
+
+/**
+ * Rower which only accepts Rows, to check the row-at-a-time fallback of
+ * DataFrameChunk::map
+ */
+class RowIdxRower : public Rower {
+public:
+  vector<int> idxs;
+  int64_t sum = 0;
+  int missing = 0;
+
+  bool accept(const Row &row) {
+    idxs.push_back(row.get_idx());
+    if (row.is_missing(0))
+      missing++;
+    else
+      sum += row.get<int>(0);
+    return true;
+  }
+  unique_ptr<Rower> clone() const { return make_unique<RowIdxRower>(); }
+};
+
+/**
+ * Rower which only reads column 0, records which columns it was given
+ */
+class ProjectedRower : public RowIdxRower {
+public:
+  bool saw_other_columns = false;
+
+  optional<vector<int>> projection() const { return vector<int>{0}; }
+  bool accept(const Row &row) {
+    for (int x = 1; x < row.width(); x++)
+      saw_other_columns = saw_other_columns || !row.is_missing(x);
+    return RowIdxRower::accept(row);
+  }
+};
+
+/**
+ * Rower which records the length and first index of every batch
+ */
+class BatchRower : public Rower {
+public:
+  vector<pair<int, int>> batches;
+  int64_t sum = 0;
+
+  bool accept(const Row &row) { assert(false); }
+  bool accept_batch(const RowBatch &batch) {
+    batches.emplace_back(batch.first_idx(), batch.length());
+    const int *vals = batch.ints(0);
+    for (int i = 0; i < batch.length(); i++)
+      sum += batch.is_missing(i, 0) ? 0 : vals[i];
+    return true;
+  }
+  unique_ptr<Rower> clone() const { return make_unique<BatchRower>(); }
+};
+
+class TestRowBatch : public ::testing::Test {
+public:
+  Schema scm{"IFBS"};
+  unique_ptr<DataFrameChunk> dfc;
+  int64_t sum = 0;
+  string words[3] = {"apple", "banana", "cherry"};
+
+  void SetUp() {
+    dfc = make_unique<DataFrameChunk>(scm);
+    Row row(scm);
+    for (int i = 0; i < 2500; i++) {
+      if (i % 100 == 7) {
+        row.set_missing(0);
+      } else {
+        row.set(0, i * 3);
+        sum += i * 3;
+      }
+      row.set(1, i * 0.5f);
+      row.set(2, i % 3 == 0);
+      row.set(3, &words[i % 3]);
+      dfc->add_row(row);
+    }
+  }
+};
+
+TEST_F(TestRowBatch, test_spans) {
+  RowBatch batch = dfc->row_batch(10000);
+  batch.seek(1024, 1024);
+  EXPECT_EQ(batch.length(), 1024);
+  EXPECT_EQ(batch.first_idx(), 11024);
+  /* plain columns are read in place */
+  EXPECT_EQ(batch.ints(0), &dfc->get_column(0).int_values()[1024]);
+  EXPECT_EQ(batch.floats(1), &dfc->get_column(1).float_values()[1024]);
+  for (int i = 0; i < batch.length(); i++) {
+    int y = 1024 + i;
+    EXPECT_EQ(batch.is_missing(i, 0), y % 100 == 7);
+    if (y % 100 != 7) {
+      EXPECT_EQ(batch.ints(0)[i], y * 3);
+    }
+    EXPECT_EQ(batch.floats(1)[i], y * 0.5f);
+    EXPECT_EQ(batch.bools(2)[i], y % 3 == 0);
+    EXPECT_EQ(batch.strings(3)[i], words[y % 3]);
+  }
+  EXPECT_TRUE(batch.may_have_missing(0));
+}
+
+TEST_F(TestRowBatch, test_spans__compressed) {
+  dfc->finalize();
+  EXPECT_EQ(dfc->get_column(0).int_values(), nullptr);
+  EXPECT_FALSE(dfc->zone_map(1).null_count);
+
+  RowBatch batch = dfc->row_batch();
+  batch.seek(2048, 2500 - 2048);
+  EXPECT_FALSE(batch.may_have_missing(1));
+  for (int i = 0; i < batch.length(); i++) {
+    int y = 2048 + i;
+    if (y % 100 != 7) {
+      EXPECT_EQ(batch.ints(0)[i], y * 3);
+    }
+  }
+
+  Row row(scm);
+  batch.fill_row(9, row);
+  EXPECT_EQ(row.get_idx(), 2057);
+  EXPECT_EQ(row.get<int>(0), 2057 * 3);
+  EXPECT_EQ(row.get<string_view>(3), words[2057 % 3]);
+  batch.fill_row(59, row);
+  EXPECT_TRUE(row.is_missing(0));
+}
+
+TEST_F(TestRowBatch, test_map__batches) {
+  BatchRower rower;
+  dfc->map(rower, 65536);
+  vector<pair<int, int>> expected = {
+      {65536, 1024}, {65536 + 1024, 1024}, {65536 + 2048, 2500 - 2048}};
+  EXPECT_EQ(rower.batches, expected);
+  EXPECT_EQ(rower.sum, sum);
+}
+
+TEST_F(TestRowBatch, test_map__rows_fallback) {
+  /* serialize so the chunk is a view with compressed columns */
+  dfc->finalize();
+  WriteCursor wc;
+  dfc->serialize(wc);
+  DataChunk data(move(wc));
+  ReadCursor rc = data.cursor();
+  DataFrameChunk view(scm, rc);
+
+  RowIdxRower rower;
+  view.map(rower, 100);
+  ASSERT_EQ(rower.idxs.size(), 2500);
+  for (int i = 0; i < 2500; i++)
+    EXPECT_EQ(rower.idxs[i], 100 + i);
+  EXPECT_EQ(rower.sum, sum);
+  EXPECT_EQ(rower.missing, 25);
+}
+
+TEST_F(TestRowBatch, test_map__projection) {
+  ProjectedRower rower;
+  dfc->map(rower);
+  EXPECT_EQ(rower.idxs.size(), 2500);
+  EXPECT_EQ(rower.sum, sum);
+  EXPECT_EQ(rower.missing, 25);
+  EXPECT_FALSE(rower.saw_other_columns);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "sdk/stream_parser.h"
+#include <string>
+
+class TestStreamParser : public ::testing::Test {
+public:
+  Schema scm;
+  string file;
+  long read_pos = 0;
+
+  void SetUp() { scm = Schema("IBS"); }
+
+  /* two and a half chunks worth of rows */
+  void build_file() {
+    for (int i = 0; i < DF_CHUNK_SIZE * 2.5; i++) {
+      file += "<" + to_string(i) + "><" + to_string(i % 2) + "><\"s" +
+              to_string(i % 7) + "\">\n";
+    }
+  }
+
+  /* reads at most max_read bytes of file at a time, like a pipe */
+  StreamParser::read_fn_t reader(long max_read) {
+    return [this, max_read](char *buf, long n) {
+      long len = min(n, min(max_read, (long)file.size() - read_pos));
+      memcpy(buf, file.c_str() + read_pos, len);
+      read_pos += len;
+      return len;
+    };
+  }
+
+  void parse_sequential(vector<DataFrameChunk> &dest) {
+    Parser parser(file.size(), const_cast<char *>(file.c_str()));
+    bool more_to_parse = true;
+    while (more_to_parse) {
+      dest.emplace_back(scm);
+      if (!parser.parse_n_lines(DF_CHUNK_SIZE, dest.back())) {
+        dest.pop_back();
+        break;
+      }
+      more_to_parse = dest.back().is_full();
+    }
+  }
+
+  void parse_stream(StreamParser &parser, vector<DataFrameChunk> &dest) {
+    while (true) {
+      dest.emplace_back(scm);
+      if (!parser.next_chunk(dest.back())) {
+        dest.pop_back();
+        break;
+      }
+    }
+  }
+};
+
+TEST_F(TestStreamParser, test_infer_schema) {
+  build_file();
+  StreamParser parser(reader(1000), 4096);
+  Schema inferred;
+  EXPECT_TRUE(parser.infer_schema(inferred));
+  EXPECT_EQ(inferred, scm);
+}
+
+TEST_F(TestStreamParser, test_next_chunk__matches_sequential) {
+  build_file();
+  vector<DataFrameChunk> expected;
+  parse_sequential(expected);
+
+  /* small window and reads so lines are split across reads */
+  StreamParser parser(reader(1000), 4096);
+  Schema inferred;
+  parser.infer_schema(inferred);
+  vector<DataFrameChunk> actual;
+  parse_stream(parser, actual);
+
+  EXPECT_EQ(expected.size(), 3);
+  ASSERT_EQ(actual.size(), expected.size());
+  for (int i = 0; i < expected.size(); i++)
+    EXPECT_TRUE(actual[i] == expected[i]);
+}
+
+TEST_F(TestStreamParser, test_next_chunk__line_larger_than_window) {
+  file = "<1><0><\"" + string(100, 'a') + "\">\n<2><1><\"b\">";
+  StreamParser parser(reader(7), 16);
+  DataFrameChunk dfc(scm);
+  EXPECT_TRUE(parser.next_chunk(dfc));
+  EXPECT_EQ(dfc.nrows(), 2);
+  EXPECT_EQ(dfc.get_string(0, 2), string(100, 'a'));
+  EXPECT_EQ(dfc.get_int(1, 0), 2);
+
+  DataFrameChunk empty(scm);
+  EXPECT_FALSE(parser.next_chunk(empty));
+}
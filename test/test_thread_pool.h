@@ -0,0 +1,66 @@
+#pragma once
+
+#include "lib/thread_pool.h"
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST(TestThreadPool, test_run__every_task_once) {
+  for (int n_threads : {1, 2, 4}) {
+    ThreadPool pool(n_threads);
+    EXPECT_EQ(pool.slots(), n_threads);
+    for (int n_tasks : {0, 1, 3, 1000}) {
+      vector<atomic<int>> runs(n_tasks);
+      pool.run(n_tasks, [&](int task, int slot) {
+        EXPECT_GE(slot, 0);
+        EXPECT_LT(slot, pool.slots());
+        runs[task]++;
+      });
+      for (int i = 0; i < n_tasks; i++)
+        EXPECT_EQ(runs[i], 1);
+    }
+  }
+}
+
+TEST(TestThreadPool, test_run__slots_are_not_shared) {
+  ThreadPool pool(4);
+  vector<atomic<int>> in_slot(pool.slots());
+  atomic<bool> shared(false);
+  pool.run(200, [&](int task, int slot) {
+    if (in_slot[slot]++ > 0)
+      shared = true;
+    this_thread::sleep_for(chrono::microseconds(50));
+    in_slot[slot]--;
+  });
+  EXPECT_FALSE(shared);
+}
+
+TEST(TestThreadPool, test_run__steals_from_slow_slot) {
+  ThreadPool pool(4);
+  /* slot 0 starts with tasks [0, 16), whichever thread runs the slow task 0
+   * should find the rest of its range stolen by the others meanwhile */
+  vector<int> slot_of(64);
+  pool.run(64, [&](int task, int slot) {
+    this_thread::sleep_for(chrono::milliseconds(task == 0 ? 100 : 1));
+    slot_of[task] = slot;
+  });
+  int stolen = 0;
+  for (int task = 1; task < 16; task++)
+    stolen += slot_of[task] != slot_of[0];
+  EXPECT_GT(stolen, 0);
+}
+
+TEST(TestThreadPool, test_run__concurrent_jobs) {
+  ThreadPool pool(3);
+  atomic<long> sum(0);
+  vector<thread> callers;
+  for (int c = 0; c < 4; c++)
+    callers.emplace_back([&]() {
+      pool.run(500, [&](int task, int slot) { sum += task; });
+    });
+  for (thread &t : callers)
+    t.join();
+  EXPECT_EQ(sum, 4L * 499 * 500 / 2);
+}